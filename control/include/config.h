@@ -25,6 +25,12 @@
  *     steps_per_rotation = positive integer, indicating the amount of full steps in a single rotation of a motor.
  *     direction = String, either "clockwise" or "counterclockwise". Initial rotational direction of the motor.
  *     microstep = Number, either 1, 2, 4, 8, 16 or 32. Indicates the microstep resolution of the driver.
+ *     acceleration = (Optional) Positive integer, maximum acceleration of the motor in microsteps/s².
+ *                    If given, moves ramp up to and down from their speed instead of starting and stopping abruptly.
+ *     jerk = (Optional) Positive integer, maximum jerk of the motor in microsteps/s³. Used by S-curve moves.
+ *     timing = (Optional) String, either "sleep" (default) or "hybrid". With "hybrid", the pulser spins before every
+ *              edge instead of only sleeping, allowing speeds up to STEPPER_MAX_PPS. Meant for pulsers on an isolated core.
+ *     cpu = (Optional) Non-negative integer, index of the CPU on which the thread of the motor runs.
  * 
  * [axis] = identifier for initializing an axis.
  * Following parameters apply only to axes:
@@ -4,5 +4,7 @@
 // System-wide parameter.
 // Base directory of the program. 
 #define BASE_PATH "/home/nvidia/pef_pr21/"
+// Directory where the traces asked by CMD_TRACE are saved.
+#define TRACE_PATH BASE_PATH "traces/"
 
 #endif 
\ No newline at end of file
@@ -20,6 +20,10 @@ struct motor_config{
     unsigned int microstep;
     unsigned int steps_rot;
     unsigned int direction;
+    unsigned int accel;
+    unsigned int jerk;
+    stepper_timing_t timing;
+    int cpu;
     Stepper* motor;
 };
 
@@ -62,6 +66,10 @@ enum params{
     STEPS_ROT,
     DIRECTION,
     MICROSTEP,
+    ACCELERATION,
+    JERK,
+    TIMING,
+    CPU,
     AXIS_NAME,
     MOTOR_LIST,
     MM_ROT,
@@ -69,9 +77,9 @@ enum params{
 };
 
 // Parameter list data for motor objects
-static const char* motor_params[] = {"name", "step_pin", "dir_pin", "steps_per_rotation", "direction", "microstep"};
-static const enum params motor_params_id[] = {MOTOR_NAME, STEP_PIN, DIR_PIN, STEPS_ROT, DIRECTION, MICROSTEP}; //Corresponding symbol for the string in motor_params
-static const int motor_params_len[] = {4, 8, 7, 18, 9, 9};  //Lenght of corresponding string in motor_params, without the NULL terminator. 
+static const char* motor_params[] = {"name", "step_pin", "dir_pin", "steps_per_rotation", "direction", "microstep", "acceleration", "jerk", "timing", "cpu"};
+static const enum params motor_params_id[] = {MOTOR_NAME, STEP_PIN, DIR_PIN, STEPS_ROT, DIRECTION, MICROSTEP, ACCELERATION, JERK, TIMING, CPU}; //Corresponding symbol for the string in motor_params
+static const int motor_params_len[] = {4, 8, 7, 18, 9, 9, 12, 4, 6, 3};  //Lenght of corresponding string in motor_params, without the NULL terminator. 
 static const int motor_params_count = sizeof(motor_params)/sizeof(char*);
 
 // Parameter list data for axis objects
@@ -141,6 +149,23 @@ static int str_to_dir(const char* s)
     return DIRECTION_INVALID;
 }
 
+/**
+ * @brief Convert a string with a pulse timing to the corresponding constant.
+ * 
+ * @param s (in) String to convert.
+ * @return (int) If s = "sleep" -> TIMING_SLEEP; s = "hybrid" -> TIMING_HYBRID. Invalid values of s return -1.
+ */
+static int str_to_timing(const char* s)
+{
+    if(strncmp(s, "sleep", 6) == 0)
+        return TIMING_SLEEP;
+
+    if(strncmp(s, "hybrid", 7) == 0)
+        return TIMING_HYBRID;
+
+    return -1;
+}
+
 /**
  * @brief Convert a string to a positive integer.
  * 
@@ -609,6 +634,54 @@ static void state_set_param(const enum params param_id, const char* value_buff)
             }
             break;
         
+        case ACCELERATION:
+            // Validate the string and convert to a number if valid.
+            temp = str_to_int(value_buff);
+            if(temp > 0){
+                motor_list[motor_list_len-1].accel = temp; // Set motor's maximum acceleration.
+            } else{
+                // Error if string is invalid.
+                snprintf(err_str, ERROR_STR_LEN-1, "%s is not a valid value for acceleration.", value_buff);
+                motor_config_state = ERROR;
+            }
+            break;
+
+        case JERK:
+            // Validate the string and convert to a number if valid.
+            temp = str_to_int(value_buff);
+            if(temp > 0){
+                motor_list[motor_list_len-1].jerk = temp; // Set motor's maximum jerk.
+            } else{
+                // Error if string is invalid.
+                snprintf(err_str, ERROR_STR_LEN-1, "%s is not a valid value for jerk.", value_buff);
+                motor_config_state = ERROR;
+            }
+            break;
+
+        case TIMING:
+            // Validate the string and convert to a pulse timing if valid.
+            temp = str_to_timing(value_buff);
+            if(temp >= 0){
+                motor_list[motor_list_len-1].timing = temp; // Set motor's pulse timing.
+            } else{
+                // Error if string is invalid.
+                snprintf(err_str, ERROR_STR_LEN-1, "%s is not a valid value for timing.", value_buff);
+                motor_config_state = ERROR;
+            }
+            break;
+
+        case CPU:
+            // Validate the string and convert to a number if valid.
+            temp = str_to_int(value_buff);
+            if(temp >= 0){
+                motor_list[motor_list_len-1].cpu = temp; // Set motor's CPU.
+            } else{
+                // Error if string is invalid.
+                snprintf(err_str, ERROR_STR_LEN-1, "%s is not a valid value for cpu.", value_buff);
+                motor_config_state = ERROR;
+            }
+            break;
+
         case AXIS_NAME:
             // Set the name of the axis. String passed as is.
             strncpy(axis_list[axis_list_len-1].name, value_buff, AXIS_NAME_LEN - 1);
@@ -850,6 +923,34 @@ static int init_motors(void)
                 retval = -1;
                 goto exit;
             }
+
+            // Acceleration is optional. Motors without it are not ramped.
+            if(node->accel > 0 && stepper_set_acceleration(node->motor, node->accel) < 0){
+                ERROR_PRINT("Error setting the acceleration of a motor from " MOTOR_CONFIG_NAME "\n");
+                retval = -1;
+                goto exit;
+            }
+
+            // Jerk is optional. Without it, S-curve moves are trapezoidal.
+            if(node->jerk > 0 && stepper_set_jerk(node->motor, node->jerk) < 0){
+                ERROR_PRINT("Error setting the jerk of a motor from " MOTOR_CONFIG_NAME "\n");
+                retval = -1;
+                goto exit;
+            }
+
+            // Timing is optional. Motors sleep between edges by default.
+            if(node->timing != TIMING_SLEEP && stepper_set_timing(node->motor, node->timing) < 0){
+                ERROR_PRINT("Error setting the timing of a motor from " MOTOR_CONFIG_NAME "\n");
+                retval = -1;
+                goto exit;
+            }
+
+            // CPU is optional. Without it, the thread of the motor runs on any CPU.
+            if(node->cpu >= 0 && stepper_set_cpu(node->motor, node->cpu) < 0){
+                ERROR_PRINT("Error setting the CPU of a motor from " MOTOR_CONFIG_NAME "\n");
+                retval = -1;
+                goto exit;
+            }
         } else{
             ERROR_PRINT("A motor in " MOTOR_CONFIG_NAME " is not fully configured.\n");
             retval = -1;
@@ -904,8 +1005,10 @@ int read_motor_config(void)
     memset(motor_list, 0, sizeof(motor_list));
     memset(axis_list, 0, sizeof(axis_list));
 
-    for(int i = 0; i < MOTOR_LIST_SIZE_MAX; i++) 
+    for(int i = 0; i < MOTOR_LIST_SIZE_MAX; i++){
         motor_list[i].direction = DIRECTION_INVALID; // 0 is valid direction constant, thus must be changed to DIRECTION_INVALID
+        motor_list[i].cpu = -1; // CPU 0 is valid, so -1 means the CPU was not given
+    }
 
     // State machine
     int error = motor_config_state_machine(config_file);
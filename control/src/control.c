@@ -6,33 +6,40 @@
 #include "sysconfig.h"
 #include "Stepper.h"
 #include "Axis.h"
+#include "Trace.h"
 #include "Time.h"
 #include "ipc.h"
 #include "config.h"
 #include "debug.h"
 
 #define MSG_BUFF_SIZE 256
+#define TRACE_EVENTS (1 << 16)  // Last edges of the axis kept for CMD_TRACE
 
 typedef enum cmds{
     CMD_MOVE = 0x01,
     CMD_STOP = 0x02,
     CMD_FINISH = 0x03,
     CMD_GETPOS = 0x04,
-    CMD_PARAMS = 0x05
+    CMD_PARAMS = 0x05,
+    CMD_FEED = 0x06,
+    CMD_TRACE = 0x07
 } cmd_t;
 
 static pid_t zed_pid = 0;
 static pid_t lidar_pid = 0;
 
 static Axis* x_axis = NULL;
+static Trace* x_trace = NULL;
 
 static volatile int stop = 0;
+static int finishing = 0;   // CMD_FINISH received, exit once the axis is idle
 
 static int zed_socket = 0;
 static int lidar_socket = 0;
 static int flask_socket = 0;
 
 static int e_stop_fd = 0;
+static int axis_fd = 0;
 
 // {d: double, v: double, freq: char, freq_s: char, res: char, inter_img: double, sensors: char (1:lidar,2:zed,0:both)}
 
@@ -86,18 +93,63 @@ static int cmd_move(const char* data, int len)
     double speed = *(double*)&data[0];
     double distance = *(double*)&data[sizeof(double)];
 
-    axis_set_speed(x_axis, speed);
-    axis_move(x_axis, distance);
+    // Moves received while the axis is moving are queued and joined with the previous one
+    if(axis_queue_move(x_axis, distance, speed) < 0)
+        ERROR_PRINT("Could not queue the move.");
+
+    return 0;
+}
+
+static int cmd_feed(const char* data, int len)
+{
+    double percent = *(double*)&data[0];
+
+    // Applied to the move in progress, ramping at the acceleration of the axis
+    if(axis_set_feed(x_axis, percent) < 0)
+        ERROR_PRINT("Could not override the feed rate.");
+
+    return 0;
+}
+
+static int cmd_trace(const char* data, int len)
+{
+    char path[MSG_BUFF_SIZE];
+
+    // File name, without terminator. Traces are only written to TRACE_PATH.
+    // A trace is only a diagnostic, so a bad name is reported without stopping the program.
+    if(len <= 0 || len >= (int)(sizeof(path) - sizeof(TRACE_PATH))){
+        ERROR_PRINT("Invalid trace file name length: %d.", len);
+        return 0;
+    }
+    if(memchr(data, '/', len) != NULL || memchr(data, '\0', len) != NULL || data[0] == '.'){
+        ERROR_PRINT("Invalid trace file name.");
+        return 0;
+    }
+
+    memcpy(path, TRACE_PATH, sizeof(TRACE_PATH) - 1);
+    memcpy(&path[sizeof(TRACE_PATH) - 1], data, len);
+    path[sizeof(TRACE_PATH) - 1 + len] = '\0';
+
+    // Saved while the axis moves. Convert it with the trace_dump tool.
+    if(trace_save(x_trace, path) < 0)
+        ERROR_PRINT("Could not save the trace to %s.", path);
 
     return 0;
 }
 
 static int cmd_getpos(const char* data, int len)
 {
-    //TODO: Add error checking
-    double pos = axis_get_position(x_axis);
-    struct timespec t_now;
-    clock_gettime(CLOCK_MONOTONIC, &t_now);
+    double pos;
+    struct timespec t_step;
+
+    // Position is sent with the time of the step that reached it. An axis that hasn't moved is
+    // stamped with the current time.
+    if(axis_get_position_stamped(x_axis, &pos, &t_step) < 0){
+        ERROR_PRINT("Could not get the position of the axis.");
+        return -1;
+    }
+    if(t_step.tv_sec == 0 && t_step.tv_nsec == 0)
+        clock_gettime(CLOCK_MONOTONIC, &t_step);
 
     char response[64];
     size_t offset = 0;
@@ -106,9 +158,9 @@ static int cmd_getpos(const char* data, int len)
     response[offset++] = CMD_GETPOS;
     memcpy(&response[offset], &pos, sizeof(double));
     offset += sizeof(double);
-    memcpy(&response[offset], &t_now.tv_sec, sizeof(time_t));
+    memcpy(&response[offset], &t_step.tv_sec, sizeof(time_t));
     offset += sizeof(time_t);
-    memcpy(&response[offset], &t_now.tv_nsec, sizeof(long));
+    memcpy(&response[offset], &t_step.tv_nsec, sizeof(long));
     offset += sizeof(long);
 
     write(zed_socket, response, offset);
@@ -145,21 +197,24 @@ static int decode_message(const char* msg)
             break;
         
         case CMD_STOP:
+            // Decelerates, so the position stays valid and the axis doesn't need to be homed again
             DEBUG_PRINT("Recieved command: CMD_STOP");
-            axis_stop(x_axis);
+            axis_stop_decel_nowait(x_axis);
             break;
         
         case CMD_FINISH:
             DEBUG_PRINT("Recieved command: CMD_FINISH");
-            if(data[0] == 0){
-                DEBUG_PRINT("AXIS_WAIT");
-                axis_wait(x_axis);
+            if(data[0] != 0){
+                DEBUG_PRINT("AXIS_STOP");
+                axis_stop_nowait(x_axis);
             }
-            else{
-                DEBUG_PRINT("AXIS_WAIT");
-                axis_stop(x_axis);
-            }
-            stop = 1;
+
+            // The main loop keeps serving the sockets until the axis is idle (see axis_fd)
+            axis_clear_event(x_axis);
+            if(axis_ready(x_axis))
+                stop = 1;
+            else
+                finishing = 1;
             break;
 
         case CMD_GETPOS:
@@ -176,6 +231,16 @@ static int decode_message(const char* msg)
                 write(zed_socket, msg, n);
             break;
 
+        case CMD_FEED:
+            DEBUG_PRINT("Recieved command: CMD_FEED");
+            retval = cmd_feed(data, n-2);
+            break;
+
+        case CMD_TRACE:
+            DEBUG_PRINT("Recieved command: CMD_TRACE");
+            retval = cmd_trace(data, n-2);
+            break;
+
         default:
             ERROR_PRINT("Unknown command received from partner process.");
             retval = -1;
@@ -218,17 +283,27 @@ static int init_system(int argc, char const *argv[])
 
     DEBUG_PRINT("Axis x-axis initialized successfully.");
 
+    // Edges of the axis are recorded by the pulser of its first motor, which leads its moves
+    x_trace = trace_create(TRACE_EVENTS);
+    if(x_trace == NULL || stepper_set_trace(x_axis->motors[0], x_trace) < 0){
+        ERROR_PRINT("Could not start the trace of x-axis.");
+        goto exit;
+    }
+
     // Initialize GPIO for emergency stop and limit switches
     // TODO: Add limit switches
     GPIO_Pin* emer_stop = GPIO_init_pin(J21_HEADER_PIN_37, GPIO_DIRECTION_NONE, 0);
-    if(gpiod_line_request_rising_edge_events(emer_stop, "PEF") < 0){
+    if(emer_stop == NULL || GPIO_request_events(emer_stop) < 0){
         ERROR_PRINT("Could not initialize emergency stop input.");
         goto exit;
     }
-    e_stop_fd = gpiod_line_event_get_fd(emer_stop);
+    e_stop_fd = GPIO_get_event_fd(emer_stop);
 
     DEBUG_PRINT("Emergency stop initialized successfully.");
 
+    // Readable when a move of the axis finishes
+    axis_fd = axis_get_event_fd(x_axis);
+
     // Set handler for user interrupt
     signal(SIGINT, sigint_handler);
 
@@ -296,6 +371,7 @@ int main(int argc, char const *argv[])
     while(!stop){
         FD_ZERO(&read_set);
         FD_SET(e_stop_fd, &read_set);
+        FD_SET(axis_fd, &read_set);
         for(unsigned int i = 0; i < socket_list_len; i++)
             FD_SET(socket_list[i], &read_set);
 
@@ -304,7 +380,13 @@ int main(int argc, char const *argv[])
         if(n > 0){
             if(FD_ISSET(e_stop_fd, &read_set)){
                 DEBUG_PRINT("Emergency stop pressed. Exiting.");
+                axis_stop_nowait(x_axis);
                 stop = 1;
+            } else if(FD_ISSET(axis_fd, &read_set)){
+                DEBUG_PRINT("Axis move finished at %.3f mm.", axis_get_position(x_axis));
+                axis_clear_event(x_axis);
+                if(finishing && axis_ready(x_axis))
+                    stop = 1;
             } else{
                 DEBUG_PRINT("Message recieved.");
 
@@ -21,6 +21,7 @@
 
 #define AXIS_LIST_SIZE_MAX 4 /**< Maximum amount of motors that can be linked to an axis*/
 #define AXIS_NAME_LEN 32 /**< Maximum lenght for the name of an axis*/
+#define AXIS_FRAC_BITS 32 /**< Fractional bits of the commanded position of the motors of an axis*/
 
 /**
  * @brief Axis object.
@@ -32,6 +33,8 @@ typedef struct axis{
     double mm_per_rotation; /**< Millimeters advanced in a single rotation of a motor.*/
     double position; /**< Current position of the axis, in mm, relative to the home position.*/
     double speed; /**< Current speed of the motor, in mm/sec.*/
+    long long commanded[MOTOR_LIST_SIZE_MAX]; /**< @internal Commanded position of each motor, in 2^-AXIS_FRAC_BITS microsteps.*/
+    long long issued[MOTOR_LIST_SIZE_MAX]; /**< @internal Position of each motor once the commanded moves are done, in microsteps.*/
 } Axis;
 
 /**
@@ -53,6 +56,18 @@ Axis* axis_init(Stepper* motors[], unsigned int mm_per_rotation, unsigned int co
  */
 int axis_set_speed(Axis* axis, double mm_per_sec);
 
+/**
+ * @brief Override the feed rate of an axis while it moves.
+ * 
+ * The move in progress and the queued ones run at the given fraction of their speed. The axis
+ * changes speed at its maximum acceleration.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] percent Feed rate, in percent of the programmed speed (STEPPER_FEED_MIN to 100).
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_set_feed(Axis* axis, double percent);
+
 /**
  * @brief Set the direction of an axis. 
  * 
@@ -65,6 +80,15 @@ int axis_set_speed(Axis* axis, double mm_per_sec);
  */
 int axis_set_direction(Axis* axis, direction_rel_t direction);
 
+/**
+ * @brief Set the motion profile used by the next moves of an axis.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] type PROFILE_CONSTANT, PROFILE_TRAPEZOIDAL or PROFILE_SCURVE.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_set_profile(Axis* axis, profile_type_t type);
+
 /**
  * @brief Move an axis a set distance.
  * 
@@ -76,6 +100,20 @@ int axis_set_direction(Axis* axis, direction_rel_t direction);
  */
 int axis_move(Axis* axis, double distance);
 
+/**
+ * @brief Queue a move of an axis, joined with the previous queued move if possible.
+ * 
+ * If the axis is idle, the move starts right away. Otherwise, it runs after the moves queued
+ * before it, without stopping in between if both go in the same direction. Negative distance
+ * implies to move in the opposite direction.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] distance Distance to advance in mm (can be positive or negative).
+ * @param[in] mm_per_sec Speed of the move in mm/sec (must be positive).
+ * @return (int) On success, 0. Otherwise (e.g. the queue is full), -1.
+ */
+int axis_queue_move(Axis* axis, double distance, double mm_per_sec);
+
 /**
  * @brief Wait until an axis stops moving.
  * 
@@ -92,12 +130,60 @@ void axis_wait(Axis* axis);
 int axis_ready(Axis* axis);
 
 /**
- * @brief Stop an axis from moving.
+ * @brief Stop an axis from moving, immediately.
+ * 
+ * Steps may be lost at high speeds. Meant for emergency stops, see axis_stop_decel() otherwise.
  * 
  * @param[in] axis Handle of the axis to update.
  */
 void axis_stop(Axis* axis);
 
+/**
+ * @brief Ask an axis to stop, without waiting for it.
+ * 
+ * The event file descriptor of the axis becomes readable once it has stopped (see axis_get_event_fd()).
+ * 
+ * @param[in] axis Handle of the axis to update.
+ */
+void axis_stop_nowait(Axis* axis);
+
+/**
+ * @brief Ask an axis to decelerate to a stop, without waiting for it.
+ * 
+ * No step is lost, so the position of the axis stays valid. See stepper_stop_decel_nowait().
+ * 
+ * @param[in] axis Handle of the axis to update.
+ */
+void axis_stop_decel_nowait(Axis* axis);
+
+/**
+ * @brief Decelerate an axis to a stop.
+ * 
+ * Function blocks until the axis has stopped. See axis_stop_decel_nowait().
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @return (double) On success, position at which the axis stopped, in mm. Otherwise, NAN.
+ */
+double axis_stop_decel(Axis* axis);
+
+/**
+ * @brief Get the event file descriptor of an axis.
+ * 
+ * The descriptor becomes readable when a move of the axis finishes, or is stopped, and stays readable
+ * until cleared with axis_clear_event(). Clear it before checking axis_ready(), so no completion is missed.
+ * 
+ * @param[in] axis Handle to the axis.
+ * @return (int) File descriptor on success, negative value otherwise.
+ */
+int axis_get_event_fd(Axis* axis);
+
+/**
+ * @brief Clear the event file descriptor of an axis.
+ * 
+ * @param[in] axis Handle to the axis.
+ */
+void axis_clear_event(Axis* axis);
+
 /**
  * @brief Get the current position of an axis
  * 
@@ -106,4 +192,30 @@ void axis_stop(Axis* axis);
  */
 double axis_get_position(Axis* axis);
 
+/**
+ * @brief Get the commanded position of an axis.
+ * 
+ * Sum of the distances of the moves commanded since the axis was created, or since it was last
+ * stopped. Moves are rounded to whole microsteps, and the remainder is carried into the next move,
+ * so the actual position (see axis_get_position()) stays within half a microstep of the commanded
+ * one once the axis is idle.
+ * 
+ * @param[in] axis Handle of the axis of interest.
+ * @return (double) On success, commanded position of the axis in mm. Otherwise, NAN.
+ */
+double axis_get_commanded_position(Axis* axis);
+
+/**
+ * @brief Get the current position of an axis, and the time at which the axis reached it.
+ * 
+ * The position and the time belong to the same step of the first motor of the axis, so they
+ * can be matched with other measurements. Doesn't lock, and can be called from any thread.
+ * 
+ * @param[in] axis Handle of the axis of interest.
+ * @param[out] position Current position of the axis, in mm.
+ * @param[out] t_step CLOCK_MONOTONIC time of the last step of the axis. Zero if it hasn't moved.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_get_position_stamped(Axis* axis, double* position, struct timespec* t_step);
+
 #endif
@@ -6,6 +6,7 @@
  *          The public interface consists mainly of the enum to access the pins on the J21 header of the Jetson board,
  *          functions to initialize said pins either in bulk or individually,
  *          and some wrappers with friendly names around functions from the gpiod library.
+ *          The lines are driven through a backend, so the library can also run on a simulated chip (see GPIO_sim.h).
  * @version 1.0
  * @date 03.07.2021
  * 
@@ -17,6 +18,7 @@
 
 #include <gpiod.h> // Library for communicating with the GPIO char device driver.
 #include <stdio.h>
+#include <stdlib.h>
 
 // Paths to the device drivers of the GPIO pins.
 #define GPIO_MAIN_CONTROLLER_PATH "/dev/gpiochip0" /**< @internal*/
@@ -91,17 +93,42 @@ enum j21_hdr_pins{
  */
 #define GPIO_GET_CONTROLLER(pin) (pin & 0xF0000000)
 
+/**
+ * @brief Maximum amount of pins in a bulk.
+ */
+#define GPIO_BULK_MAX_PINS GPIOD_LINE_BULK_MAX_LINES
+
+/**
+ * @brief Valid GPIO directions
+ */
+typedef enum gpio_direction{
+    GPIO_DIRECTION_OUTPUT, /**< Output */ 
+    GPIO_DIRECTION_INPUT, /**< Input */
+    GPIO_DIRECTION_NONE /**< Used for only getting the line. Direction might be set later.*/
+} gpio_direction_t;
+
+struct gpio_backend;
+
 /**
  * @brief Pin type.
- * @details Wraps around the gpiod_line struct, from the gpiod lib. 
+ * @details Handle of a pin of the J21 header, driven by the backend selected when it was initialized.
  */
-typedef struct gpiod_line GPIO_Pin;
+typedef struct gpio_pin{
+    const struct gpio_backend* backend; /**< @internal Backend driving the pin */
+    unsigned int pin;                   /**< J21 header pin constant of the pin */
+    struct gpiod_line* line;            /**< @internal Line of the pin, for the libgpiod backend */
+} GPIO_Pin;
 
 /**
  * @brief Pin bulk type.
- * @details Wraps around the gpiod_line_bulk struct, from the gpiod lib. 
+ * @details Pins controlled together. Its pins must have been initialized with the same backend.
  */
-typedef struct gpiod_line_bulk GPIO_Bulk;
+typedef struct gpio_bulk{
+    const struct gpio_backend* backend; /**< @internal Backend driving the pins */
+    GPIO_Pin* pins[GPIO_BULK_MAX_PINS]; /**< Pins of the bulk */
+    unsigned int count;                 /**< Amount of pins in the bulk */
+    struct gpiod_line_bulk lines;       /**< @internal Lines of the pins, for the libgpiod backend */
+} GPIO_Bulk;
 
 /**
  * @brief GPIO controller chip type.
@@ -110,38 +137,88 @@ typedef struct gpiod_line_bulk GPIO_Bulk;
 typedef struct gpiod_chip GPIO_Controller;
 
 /**
- * @brief Valid GPIO directions
+ * @brief GPIO backend.
+ * @details Table of the operations on the lines of a GPIO driver. Pins are bound to the backend selected
+ *          when they are initialized (see GPIO_set_backend()).
  */
-typedef enum gpio_direction{
-    GPIO_DIRECTION_OUTPUT, /**< Output */ 
-    GPIO_DIRECTION_INPUT, /**< Input */
-    GPIO_DIRECTION_NONE /**< Used for only getting the line. Direction might be set later.*/
-} gpio_direction_t;
+typedef struct gpio_backend{
+    const char* name;                                           /**< Name of the backend */
+    int (*open_pin)(GPIO_Pin* pin);                             /**< Get the line of a pin, without requesting it */
+    int (*request_pin)(GPIO_Pin* pin, gpio_direction_t direction, int init_val); /**< Request a line */
+    int (*request_bulk)(GPIO_Bulk* bulk, gpio_direction_t direction, const int init_vals[]); /**< Request the lines of a bulk together */
+    int (*request_events)(GPIO_Pin* pin);                       /**< Request a line as an input reporting rising edges */
+    void (*release_pin)(GPIO_Pin* pin);                         /**< Release a line */
+    void (*release_bulk)(GPIO_Bulk* bulk);                      /**< Release the lines of a bulk */
+    int (*write)(GPIO_Pin* pin, int value);                     /**< Set the value of an output line */
+    int (*write_bulk)(GPIO_Bulk* bulk, const int values[]);     /**< Set the values of the lines of a bulk at once */
+    int (*read)(GPIO_Pin* pin);                                 /**< Get the value of a line */
+    int (*read_bulk)(GPIO_Bulk* bulk, int values[]);            /**< Get the values of the lines of a bulk */
+    int (*event_fd)(GPIO_Pin* pin);                             /**< File descriptor readable on the edges of a line */
+} GPIO_Backend;
+
+/**
+ * @brief Backend for the GPIO character devices, through libgpiod. Used by default.
+ */
+extern const GPIO_Backend GPIO_backend_gpiod;
+
+/**
+ * @brief In-process simulated GPIO chip, which records the edges of its lines (see GPIO_sim.h).
+ */
+extern const GPIO_Backend GPIO_backend_sim;
 
 /**
- * @brief Wrapper around gpiod_line_release.
+ * @brief Release a pin, and free its handle.
  */
-#define GPIO_release_pin gpiod_line_release
+static inline void GPIO_release_pin(GPIO_Pin* pin)
+{
+    pin->backend->release_pin(pin);
+    free(pin);
+}
 
 /**
- * @brief Wrapper around gpiod_line_set_value.
+ * @brief Set the value of an output pin.
+ * @return (int) On success, 0. Otherwise, -1.
  */
-#define GPIO_write gpiod_line_set_value
+static inline int GPIO_write(GPIO_Pin* pin, int value)
+{
+    return pin->backend->write(pin, value);
+}
 
 /**
- * @brief Wrapper around gpiod_line_set_value_bulk.
+ * @brief Set the values of the pins of a bulk, at once.
+ * @return (int) On success, 0. Otherwise, -1.
  */
-#define GPIO_write_bulk gpiod_line_set_value_bulk
+static inline int GPIO_write_bulk(GPIO_Bulk* bulk, const int values[])
+{
+    return bulk->backend->write_bulk(bulk, values);
+}
 
 /**
- * @brief Wrapper around gpiod_line_get_value.
+ * @brief Get the value of a pin.
+ * @return (int) Value of the pin on success. Otherwise, -1.
  */
-#define GPIO_read gpiod_line_get_value
+static inline int GPIO_read(GPIO_Pin* pin)
+{
+    return pin->backend->read(pin);
+}
 
 /**
- * @brief Wrapper around gpiod_line_get_value_bulk.
+ * @brief Get the values of the pins of a bulk.
+ * @return (int) On success, 0. Otherwise, -1.
  */
-#define GPIO_read_bulk gpiod_line_get_value_bulk
+static inline int GPIO_read_bulk(GPIO_Bulk* bulk, int values[])
+{
+    return bulk->backend->read_bulk(bulk, values);
+}
+
+/**
+ * @brief Select the backend of the pins initialized from now on.
+ * If no backend is selected, the one named by the PEF_GPIO_BACKEND environment variable ("gpiod" or "sim")
+ * is used, or the libgpiod one if the variable is not set.
+ * @param[in] backend Backend to use (eg. &GPIO_backend_sim).
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_set_backend(const GPIO_Backend* backend);
 
 /**
  * @brief Initialize a pin on the J21 GPIO header.
@@ -158,6 +235,7 @@ GPIO_Pin* GPIO_init_pin(unsigned int pin, gpio_direction_t direction, int init_v
  * 
  * Pins initialized this way can only be controlled groupally.
  * For controlling pins individually, initialize them with GPIO_init_pin.
+ * The bulk must be freed with GPIO_destroy_bulk.
  * 
  * @param[in] pins Array of symbols pertaining to the pin to initialize (eg. J21_HEADER_PIN_7).
  * @param[in] direction GPIO direction (GPIO_DIRECTION_OUTPUT, GPIO_DIRECTION_INPUT, or GPIO_DIRECTION_NONE).
@@ -168,6 +246,48 @@ GPIO_Pin* GPIO_init_pin(unsigned int pin, gpio_direction_t direction, int init_v
  */
 GPIO_Bulk* GPIO_init_bulk(unsigned int pins[], gpio_direction_t direction, int init_vals[], unsigned int count);
 
+/**
+ * @brief Request pins already initialized as a bulk.
+ * Pins must have been initialized with GPIO_DIRECTION_NONE, and can't be part of another requested bulk.
+ * All pins must be on the same GPIO controller (main or AON).
+ * @param[out] bulk Bulk to fill. Owned by the caller.
+ * @param[in] pins Array of pins to add to the bulk.
+ * @param[in] count Amount of pins in the array.
+ * @param[in] direction GPIO direction (GPIO_DIRECTION_OUTPUT or GPIO_DIRECTION_INPUT). Applied to all pins in the bulk.
+ * @param[in] init_vals Only relevant if direction=GPIO_DIRECTION_OUTPUT. Array of initial values to write to the respective pins.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_request_bulk(GPIO_Bulk* bulk, GPIO_Pin* pins[], unsigned int count, gpio_direction_t direction, const int init_vals[]);
+
+/**
+ * @brief Release the pins of a bulk requested with GPIO_request_bulk.
+ * The pins stay initialized, and can be requested again.
+ * @param[in] bulk Bulk to release.
+ */
+void GPIO_release_bulk(GPIO_Bulk* bulk);
+
+/**
+ * @brief Release a bulk initialized with GPIO_init_bulk, and free it along with the handles of its pins.
+ * Must not be used on a bulk filled with GPIO_request_bulk, whose pins and storage belong to the caller.
+ * @param[in] bulk Bulk to destroy.
+ */
+void GPIO_destroy_bulk(GPIO_Bulk* bulk);
+
+/**
+ * @brief Request a pin as an input reporting its rising edges.
+ * Pin must have been initialized with GPIO_DIRECTION_NONE.
+ * @param[in] pin Pin to request.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_request_events(GPIO_Pin* pin);
+
+/**
+ * @brief Get a file descriptor that becomes readable on the rising edges of a pin.
+ * @param[in] pin Pin requested with GPIO_request_events.
+ * @return (int) File descriptor on success. Otherwise, -1.
+ */
+int GPIO_get_event_fd(GPIO_Pin* pin);
+
 /**
  * @brief Get the J21 header pin constant corresponding to a pin number.
  * 
@@ -176,4 +296,12 @@ GPIO_Bulk* GPIO_init_bulk(unsigned int pins[], gpio_direction_t direction, int i
  */
 int int_to_gpio_pin(int p);
 
+/**
+ * @brief Get the pin number corresponding to a J21 header pin constant.
+ * 
+ * @param[in] pin J21 header pin constant.
+ * @return (int) If pin is valid, corresponding pin number (eg. J21_HEADER_PIN_7 --> 7). Otherwise, 0.
+ */
+int gpio_pin_to_int(unsigned int pin);
+
 #endif
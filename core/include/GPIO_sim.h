@@ -0,0 +1,71 @@
+/**
+ * @file GPIO_sim.h
+ * @author Rafael Martinez (rafael.martinez@udem.edu)
+ * @brief Simulated GPIO chip public interface.
+ * @details In-process GPIO backend, for running the motion stack without the GPIO hardware. Lines keep their
+ *          values in memory, and every edge written to them can be recorded with a CLOCK_MONOTONIC timestamp,
+ *          so the timing of the pulses (period, jitter, throughput) can be measured on any Linux machine.
+ *          Requests are checked like the driver does: a line can't be requested twice. Select the backend
+ *          with GPIO_set_backend(&GPIO_backend_sim) before initializing the pins, or by setting the
+ *          PEF_GPIO_BACKEND environment variable to "sim".
+ * @see GPIO.h
+ * @version 1.0
+ * @date 16.10.2026
+ *
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef GPIO_SIM_H
+#define GPIO_SIM_H
+
+#include "GPIO.h"
+#include <stddef.h>
+
+/**
+ * @brief Edge of a simulated line.
+ */
+typedef struct gpio_edge{
+    unsigned long long t_ns; /**< CLOCK_MONOTONIC time of the edge, in ns. Virtual time if the virtual clock runs (see Time.h) */
+    unsigned int pin;        /**< J21 header pin constant of the line */
+    int value;               /**< New value of the line: 1 for a rising edge, 0 for a falling one */
+} GPIO_Edge;
+
+/**
+ * @brief Start recording the edges of the simulated lines.
+ * Previous records are discarded. Edges past the capacity are counted, but not recorded.
+ * Must not be called while the lines are being written.
+ * @param[in] capacity Maximum amount of edges to record. 0 stops recording.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_sim_record(size_t capacity);
+
+/**
+ * @brief Get the edges recorded so far.
+ * Edges written by a single thread are in time order. Read them once the lines are not written anymore.
+ * @param[out] edges Set to the array of recorded edges.
+ * @return (size_t) Amount of edges in the array.
+ */
+size_t GPIO_sim_get_edges(const GPIO_Edge** edges);
+
+/**
+ * @brief Get the amount of edges that didn't fit in the record.
+ * @return (unsigned long) Amount of edges dropped.
+ */
+unsigned long GPIO_sim_get_dropped(void);
+
+/**
+ * @brief Get the current value of a simulated line.
+ * @param[in] pin J21 header pin constant of the line.
+ * @return (int) Value of the line, or -1 if the pin is invalid.
+ */
+int GPIO_sim_get_value(unsigned int pin);
+
+/**
+ * @brief Pulse a simulated input line, as an external signal would.
+ * The rising edge is signaled on the event file descriptor of the line, if it was requested with GPIO_request_events.
+ * @param[in] pin J21 header pin constant of the line.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_sim_trigger(unsigned int pin);
+
+#endif
@@ -0,0 +1,83 @@
+/**
+ * @file Planner.h
+ * @author Rafael Martinez (rafael.martinez@udem.edu)
+ * @brief Motion planner library public interface.
+ * @details Library for blending consecutive moves of a group of motors. Each move is described by a block,
+ *          holding its direction and length in step space (one dimension per motor), its cruising speed and its
+ *          maximum acceleration. The speed at which two moves may be joined without stopping is limited with the
+ *          junction deviation method: the motors may take the corner as if it was an arc deviating at most a set
+ *          amount of steps from it. Moves in the same direction are joined at the speed of the slowest one, while
+ *          reversals must stop. Given the queue of moves, a backward and a forward pass find the highest entry and
+ *          exit speeds of each move that can still be reached or shed with the available acceleration, ending the
+ *          last move at standstill.
+ * @see Stepper.h Profile.h
+ * @version 1.0
+ * @date 16.10.2026
+ *
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include <math.h>
+#include <string.h>
+
+/**
+ * @brief Maximum amount of dimensions (motors) of a move.
+ */
+#define PLANNER_DIMENSIONS_MAX 8
+
+/**
+ * @brief Planner block object.
+ * @details Initialized by planner_block_init(). Speeds and accelerations are measured along the path of the move,
+ *          in steps of the step space. They are converted to the ticks of the move (steps of the motor with the
+ *          most steps) with the ratio member.
+ */
+typedef struct planner_block{
+    double unit[PLANNER_DIMENSIONS_MAX]; /**< Direction of the move, as a unit vector */
+    unsigned int dimensions; /**< Amount of dimensions of the move */
+    double length;           /**< Length of the move, in steps */
+    double ratio;            /**< Ticks per step along the path */
+    double v_max;            /**< Cruising speed, in steps/s */
+    double accel;            /**< Maximum acceleration, in steps/s² */
+    double v_junction;       /**< Maximum speed at the junction with the previous move, in steps/s */
+    double v_entry;          /**< Planned speed at the start of the move, in steps/s */
+    double v_exit;           /**< Planned speed at the end of the move, in steps/s */
+} Planner_block;
+
+/**
+ * @brief Initialize a planner block.
+ *
+ * The junction speed is set to 0 (the move starts from standstill) until planner_junction() is called.
+ *
+ * @param[out] block Block to initialize.
+ * @param[in] steps Array with the signed amount of steps of the move in each dimension. At least one must be non-zero.
+ * @param[in] dimensions Amount of dimensions in the steps array.
+ * @param[in] tick_rate Cruising speed of the move, in ticks/s.
+ * @param[in] tick_accel Maximum acceleration of the move, in ticks/s².
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int planner_block_init(Planner_block* block, const int steps[], unsigned int dimensions, double tick_rate, double tick_accel);
+
+/**
+ * @brief Compute the maximum speed at the junction between two moves.
+ *
+ * @param[in] prev Block of the previous move. If NULL, the move starts from standstill.
+ * @param[in,out] block Block of the move whose junction speed is set.
+ * @param[in] deviation Junction deviation, in steps.
+ */
+void planner_junction(const Planner_block* prev, Planner_block* block, double deviation);
+
+/**
+ * @brief Plan the entry and exit speeds of a sequence of moves.
+ *
+ * The last move of the sequence ends at standstill.
+ *
+ * @param[in,out] blocks Array of pointers to the blocks of the moves, in the order they are run.
+ * @param[in] count Amount of blocks in the array.
+ * @param[in] v_start Speed at which the first move starts, in steps/s along its path.
+ */
+void planner_recalculate(Planner_block* blocks[], unsigned int count, double v_start);
+
+#endif
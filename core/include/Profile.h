@@ -0,0 +1,220 @@
+/**
+ * @file Profile.h
+ * @author Rafael Martinez (rafael.martinez@udem.edu)
+ * @brief Motion profile library public interface.
+ * @details Library for generating the timing of the steps of a move. A profile is initialized with the amount
+ *          of steps of the move, the cruising speed and the maximum acceleration of the motors, and then yields
+ *          the period of each step, one at a time. Trapezoidal profiles accelerate and decelerate at a constant
+ *          rate, so motors can be started and stopped at speeds they couldn't reach from standstill. Ramps are
+ *          generated with the approximation described by D. Austin in "Generate stepper-motor speed profiles in
+ *          real time" (2005), which costs a single division per step. S-curve profiles also limit the jerk, so
+ *          acceleration builds up and fades out gradually, reducing the vibrations at the start and end of a move.
+ *          Their phase boundaries are computed when the profile is initialized, and the motion is integrated one step
+ *          at a time, so the cost per step is also constant. To keep floating point math out of the pulser, a profile
+ *          is compiled into a table of run-length segments (period of the first step, amount of steps, and change of
+ *          the period between steps) when a move is requested. Reading the next period from a table only takes an
+ *          integer addition.
+ * @see Stepper.h
+ * @version 1.0
+ * @date 16.10.2026
+ *
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "Time.h"
+#include <math.h>
+#include <string.h>
+
+/**
+ * @internal
+ * @brief Amount of phases of an S-curve profile.
+ */
+#define PROFILE_SCURVE_PHASES 7
+
+/**
+ * @brief Maximum amount of segments in a profile table.
+ */
+#define PROFILE_SEGMENTS_MAX 256
+
+/**
+ * @brief Fractional bits of the fixed-point periods stored in a profile table.
+ */
+#define PROFILE_FRAC_BITS 16
+
+/**
+ * @brief Maximum error allowed between a compiled period and the generated one, in ns.
+ * @details Doubled as needed if the profile doesn't fit in PROFILE_SEGMENTS_MAX segments.
+ */
+#define PROFILE_TOLERANCE_NS 50.0
+
+/**
+ * @brief Types of motion profiles.
+ */
+typedef enum profile_type{
+    PROFILE_CONSTANT,    /**< Constant speed from the first to the last step */
+    PROFILE_TRAPEZOIDAL, /**< Constant acceleration up to the cruising speed, constant deceleration down to standstill */
+    PROFILE_SCURVE       /**< Jerk-limited (7 phase) acceleration and deceleration */
+} profile_type_t;
+
+/**
+ * @brief Motion profile object.
+ * @details Initialized by profile_init(), and advanced one step at a time by profile_next_period().
+ */
+typedef struct profile{
+    profile_type_t type;     /**< Type of the profile */
+    unsigned int steps;      /**< Total amount of steps of the move */
+    unsigned int step;       /**< Index of the next step */
+    unsigned int ramp_steps; /**< Amount of steps of the acceleration ramp */
+    unsigned int decel_steps; /**< Amount of steps of the deceleration ramp */
+    unsigned int fixed_steps; /**< Leading steps whose timing doesn't depend on the exit speed */
+    unsigned int n;          /**< @internal Position along the ramp (trapezoidal), or current phase (S-curve) */
+    double c;                /**< @internal Period of the step at position n of the ramp, in ns */
+    double c_min;            /**< Period at cruising speed, in ns */
+    double v;                /**< @internal S-curve: current speed, in steps/s */
+    double a;                /**< @internal S-curve: current acceleration, in steps/s² */
+    double v_min;            /**< @internal S-curve: lowest speed, in steps/s */
+    double v_cruise;         /**< @internal S-curve: cruising speed, in steps/s */
+    unsigned int bounds[PROFILE_SCURVE_PHASES]; /**< @internal S-curve: step at which each phase ends */
+    double a_start[PROFILE_SCURVE_PHASES];      /**< @internal S-curve: acceleration at the start of each phase */
+    double j_phase[PROFILE_SCURVE_PHASES];      /**< @internal S-curve: jerk during each phase */
+} Profile;
+
+/**
+ * @brief Run of steps whose period changes linearly.
+ */
+typedef struct profile_segment{
+    unsigned int count; /**< Amount of steps in the segment */
+    long long period;   /**< Period of the first step, in 2^-PROFILE_FRAC_BITS ns */
+    long long delta;    /**< Change of the period from one step to the next, in 2^-PROFILE_FRAC_BITS ns */
+} Profile_segment;
+
+/**
+ * @brief Compiled motion profile.
+ * @details Filled by profile_compile(), and read one step at a time by profile_table_next().
+ */
+typedef struct profile_table{
+    Profile_segment segments[PROFILE_SEGMENTS_MAX]; /**< Segments of the profile */
+    unsigned int count;  /**< Amount of segments used */
+    unsigned int steps;  /**< Total amount of steps of the move */
+    unsigned int fixed_steps; /**< Leading steps whose timing doesn't depend on the exit speed */
+    unsigned int index;  /**< @internal Segment of the next step */
+    unsigned int left;   /**< @internal Steps left in the current segment */
+    long long period;    /**< @internal Period of the next step, in 2^-PROFILE_FRAC_BITS ns */
+    long long residue;   /**< @internal Fraction of ns truncated from the previous steps, in 2^-PROFILE_FRAC_BITS ns */
+} Profile_table;
+
+/**
+ * @brief Initialize a motion profile.
+ *
+ * If accel is 0, the profile degenerates to PROFILE_CONSTANT.
+ * If jerk is 0, PROFILE_SCURVE degenerates to PROFILE_TRAPEZOIDAL.
+ *
+ * @param[out] profile Profile to initialize.
+ * @param[in] type Type of the profile.
+ * @param[in] steps Amount of steps of the move.
+ * @param[in] period_ns Period at cruising speed, in nanoseconds. May be fractional.
+ * @param[in] accel Maximum acceleration, in steps/s².
+ * @param[in] jerk Maximum jerk, in steps/s³. Only used by PROFILE_SCURVE.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_init(Profile* profile, profile_type_t type, unsigned int steps, double period_ns, unsigned int accel, unsigned int jerk);
+
+/**
+ * @brief Initialize a motion profile that starts and ends at given speeds.
+ *
+ * Used to join consecutive moves without stopping. Ramps start at the entry speed and end at the exit speed,
+ * which must be reachable from each other within the move. If any of them is not 0, PROFILE_SCURVE degenerates
+ * to PROFILE_TRAPEZOIDAL.
+ *
+ * @param[out] profile Profile to initialize.
+ * @param[in] type Type of the profile.
+ * @param[in] steps Amount of steps of the move.
+ * @param[in] period_ns Period at cruising speed, in nanoseconds. May be fractional.
+ * @param[in] accel Maximum acceleration, in steps/s².
+ * @param[in] jerk Maximum jerk, in steps/s³. Only used by PROFILE_SCURVE.
+ * @param[in] v_entry Speed at the start of the move, in steps/s.
+ * @param[in] v_exit Speed at the end of the move, in steps/s.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_init_blended(Profile* profile, profile_type_t type, unsigned int steps, double period_ns, unsigned int accel, unsigned int jerk, double v_entry, double v_exit);
+
+/**
+ * @brief Get the period of the next step of the profile.
+ *
+ * Must not be called more times than the amount of steps the profile was initialized with.
+ *
+ * @param[in,out] profile Profile to advance.
+ * @return (unsigned long long) Period of the step, in nanoseconds.
+ */
+unsigned long long profile_next_period(Profile* profile);
+
+/**
+ * @brief Compile a motion profile into a table of segments.
+ *
+ * The profile is read from its current state, and is not modified.
+ *
+ * @param[in] profile Initialized profile.
+ * @param[out] table Table to fill. Its read position is set to the first step.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_compile(const Profile* profile, Profile_table* table);
+
+/**
+ * @brief Set the read position of a profile table to its first step.
+ *
+ * @param[in,out] table Table to rewind.
+ */
+void profile_table_rewind(Profile_table* table);
+
+/**
+ * @brief Set the read position of a profile table to a given step.
+ *
+ * Allows switching to the table of the same move compiled with a higher exit speed, as long as
+ * the step is not past the fixed steps of the table in use.
+ *
+ * @param[in,out] table Table to update.
+ * @param[in] step Index of the next step to read.
+ */
+void profile_table_seek(Profile_table* table, unsigned int step);
+
+/**
+ * @brief Find the first step of a profile table that is not faster than a given period.
+ *
+ * Meant for tables whose periods never decrease, like a deceleration ramp, so a move can continue
+ * on the table from its current speed.
+ *
+ * @param[in] table Table to search.
+ * @param[in] period_ns Period of reference, in nanoseconds.
+ * @return (unsigned int) Index of the step, or the amount of steps of the table if all of them are faster.
+ */
+unsigned int profile_table_find(const Profile_table* table, unsigned long long period_ns);
+
+/**
+ * @brief Get the period of the next step of a profile table.
+ *
+ * Must not be called more times than the amount of steps in the table.
+ *
+ * @param[in,out] table Table to advance.
+ * @return (unsigned long long) Period of the step, in nanoseconds. The fraction of ns left out is added to the next step.
+ */
+static inline unsigned long long profile_table_next(Profile_table* table)
+{
+    // Fraction truncated from a period is carried to the next one, so the steps keep the exact average rate
+    long long exact = table->period + table->residue;
+    unsigned long long period = (unsigned long long)(exact >> PROFILE_FRAC_BITS);
+    table->residue = exact & ((1LL << PROFILE_FRAC_BITS) - 1);
+
+    table->period += table->segments[table->index].delta;
+    if(--table->left == 0 && table->index + 1 < table->count){
+        table->index++;
+        table->left = table->segments[table->index].count;
+        table->period = table->segments[table->index].period;
+    }
+
+    return period;
+}
+
+#endif
@@ -0,0 +1,106 @@
+/**
+ * @file Ring.h
+ * @author Rafael Martinez (rafael.martinez@udem.edu)
+ * @brief Lock-free ring library public interface.
+ * @details Bounded single-producer/single-consumer queue of pointers. Only one thread may push, and only
+ *          one thread may pop, but both can do it at the same time without locking. The read and write
+ *          indices are C11 atomics, each on its own cache line, so the producer and the consumer don't
+ *          invalidate each other's line on every access. The indices run freely and are wrapped with a
+ *          mask, so the capacity must be a power of two.
+ * @see Stepper.h
+ * @version 1.0
+ * @date 16.10.2026
+ *
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+/**
+ * @brief Maximum amount of pointers in a ring. Must be a power of two.
+ */
+#define RING_CAPACITY 16
+
+/**
+ * @brief Size of a cache line, in bytes.
+ */
+#define RING_CACHE_LINE 64
+
+/**
+ * @brief Lock-free ring object.
+ * @details Initialized by ring_init().
+ */
+typedef struct ring{
+    _Alignas(RING_CACHE_LINE) atomic_uint head; /**< Index of the next pointer to pop. Written by the consumer */
+    _Alignas(RING_CACHE_LINE) atomic_uint tail; /**< Index of the next pointer to push. Written by the producer */
+    _Alignas(RING_CACHE_LINE) void* slots[RING_CAPACITY]; /**< Pointers in the ring */
+} Ring;
+
+/**
+ * @brief Initialize an empty ring.
+ *
+ * @param[out] ring Ring to initialize.
+ */
+void ring_init(Ring* ring);
+
+/**
+ * @brief Add a pointer at the end of a ring. Must only be called by the producer.
+ *
+ * @param[in,out] ring Ring to update.
+ * @param[in] item Pointer to add.
+ * @return (int) 0 on success, -1 if the ring is full.
+ */
+static inline int ring_push(Ring* ring, void* item)
+{
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if(tail - head == RING_CAPACITY)
+        return -1;
+
+    ring->slots[tail & (RING_CAPACITY - 1)] = item;
+
+    // Publishes the slot to the consumer
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return 0;
+}
+
+/**
+ * @brief Remove the pointer at the start of a ring. Must only be called by the consumer.
+ *
+ * @param[in,out] ring Ring to update.
+ * @return (void*) Pointer removed, or NULL if the ring is empty.
+ */
+static inline void* ring_pop(Ring* ring)
+{
+    unsigned int head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    unsigned int tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+    if(head == tail)
+        return NULL;
+
+    void* item = ring->slots[head & (RING_CAPACITY - 1)];
+
+    // Hands the slot back to the producer
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return item;
+}
+
+/**
+ * @brief Check if a ring is empty.
+ *
+ * @param[in] ring Ring to check.
+ * @return (int) 1 if empty, 0 otherwise.
+ */
+static inline int ring_empty(Ring* ring)
+{
+    return atomic_load_explicit(&ring->head, memory_order_acquire) == atomic_load_explicit(&ring->tail, memory_order_acquire);
+}
+
+#endif
@@ -9,7 +9,15 @@
  *          bulk, only the thread of one the motors in the bulk is used, ensuring optimal use of CPU time and true 
  *          parallel control. For further details, refer to the documentation of the available functions. Here, motor 
  *          movement is measured in microsteps. For measuring movement in along dimension in millimeters, see Axis.h.
- * @see Axis.h 
+ *          Moves might also be queued on a group of motors with stepper_queue_move(). Queued moves are run back to
+ *          back by the same thread, and joined without stopping when their directions allow it (see Planner.h).
+ *          Alternatively, a set of motors can be run by a single pulse engine thread instead of their own ones
+ *          (see stepper_engine_init()), which fires the edges of all of them that fall close together at once.
+ *          The edges driven by the pulsers can be recorded in a trace, to diagnose their timing (see stepper_set_trace()).
+ *          Pulsers run on the virtual clock of Time.h once it is started, so moves are simulated as fast as they
+ *          are computed. Motors must then be commanded from the thread that started it, which may only block
+ *          in stepper_wait() (or the functions built on it) and in the delays of Time.h.
+ * @see Axis.h Planner.h 
  * @version 1.0
  * @date 03.07.2021
  * 
@@ -22,8 +30,13 @@
 #include "GPIO.h"
 #include "Tasks.h"
 #include "Time.h"
+#include "Profile.h"
+#include "Planner.h"
+#include "Ring.h"
+#include "Trace.h"
 #include <string.h>
 #include <limits.h>
+#include <stdatomic.h>
 
 /**
  * @brief Maximum amount of motors that might be controlled simultaneously.
@@ -33,6 +46,55 @@
  * @brief Maximum length for the name of a motor. 
  */
 #define MOTOR_NAME_LEN 32
+/**
+ * @brief Maximum amount of moves queued on a group of motors, including the one in progress.
+ */
+#define STEPPER_QUEUE_SIZE 8
+/**
+ * @brief Junction deviation of queued moves, in microsteps.
+ * @details Maximum distance the path may deviate from the corner between two moves when it is taken
+ *          without stopping. Larger values allow faster corners. See Planner.h.
+ */
+#define STEPPER_JUNCTION_DEVIATION 10.0
+/**
+ * @brief Maximum speed of motors with TIMING_SLEEP timing, in microsteps per second.
+ * @details Above it, the wakeup latency of the sleeps is a large part of the half period.
+ */
+#define STEPPER_MAX_PPS_SLEEP 4160
+/**
+ * @brief Maximum speed of motors with TIMING_HYBRID timing, in microsteps per second.
+ */
+#define STEPPER_MAX_PPS 40000
+/**
+ * @brief Time a DIR line is held before the first step after a direction change, in nanoseconds.
+ * @details Setup time of the DIR input of the A4988 driver.
+ */
+#define STEPPER_DIR_SETUP_NS 200
+/**
+ * @brief Scheduling policy of the pulser threads.
+ * @details Processes without the privileges to use it fall back to the default policy (see Tasks.h).
+ */
+#define STEPPER_TASK_POLICY SCHED_FIFO
+/**
+ * @brief Priority of the pulser threads.
+ */
+#define STEPPER_TASK_PRIORITY 80
+/**
+ * @brief Stack size of the pulser threads, in bytes. The stack is locked in RAM.
+ */
+#define STEPPER_TASK_STACK_SIZE (64*1024)
+/**
+ * @brief Minimum feed rate override, in percent of the programmed speed.
+ */
+#define STEPPER_FEED_MIN 1.0
+/**
+ * @brief Alignment of the blocks of the Stepper object written by different threads, in bytes.
+ */
+#define STEPPER_CACHE_LINE RING_CACHE_LINE
+/**
+ * @brief Name of the thread of the pulse engine.
+ */
+#define STEPPER_ENGINE_NAME "stepper-engine"
 
 /**
  * @brief Invalid direction constant. 
@@ -67,35 +129,73 @@ enum microstep_config{
     SIXTEENTH = 16
 };
 
+/**
+ * @brief Timing of the pulses of the moves led by a motor.
+ */
+typedef enum stepper_timing{
+    TIMING_SLEEP,   /**< The pulser sleeps until every edge. Speeds up to STEPPER_MAX_PPS_SLEEP */
+    TIMING_HYBRID   /**< The pulser sleeps until shortly before every edge, and spins for the rest.
+                         Speeds up to STEPPER_MAX_PPS. Meant for pulsers running on an isolated core */
+} stepper_timing_t;
+
 /**
  * @internal
  * @brief Move request object.
  */
 typedef struct stepper_req Stepper_req;
 
+/**
+ * @brief Position of a motor, as published by its pulser.
+ * @details Filled by stepper_get_position(). Both fields belong to the same step.
+ */
+typedef struct stepper_position{
+    long long steps;        /**< Steps taken in the positive direction, minus steps taken in the opposite direction */
+    struct timespec t_step; /**< CLOCK_MONOTONIC time of the last step. Zero if the motor hasn't stepped */
+} Stepper_position;
+
 /**
  * @brief Stepper motor object.
  * @details Constructed by stepper_init(). Motors are assigned a starting direction
  * at initialization. This direction is then considered "positive". Steps taken in
  * this direction are added to the position accumulator, while steps taken in the
  * opposite direction are substracted from the accumulator.
+ * The state written by the pulser on every step is kept on its own cache line, apart from
+ * the state written by the threads commanding the motor, so they don't invalidate each other's lines.
  */
 typedef struct stepper{
+    /* Control block: written by the threads commanding the motor */
     GPIO_Pin* dir_pin;              /**< Pin handle setting the direction */
     GPIO_Pin* step_pin;             /**< Pin handle for stepping the motor */
     Stepper_req* current_req;       /**< @internal Handle to the current move request */
+    Stepper_req* own_req;           /**< @internal Request used when the motor is the first of a group */
+    Stepper_req* group_req;         /**< @internal Request holding the STEP and DIR lines of the motor requested */
     pthread_mutex_t* shared_mutex;  /**< @internal Protects access to shared_mutex (pointer and contents) */ 
     pthread_mutex_t struct_mutex;   /**< @internal Protects conditional variables */
     pthread_cond_t req_cv;          /**< @internal Cond. var. for signaling that a request is ready */
     pthread_cond_t wait_cv;         /**< @internal Cond. var. for waiting on a reques to finish */
     char name[MOTOR_NAME_LEN];      /**< Name of the stepper motor */
     direction_abs_t pos_direction;  /**< Positive direction of the motor */
-    direction_abs_t curr_direction; /**< Current direction of the motor */
-    unsigned int half_period;       /**< Pulse width for the pulse train driving the stepper */
+    double period_ns;               /**< Period of the pulse train driving the stepper, in nanoseconds. May be fractional */
     unsigned int microsteps_per_rotation; /**< Microstep configuration of the driver */
-    volatile int steps;             /**< Steps accumulator */
-    volatile unsigned int stop;     /**< @internal Flag for stopping the stepper */
+    unsigned int max_accel;         /**< Maximum acceleration, in microsteps/s². 0 if moves are not ramped */
+    unsigned int max_jerk;          /**< Maximum jerk, in microsteps/s³. Only used by S-curve moves */
+    profile_type_t profile;         /**< Motion profile of the next moves */
+    stepper_timing_t timing;        /**< Timing of the pulses of the moves the motor leads */
+    int engine_line;                /**< @internal Index of the STEP line in the bulk of the pulse engine, whose DIR lines follow the STEP ones. -1 if not in the engine */
+    unsigned int req_bit;           /**< @internal Bit of the motor in the stop mask of its current request */
+    int event_fd;                   /**< @internal eventfd signaled when a request of the motor finishes */
+    atomic_uint feed;               /**< @internal Feed rate override of the moves the motor leads, in 2^-16 of the programmed speed */
+    Trace* trace;                   /**< Trace recording the edges of the requests the motor leads. NULL if not traced */
     volatile unsigned int req_available;  /**< @internal Flag indicating that a move request is available */
+
+    /* Pulser block: written by the thread running the request of the motor */
+    _Alignas(STEPPER_CACHE_LINE) atomic_uint position_seq; /**< @internal Seqlock of steps and step_ns. Odd while they are written */
+    atomic_llong steps;             /**< @internal Steps accumulator. Read with stepper_get_position() */
+    atomic_ullong step_ns;          /**< @internal CLOCK_MONOTONIC time of the last step, in nanoseconds */
+    direction_abs_t curr_direction; /**< Current direction of the motor */
+    direction_abs_t dir_level;      /**< @internal Level last driven on the DIR line. Changed when a move starts */
+    long long spin_ns;              /**< @internal Time spun before every edge with TIMING_HYBRID. Calibrated by the pulser, negative until then */
+    unsigned int overruns;          /**< Times the pulser fell too far behind its schedule and restarted it */
 } Stepper;
 
 /**
@@ -106,6 +206,8 @@ typedef struct stepper{
  *                      Value must be from the defined symbols in GPIO.h.
  * @param[in] dir_pin   Pin controlling the DIR input of the stepper driver.
  *                      Value must be from the defined symbols in GPIO.h 
+ *                      Must be on the same GPIO controller (main or AON) as step_pin, and as the
+ *                      lines of the motors moved along with this one.
  * @param[in] microstep Microstep configuration of the stepper driver.
  *                      Valid values are FULL, HALF, QUARTER, EIGHT, and SIXTEENTH.
  * @param[in] steps_per_rotation Amount of full steps in a single rotation of the stepper motor.
@@ -128,6 +230,9 @@ void stepper_destroy(Stepper* motor);
 /**
  * @brief Set the absolute turning direction of the motor.
  * 
+ * No line is written: the DIR line of the motor is changed by the pulser at the start of the next move,
+ * in the same bulk write as the DIR lines of the rest of its group, and before its first step.
+ * 
  * @param[in] motor Pointer to the motor to update.
  * @param[in] direction New direction (DIRECTION_CLOCKWISE, DIRECTION_COUNTERCLOCKWISE).
  * @return (int) 0 on success, negative value otherwise.
@@ -166,10 +271,10 @@ direction_rel_t stepper_get_direction_rel(Stepper* motor);
  * was initialized.
  * 
  * @param[in] motor Pointer to the motor to update.
- * @param[in] pps New speed, in microsteps per second.
+ * @param[in] pps New speed, in microsteps per second. May be fractional.
  * @return (int) 0 on success, negative value otherwise and errno set to specific error value.
  */
-int stepper_set_speed(Stepper* motor, unsigned int pps);
+int stepper_set_speed(Stepper* motor, double pps);
 
 /**
  * @brief Set the speed of multiple motors, in microsteps per second.
@@ -178,11 +283,99 @@ int stepper_set_speed(Stepper* motor, unsigned int pps);
  * was initialized.
  * 
  * @param[in] motors Array of pointers to motors, which are the motors to be updated.
- * @param[in] pps New speed for the motors, in microsteps per second.
+ * @param[in] pps New speed for the motors, in microsteps per second. May be fractional.
  * @param[in] count Amount of motors in the motors array.
  * @return (int) 0 on success, negative value otherwise.
  */
-int stepper_set_speed_multiple(Stepper* motors[], unsigned int pps, unsigned int count);
+int stepper_set_speed_multiple(Stepper* motors[], double pps, unsigned int count);
+
+/**
+ * @brief Override the feed rate of the moves led by a motor.
+ * 
+ * Scales the speed of the moves of the requests the motor leads (it is the first of their group),
+ * including the move in progress, which picks the new rate up at its next step. The speed changes
+ * gradually, at the maximum acceleration of the move. Moves without acceleration limit change at once.
+ * Meant for throttling the motors without stopping them.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] percent Feed rate, in percent of the programmed speed (STEPPER_FEED_MIN to 100).
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_feed(Stepper* motor, double percent);
+
+/**
+ * @brief Set the maximum acceleration of the motor, in microsteps per second squared.
+ * 
+ * Moves of a motor with an acceleration limit follow a trapezoidal profile: the motor ramps
+ * up to the speed set with stepper_set_speed(), and ramps down before the last step.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] accel New maximum acceleration, in microsteps/s². 0 disables the ramps.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_acceleration(Stepper* motor, unsigned int accel);
+
+/**
+ * @brief Set the maximum jerk of the motor, in microsteps per second cubed.
+ * 
+ * Only used by moves with the PROFILE_SCURVE profile.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] jerk New maximum jerk, in microsteps/s³. 0 turns S-curve moves into trapezoidal ones.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_jerk(Stepper* motor, unsigned int jerk);
+
+/**
+ * @brief Set the motion profile used by the next moves of the motor.
+ * 
+ * When stepping multiple motors, the profile of the first motor of the list is used.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] type PROFILE_CONSTANT, PROFILE_TRAPEZOIDAL or PROFILE_SCURVE.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_profile(Stepper* motor, profile_type_t type);
+
+/**
+ * @brief Set the timing of the pulses of the moves led by the motor.
+ * 
+ * With TIMING_HYBRID, the time spun before every edge is calibrated by the thread of the motor,
+ * by measuring its wakeup latency before it runs its first move with this timing. It is at most
+ * half the shortest period of the timing. The speed of the motor is limited to the maximum of the new timing.
+ * When stepping multiple motors, the timing of the first motor of the list is used.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] timing TIMING_SLEEP or TIMING_HYBRID.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_timing(Stepper* motor, stepper_timing_t timing);
+
+/**
+ * @brief Restrict the thread of the motor to a single CPU.
+ * 
+ * Moves led by the motor run on that CPU. Best used with a CPU isolated from the scheduler (isolcpus),
+ * and with TIMING_HYBRID. The spin of TIMING_HYBRID is calibrated again on the new CPU, so the motor must be idle.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] cpu Index of the CPU.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_cpu(Stepper* motor, int cpu);
+
+/**
+ * @brief Record the edges of the requests led by the motor in a trace.
+ * 
+ * Every STEP edge and every DIR change made by the pulser is recorded with its time and the id of its request.
+ * Directions set with stepper_set_direction_abs() and stepper_set_direction_rel() are recorded when the next move drives them.
+ * A trace has a single writer, so it may only be shared by motors whose requests run on the same thread,
+ * like the motors of the pulse engine. The motor must be idle.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] trace Trace to record the edges in, or NULL to stop recording them. Not owned by the motor.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_trace(Stepper* motor, Trace* trace);
 
 /**
  * @brief Step a motor. 
@@ -209,23 +402,107 @@ int stepper_step(Stepper* motor, unsigned int steps);
  */
 int stepper_step_multiple(Stepper* motors[], unsigned int steps, int count);
 
+/**
+ * @brief Step multiple motors, each a different amount of steps.
+ * 
+ * Motors start and finish together: the motor with the most steps steps on every tick, and the
+ * steps of the rest are spread evenly along the move. Ticks follow the speed and profile of the
+ * first motor of the list. Motors with 0 steps are held (as busy) but not stepped.
+ * Steps are taken in the direction previously specified in the initialization of each 
+ * Stepper object or by the stepper_set_direction (either absolute or relative) function.
+ * 
+ * @param[in] motors Array of pointers to Stepper objects, which are the motors to be stepped.
+ * @param[in] steps Array with the amount of steps each motor takes. At least one must be non-zero.
+ * @param[in] count Amount of motors in the motors and steps arrays.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_step_coordinated(Stepper* motors[], const unsigned int steps[], int count);
+
+/**
+ * @brief Queue a move on a group of motors.
+ * 
+ * If the group is idle, the move starts right away. If the group is already moving, the move
+ * is run after the ones queued before it, and joined with the previous one without stopping
+ * if their directions allow it (see Planner.h). Reversals and moves of motors without an
+ * acceleration limit are joined at standstill. Moves can only be queued on the same group of
+ * motors, in the same order, as the one that is moving.
+ * Motors are turned in the direction of the sign of their steps, and keep that direction
+ * after the move.
+ * 
+ * @param[in] motors Array of pointers to Stepper objects, which are the motors to be stepped.
+ * @param[in] steps Array with the signed amount of steps each motor takes. Positive steps are
+ *                  taken in the positive direction of the motor. At least one must be non-zero.
+ * @param[in] pps Speed of the motor with the most steps, in microsteps per second. May be fractional.
+ * @param[in] count Amount of motors in the motors and steps arrays.
+ * @return (int) 0 on success, negative value otherwise (e.g. the queue is full).
+ */
+int stepper_queue_move(Stepper* motors[], const int steps[], double pps, int count);
+
 /**
  * @brief Get the absolute amount of steps taken by the motor.
  * 
+ * The count is truncated to an int. See stepper_get_position() for the full count.
+ * 
  * @param[in] motor Pointer to the motor of interest.
  * @return (int) Absolute amount of steps taken; INT_MIN on error.
  */
 int stepper_get_steps(Stepper* motor);
 
 /**
- * @brief Stop a motor.
+ * @brief Get the amount of steps taken by the motor, and the time of the last step.
+ * 
+ * The pulser publishes both through a seqlock, so they are read consistently without locking,
+ * from any thread.
+ * 
+ * @param[in] motor Pointer to the motor of interest.
+ * @param[out] position Steps taken and time of the last one.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_get_position(Stepper* motor, Stepper_position* position);
+
+/**
+ * @brief Stop a motor immediately.
  * 
+ * The motor stops on its next step, without decelerating, so steps may be lost at high speeds.
+ * Meant for emergency stops, see stepper_stop_decel() otherwise.
  * Function blocks until the motor has stopped. 
  * 
  * @param[in] motor Pointer to the motor to be stopped.
  */
 void stepper_stop(Stepper* motor);
 
+/**
+ * @brief Ask a motor to stop, without waiting for it.
+ * 
+ * The event file descriptor of the motor becomes readable once it has stopped (see stepper_get_event_fd()).
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ */
+void stepper_stop_nowait(Stepper* motor);
+
+/**
+ * @brief Ask a motor to decelerate to a stop, without waiting for it.
+ * 
+ * The request of the motor ramps down from its current speed at the maximum acceleration of its
+ * move in progress, so no step is lost and the position stays valid. Queued moves are dropped.
+ * If the move has no acceleration limit, or hasn't started yet, the motor stops immediately.
+ * The event file descriptor of the motor becomes readable once it has stopped (see stepper_get_event_fd()).
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ */
+void stepper_stop_decel_nowait(Stepper* motor);
+
+/**
+ * @brief Decelerate a motor to a stop.
+ * 
+ * Function blocks until the motor has stopped. See stepper_stop_decel_nowait().
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ * @param[out] position Position at which the motor stopped. Can be NULL.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_stop_decel(Stepper* motor, Stepper_position* position);
+
 /**
  * @brief Wait until the motor is finished stepping.
  * 
@@ -241,6 +518,26 @@ void stepper_wait(Stepper* motor);
  */
 int stepper_ready(Stepper* motor);
 
+/**
+ * @brief Get the event file descriptor of a motor.
+ * 
+ * The descriptor (an eventfd) becomes readable when a request of the motor finishes, or is stopped,
+ * so the completion of moves can be waited with select() or poll() together with other descriptors.
+ * It stays readable until cleared with stepper_clear_event(). Clear it before checking stepper_ready(),
+ * so no completion is missed.
+ * 
+ * @param[in] motor Handle to the motor.
+ * @return (int) File descriptor on success, negative value otherwise.
+ */
+int stepper_get_event_fd(Stepper* motor);
+
+/**
+ * @brief Clear the event file descriptor of a motor.
+ * 
+ * @param[in] motor Handle to the motor.
+ */
+void stepper_clear_event(Stepper* motor);
+
 /**
  * @brief Function to assert if microstep parameter has a valid value
  * 
@@ -249,4 +546,36 @@ int stepper_ready(Stepper* motor);
  */
 int is_valid_microstep(int microstep);
 
+/**
+ * @brief Start the pulse engine, which runs the moves of a set of motors from a single thread.
+ * 
+ * The STEP and DIR lines of the motors are requested in a single bulk, owned by the engine. The engine keeps
+ * the deadlines of the next edges of all its requests in a heap, sleeps until the earliest one, and
+ * fires every edge due within window_ns of it with a single bulk write. Independent motors then step
+ * with tight relative timing, and a single thread wakes up instead of one per group.
+ * Motors of the engine can be grouped among themselves in any way, but not with other motors.
+ * All the lines must be on the same GPIO controller (main or AON).
+ * New requests are handed to the engine through a lock-free single-producer ring, so the moves of the
+ * motors of the engine can only be commanded from the thread calling this function; other threads are
+ * refused. Moves on idle motors are started without locking. Moves queued behind a move in progress
+ * take the mutex of the leader of the group, since the planner rewrites the queued moves.
+ * All motors must be idle.
+ * 
+ * @param[in] motors Array of pointers to the motors of the engine.
+ * @param[in] count Amount of motors in the array.
+ * @param[in] window_ns Coalescing window, in nanoseconds. Edges are fired at most this early.
+ * @param[in] timing Timing of the engine. Also set as the timing of the motors, which limits their speed.
+ *                   With TIMING_HYBRID, the engine thread calibrates its spin when it starts.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_engine_init(Stepper* motors[], unsigned int count, unsigned long long window_ns, stepper_timing_t timing);
+
+/**
+ * @brief Stop the pulse engine.
+ * 
+ * The motors of the engine are stopped, its STEP and DIR lines are released, and the motors go back to
+ * being run by their own threads.
+ */
+void stepper_engine_destroy(void);
+
 #endif
@@ -6,7 +6,9 @@
  *          another thread, that execute a given routine. An internal linked list keeps track of the
  *          current tasks of the program. A tasks can be canceled asyncronously, which stops and kills
  *          it, and removes its reference from the linked list. Tasks can also be looked up based on their
- *          assigned named.
+ *          assigned named. Tasks can be created with real-time attributes (scheduling policy, priority, CPU
+ *          affinity, and a stack locked in RAM). Attributes that can't be applied, usually because the process
+ *          lacks the privileges, are skipped and reported, and the task runs with the default ones.
  * @version 1.0
  * @date 07.03.2021
  * 
@@ -24,6 +26,8 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <string.h>
+#include <sched.h>
+#include <limits.h>
 
 /**
  * @brief Maximum stack size assignable to a task.
@@ -46,6 +50,19 @@ typedef void (*Task_t)(void*);
  */
 typedef pthread_t Task_id_t;
 
+/**
+ * @brief Attributes of a task.
+ * @details Initialized by Task_attr_init() with the attributes used by CreateTask(): default scheduling,
+ *          any CPU, and a stack that is not locked.
+ */
+typedef struct task_attr{
+    size_t stack_size;  /**< Size in bytes for the stack of the task. Raised to PTHREAD_STACK_MIN if smaller */
+    int policy;         /**< Scheduling policy: SCHED_OTHER, SCHED_FIFO or SCHED_RR */
+    int priority;       /**< Priority for SCHED_FIFO and SCHED_RR, from 1 (lowest) to 99 */
+    cpu_set_t affinity; /**< CPUs on which the task may run. If empty, any */
+    int lock_stack;     /**< If non-zero, the stack is locked in RAM (or at least prefaulted) when the task starts */
+} Task_attr;
+
 /**
  * @brief Create and start a new task.
  * @param[in] name       String. Name of the task.
@@ -56,6 +73,38 @@ typedef pthread_t Task_id_t;
  */
 Task_id_t CreateTask(const char* name, size_t stack_size, Task_t entry_func, void* arg);
 
+/**
+ * @brief Initialize the attributes of a task with the defaults.
+ * 
+ * @param[out] attr Attributes to initialize.
+ * @param[in] stack_size Size in bytes for the stack of the task.
+ */
+void Task_attr_init(Task_attr* attr, size_t stack_size);
+
+/**
+ * @brief Create and start a new task with the given attributes.
+ * 
+ * The task applies its attributes before calling entry_func. If the scheduling policy, the affinity,
+ * or the stack lock can't be applied (e.g. the process is not privileged), an error is printed and
+ * the task runs without them.
+ * 
+ * @param[in] name       String. Name of the task.
+ * @param[in] attr       Attributes of the task.
+ * @param[in] entry_func Entry function for the task.
+ * @param[in] arg        Argument passed to the new task.
+ * @return (Task_id_t) On success: Numerical id of the new task. On failure: 0. 
+ */
+Task_id_t CreateTask_attr(const char* name, const Task_attr* attr, Task_t entry_func, void* arg);
+
+/**
+ * @brief Restrict a running task to a single CPU.
+ * 
+ * @param[in] task_id Id of the task.
+ * @param[in] cpu Index of the CPU.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int Task_set_affinity(Task_id_t task_id, int cpu);
+
 /**
  * @brief Get the id of a task with a given name.
  * 
@@ -5,6 +5,9 @@
  * @details Library with functions for generating blocking delays, and doing arithmetic operations
  *          on timespec structs. It also offers some additional utilities for printing timespec structs
  *          and converting an int to a timespec.
+ *          Delays can be switched to a virtual clock (see Time_virtual_start()), which jumps to the earliest
+ *          deadline as soon as every thread holding it is asleep, so timed code runs as fast as it can be
+ *          computed, with exact and reproducible times.
  * @version 1.0
  * @date 03.07.2021
  * 
@@ -37,6 +40,82 @@
  * @brief Amount of nanoseconds in a millisecond
  */ 
 #define NANO_IN_MILLI   ((unsigned int)(1000000))     
+/**
+ * @brief Length of the sleeps measured by Delay_calibrate_spin(), in nanoseconds
+ */
+#define DELAY_CALIBRATION_INTERVAL_NS 100000
+/**
+ * @brief Time of the virtual clock when it is started, in nanoseconds
+ */
+#define TIME_VIRTUAL_START_NS 1000000000ULL
+/**
+ * @brief Maximum amount of threads sleeping on the virtual clock at once
+ */
+#define TIME_VIRTUAL_SLEEPERS_MAX 64
+
+/**
+ * @brief Get the current time of the clock used by the delays
+ * 
+ * CLOCK_MONOTONIC, or the virtual clock once Time_virtual_start() was called.
+ * 
+ * @param[out] t Current time
+ */
+void Time_now(struct timespec* t);
+
+/**
+ * @brief Switch the delays to a virtual clock
+ * 
+ * The virtual clock starts at TIME_VIRTUAL_START_NS, and only advances when every hold on it was
+ * released (see Time_virtual_hold()), to the earliest deadline of the threads sleeping on it. The
+ * calling thread holds the clock from then on, and releases it while it sleeps. Delays of threads that
+ * don't hold the clock must not be used. There is no way back to CLOCK_MONOTONIC.
+ * 
+ * @return (int) 0 on success, -1 if the virtual clock was already started.
+ */
+int Time_virtual_start(void);
+
+/**
+ * @brief Check if the delays use the virtual clock
+ * 
+ * @return (int) 1 if Time_virtual_start() was called, 0 otherwise.
+ */
+int Time_is_virtual(void);
+
+/**
+ * @brief Keep the virtual clock from advancing
+ * 
+ * Taken on behalf of a thread that is about to run on virtual time (eg. before waking it up), which releases
+ * it with Time_virtual_release() when it stops running. Holds are counted, not bound to a thread, so a
+ * hold may be handed from a thread to another. No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_hold(void);
+
+/**
+ * @brief Release a hold on the virtual clock, advancing it if it was the last one
+ * 
+ * No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_release(void);
+
+/**
+ * @brief Sleep on the virtual clock until a deadline, or until a condition is met
+ * 
+ * The hold of the calling thread is released while it sleeps. The condition is checked when the sleep
+ * starts, and every time Time_virtual_notify() is called.
+ * 
+ * @param[in] deadline Absolute time of the virtual clock at which to wake up
+ * @param[in] ready Condition that ends the sleep early. May be NULL.
+ * @param[in] arg Argument of ready.
+ * @return (int) 1 if the sleep ended because of the condition, 0 otherwise.
+ */
+int Time_virtual_wait(const struct timespec* deadline, int (*ready)(void*), void* arg);
+
+/**
+ * @brief Check again the conditions of the threads sleeping on the virtual clock
+ * 
+ * No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_notify(void);
 
 
 /**
@@ -60,6 +139,43 @@ void Delay_us(long us);
  */
 void Delay_ns(long ns);
 
+/**
+ * @brief Delay until an absolute time
+ * 
+ * Sleeps against CLOCK_MONOTONIC with TIMER_ABSTIME, so consecutive calls with increasing
+ * deadlines don't accumulate wakeup latency. Returns inmediately if the deadline already passed.
+ * With the virtual clock, sleeps with Time_virtual_wait().
+ * 
+ * @param[in] deadline Absolute CLOCK_MONOTONIC time at which to wake up
+ */
+void Delay_until(const struct timespec* deadline);
+
+/**
+ * @brief Delay until an absolute time, sleeping first and then spinning
+ * 
+ * Sleeps like Delay_until() until spin_ns before the deadline, and busy-waits on CLOCK_MONOTONIC
+ * for the rest. With spin_ns larger than the wakeup latency of the sleep, the deadline is met with the
+ * resolution of the clock, at the cost of keeping the CPU busy while spinning.
+ * Returns inmediately if the deadline already passed. With the virtual clock, only sleeps.
+ * 
+ * @param[in] deadline Absolute CLOCK_MONOTONIC time at which to wake up
+ * @param[in] spin_ns Time before the deadline from which to spin, in nanoseconds. 0 only sleeps.
+ */
+void Delay_until_spin(const struct timespec* deadline, long long spin_ns);
+
+/**
+ * @brief Measure the wakeup latency of Delay_until()
+ * 
+ * Sleeps samples times, DELAY_CALIBRATION_INTERVAL_NS each, and measures how late each wakeup is.
+ * The result is the spin time for Delay_until_spin() that meets every measured deadline. Latency
+ * depends on the scheduling policy and the core of the calling thread, so it should be called from
+ * a thread configured like the one which will use Delay_until_spin().
+ * 
+ * @param[in] samples Amount of sleeps to measure.
+ * @return (long long) Largest measured latency, in nanoseconds.
+ */
+long long Delay_calibrate_spin(unsigned int samples);
+
 /**
  * @brief Add two timespec structs
  * 
@@ -87,6 +203,24 @@ void sub_time(const struct timespec* ta, const struct timespec* tb, struct times
  */
 void mul_time(const struct timespec* ta, unsigned int b, struct timespec* result);
 
+/**
+ * @brief Add an amount of nanoseconds to a timespec
+ * 
+ * @param[in] ta Time
+ * @param[in] ns Nanoseconds to add
+ * @param[out] result ta + ns, in a timespec struct
+ */
+void add_time_ns(const struct timespec* ta, unsigned long long ns, struct timespec* result);
+
+/**
+ * @brief Get the difference between two timespec structs in nanoseconds
+ * 
+ * @param[in] ta Time A
+ * @param[in] tb Time B
+ * @return (long long) A-B, in nanoseconds. Negative if tb > ta.
+ */
+long long diff_time_ns(const struct timespec* ta, const struct timespec* tb);
+
 /**
  * @brief Divide a timespec by a positive integer. Returns 0 if b == 0 
  * 
@@ -0,0 +1,156 @@
+/**
+ * @file Trace.h
+ * @author Rafael Martinez (rafael.martinez@udem.edu)
+ * @brief Step waveform trace library public interface.
+ * @details Flight recorder of the edges driven by a pulser. A trace is a preallocated ring of events, written
+ *          by a single thread (the pulser it is attached to, see stepper_set_trace()) without locking. When
+ *          the ring is full, the oldest events are overwritten, so the trace always holds the last ones.
+ *          Other threads take a consistent copy of the ring with trace_snapshot() while the pulser runs.
+ *          Snapshots can be saved to a binary file, and exported as a VCD file for GTKWave, or summarized
+ *          in a histogram of the step periods (see the trace_dump tool).
+ * @see Stepper.h
+ * @version 1.0
+ * @date 16.10.2026
+ *
+ * @copyright Copyright (c) 2021
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+
+/**
+ * @brief Size of a cache line, in bytes.
+ */
+#define TRACE_CACHE_LINE 64
+
+/**
+ * @brief Signals recorded in a trace.
+ */
+typedef enum trace_signal{
+    TRACE_STEP = 0, /**< STEP input of a driver */
+    TRACE_DIR = 1   /**< DIR input of a driver */
+} trace_signal_t;
+
+/**
+ * @brief Edge recorded in a trace.
+ */
+typedef struct trace_event{
+    unsigned long long t_ns;    /**< CLOCK_MONOTONIC time of the edge, in nanoseconds. Virtual time if the virtual clock runs (see Time.h) */
+    unsigned int request;       /**< Id of the request whose move drove the edge */
+    unsigned int pin;           /**< Pin of the line, from the defined symbols in GPIO.h */
+    unsigned short signal;      /**< Signal of the line (see trace_signal_t) */
+    unsigned short value;       /**< Level of the line after the edge */
+} Trace_event;
+
+/**
+ * @brief Trace object.
+ * @details Constructed by trace_create().
+ */
+typedef struct trace{
+    Trace_event* events;        /**< @internal Ring of events */
+    size_t mask;                /**< @internal Capacity of the ring minus one */
+    _Alignas(TRACE_CACHE_LINE) atomic_size_t head; /**< @internal Events recorded since the creation. Written by the writer */
+} Trace;
+
+/**
+ * @brief Create an empty trace.
+ *
+ * @param[in] capacity Amount of events kept. Must be a power of two.
+ * @return (Trace*) On success, pointer to the new trace. Otherwise, NULL.
+ */
+Trace* trace_create(size_t capacity);
+
+/**
+ * @brief Destroy a trace. It must not be attached to a pulser anymore.
+ *
+ * @param[in] trace Trace to destroy. May be NULL.
+ */
+void trace_destroy(Trace* trace);
+
+/**
+ * @brief Record an edge in a trace. Must only be called by the writer of the trace.
+ *
+ * @param[in,out] trace Trace to update.
+ * @param[in] t_ns CLOCK_MONOTONIC time of the edge, in nanoseconds.
+ * @param[in] request Id of the request driving the edge.
+ * @param[in] pin Pin of the line.
+ * @param[in] signal Signal of the line.
+ * @param[in] value Level of the line after the edge.
+ */
+static inline void trace_record(Trace* trace, unsigned long long t_ns, unsigned int request, unsigned int pin,
+                                trace_signal_t signal, int value)
+{
+    size_t head = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    Trace_event* event = &trace->events[head & trace->mask];
+
+    event->t_ns = t_ns;
+    event->request = request;
+    event->pin = pin;
+    event->signal = signal;
+    event->value = value;
+
+    // Publishes the event to the readers
+    atomic_store_explicit(&trace->head, head + 1, memory_order_release);
+}
+
+/**
+ * @brief Copy the events of a trace, oldest first. May be called while the writer runs.
+ * @details Events overwritten by the writer during the copy are left out.
+ *
+ * @param[in] trace Trace to copy.
+ * @param[out] events Array receiving the events.
+ * @param[in] max Amount of events that fit in the array.
+ * @return (size_t) Amount of events copied.
+ */
+size_t trace_snapshot(Trace* trace, Trace_event events[], size_t max);
+
+/**
+ * @brief Save the events of a trace to a binary file.
+ *
+ * @param[in] trace Trace to save. May be running.
+ * @param[in] path Path of the file. Overwritten if it exists.
+ * @return (int) 0 on success, -1 otherwise.
+ */
+int trace_save(Trace* trace, const char* path);
+
+/**
+ * @brief Load the events saved by trace_save().
+ *
+ * @param[in] path Path of the file.
+ * @param[out] events On success, points to the events read, to be freed by the caller.
+ * @return (long) Amount of events read on success, -1 otherwise.
+ */
+long trace_load(const char* path, Trace_event** events);
+
+/**
+ * @brief Write events as a Value Change Dump, with a 1 ns timescale.
+ * @details Every line is a wire named after its signal and J21 header pin (eg. step_23). The request
+ *          driving the edges is dumped as an integer variable.
+ *
+ * @param[in] events Events, oldest first.
+ * @param[in] count Amount of events.
+ * @param[in,out] out Stream the VCD is written to.
+ * @return (int) 0 on success, -1 otherwise.
+ */
+int trace_write_vcd(const Trace_event events[], size_t count, FILE* out);
+
+/**
+ * @brief Build the histogram of the step periods of a line, measured between consecutive rising edges.
+ * @details Periods spanning two requests are left out, since the line may have been idle in between.
+ *
+ * @param[in] events Events, oldest first.
+ * @param[in] count Amount of events.
+ * @param[in] pin Pin of the STEP line.
+ * @param[in] bin_ns Width of the bins, in nanoseconds.
+ * @param[out] bins Counts of the periods in [i*bin_ns, (i+1)*bin_ns). Longer periods are counted in the last one.
+ * @param[in] nbins Amount of bins.
+ * @return (long) Amount of periods counted on success, -1 otherwise.
+ */
+long trace_histogram(const Trace_event events[], size_t count, unsigned int pin, unsigned long long bin_ns,
+                     unsigned int bins[], unsigned int nbins);
+
+#endif
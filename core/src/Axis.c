@@ -10,15 +10,17 @@
 
 /**
  * @internal
- * @brief Convert millimeters to microsteps
+ * @brief Convert a speed from mm/sec to microsteps/sec
  * 
- * @param[in] axis Axis handle 
- * @param[in] mm Millimeters
- * @return (int) Amount of steps
+ * Not truncated, so the motors keep the exact speed of the axis.
+ * 
+ * @param[in] axis Axis handle
+ * @param[in] mm_per_sec Speed in mm/sec
+ * @return (double) Speed in microsteps/sec
  */
-inline static unsigned int mm_to_steps(Axis* axis, double mm)
+inline static double mm_to_pps(Axis* axis, double mm_per_sec)
 {
-    return (unsigned int)(mm * (double)axis->motors[0]->microsteps_per_rotation / axis->mm_per_rotation);
+    return mm_per_sec * (double)axis->motors[0]->microsteps_per_rotation / axis->mm_per_rotation;
 }
 
 /**
@@ -29,11 +31,80 @@ inline static unsigned int mm_to_steps(Axis* axis, double mm)
  * @param[in] steps Steps
  * @return (double) Millimeters 
  */
-inline static double steps_to_mm(Axis* axis, int steps)
+inline static double steps_to_mm(Axis* axis, long long steps)
 {
     return (double)steps * axis->mm_per_rotation / (double)axis->motors[0]->microsteps_per_rotation;
 }
 
+/**
+ * @internal
+ * @brief Restart the commanded position of an idle axis from its actual position.
+ * 
+ * Needed after a stop, or after its motors were moved on their own, so the next move doesn't
+ * catch up with the steps that were never taken.
+ * 
+ * @param[in] axis Axis handle
+ */
+static void axis_sync(Axis* axis)
+{
+    Stepper_position given;
+
+    if(!stepper_ready(axis->motors[0]))
+        return;
+
+    for(unsigned int i = 0; i < axis->num_motors; i++){
+        if(stepper_get_position(axis->motors[i], &given) == 0 && given.steps != axis->issued[i]){
+            axis->issued[i] = given.steps;
+            axis->commanded[i] = given.steps * (1LL << AXIS_FRAC_BITS);
+        }
+    }
+}
+
+/**
+ * @internal
+ * @brief Advance the commanded position of the motors of an axis, and get the steps each one takes.
+ * 
+ * Each motor is converted with its own microstep configuration, so motors with different gearing
+ * still advance the same distance. Steps are rounded from the commanded position, not from the
+ * distance, so the fraction of a microstep of a move is carried into the next one.
+ * 
+ * @param[in] axis Axis handle
+ * @param[in] distance Distance to advance in mm
+ * @param[out] commanded New commanded position of each motor, applied by axis_commit()
+ * @param[out] steps Signed steps each motor takes
+ * @return (int) Non-zero if any motor has to step
+ */
+static int axis_plan(Axis* axis, double distance, long long commanded[], int steps[])
+{
+    int total = 0;
+
+    for(unsigned int i = 0; i < axis->num_motors; i++){
+        double microsteps = distance * (double)axis->motors[i]->microsteps_per_rotation / axis->mm_per_rotation;
+        commanded[i] = axis->commanded[i] + llround(ldexp(microsteps, AXIS_FRAC_BITS));
+        long long target = (commanded[i] + (1LL << (AXIS_FRAC_BITS - 1))) >> AXIS_FRAC_BITS;
+        steps[i] = (int)(target - axis->issued[i]);
+        total |= steps[i];
+    }
+
+    return total;
+}
+
+/**
+ * @internal
+ * @brief Apply the commanded position planned by axis_plan(), once its move is accepted.
+ * 
+ * @param[in] axis Axis handle
+ * @param[in] commanded Commanded position of each motor
+ * @param[in] steps Signed steps each motor takes
+ */
+static void axis_commit(Axis* axis, const long long commanded[], const int steps[])
+{
+    for(unsigned int i = 0; i < axis->num_motors; i++){
+        axis->commanded[i] = commanded[i];
+        axis->issued[i] += steps[i];
+    }
+}
+
 /************* PUBLIC API *************/
 
 /**
@@ -85,6 +156,8 @@ Axis* axis_init(Stepper* motors[], unsigned int mm_per_rotation, unsigned int co
     axis->mm_per_rotation = (double)mm_per_rotation;
     // axis->position = 0.0f;
     // axis->speed = 0.0f;
+    // axis->commanded[] = 0;
+    // axis->issued[] = 0;
 
     goto exit;
 
@@ -115,8 +188,8 @@ int axis_set_speed(Axis* axis, double mm_per_sec)
         return retval;
     }
 
-    unsigned int steps_per_sec = mm_to_steps(axis, mm_per_sec);
-    DEBUG_PRINT("Vel: %d pps", steps_per_sec);
+    double steps_per_sec = mm_to_pps(axis, mm_per_sec);
+    DEBUG_PRINT("Vel: %.3f pps", steps_per_sec);
 
     if(stepper_set_speed_multiple(axis->motors, steps_per_sec, axis->num_motors) < 0)
         ERROR_PRINT("Could not set new speed for the axis.");
@@ -128,6 +201,33 @@ int axis_set_speed(Axis* axis, double mm_per_sec)
     return retval;
 }
 
+/**
+ * @brief Override the feed rate of an axis while it moves.
+ * 
+ * The move in progress and the queued ones run at the given fraction of their speed. The axis
+ * changes speed at its maximum acceleration.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] percent Feed rate, in percent of the programmed speed (STEPPER_FEED_MIN to 100).
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_set_feed(Axis* axis, double percent)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return -1;
+    }
+
+    // Requests of the axis are led by its first motor
+    if(stepper_set_feed(axis->motors[0], percent) < 0){
+        ERROR_PRINT("Could not set the feed rate of the axis.");
+        return -1;
+    }
+
+    return 0;
+}
+
 /**
  * @brief Set the direction of an axis. 
  * 
@@ -161,6 +261,36 @@ exit:
     return retval;
 }
 
+/**
+ * @brief Set the motion profile used by the next moves of an axis.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] type PROFILE_CONSTANT, PROFILE_TRAPEZOIDAL or PROFILE_SCURVE.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_set_profile(Axis* axis, profile_type_t type)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        goto exit;
+    } // type is validated by stepper_set_profile
+
+    for(unsigned int i = 0; i < axis->num_motors; i++){
+        if(stepper_set_profile(axis->motors[i], type) < 0){
+            ERROR_PRINT("Could not set the profile for a motor of the axis.");
+            goto exit;
+        }
+    }
+
+    retval = 0; // Only comes here on success
+
+exit:
+    return retval;
+}
+
 /**
  * @brief Move an axis a set distance.
  * 
@@ -184,6 +314,17 @@ int axis_move(Axis* axis, double distance)
         goto exit;
     }
 
+    axis_sync(axis);
+
+    long long commanded[MOTOR_LIST_SIZE_MAX];
+    int signed_steps[MOTOR_LIST_SIZE_MAX];
+    if(axis_plan(axis, distance, commanded, signed_steps) == 0){
+        DEBUG_PRINT("Distance under a microstep, carried to the next move.");
+        axis_commit(axis, commanded, signed_steps);
+        retval = 0; // Not an error
+        goto exit;
+    }
+
     // If a previous command caused a temporary direction change, reset it
     // Since a call to wait or stop is not assured, its better to have this here
     if(axis->reset_dir){
@@ -196,7 +337,7 @@ int axis_move(Axis* axis, double distance)
     }
 
     // Change temporarily the direction to the opposite relative direction
-    // if distance is negative
+    // if distance is negative. No line is written until the first step of the move.
     // TODO: Check if bitwise checking and changing sign is more efficient
     if(distance < 0) {
         distance = -distance;
@@ -207,14 +348,70 @@ int axis_move(Axis* axis, double distance)
         }
     }
 
-    unsigned int steps = mm_to_steps(axis, distance);
-    DEBUG_PRINT("Distance: %d mm (%d steps)", (int)distance, steps);
+    // Steps have the sign of the distance (or are 0), which is now given by the direction
+    unsigned int steps[MOTOR_LIST_SIZE_MAX];
+    for(unsigned int i = 0; i < axis->num_motors; i++)
+        steps[i] = (unsigned int)abs(signed_steps[i]);
+    DEBUG_PRINT("Distance: %d mm (%d steps)", (int)distance, steps[0]);
 
-    
-    if(stepper_step_multiple(axis->motors, steps, axis->num_motors) < 0)
+    if(stepper_step_coordinated(axis->motors, steps, axis->num_motors) < 0)
         ERROR_PRINT("Error attempting to move the axis.");
-    else
+    else{
+        axis_commit(axis, commanded, signed_steps);
         retval = 0; // Only comes on success
+    }
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Queue a move of an axis, joined with the previous queued move if possible.
+ * 
+ * If the axis is idle, the move starts right away. Otherwise, it runs after the moves queued
+ * before it, without stopping in between if both go in the same direction. Negative distance
+ * implies to move in the opposite direction.
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @param[in] distance Distance to advance in mm (can be positive or negative).
+ * @param[in] mm_per_sec Speed of the move in mm/sec (must be positive).
+ * @return (int) On success, 0. Otherwise (e.g. the queue is full), -1.
+ */
+int axis_queue_move(Axis* axis, double distance, double mm_per_sec)
+{
+    int retval = -1;
+    int steps[MOTOR_LIST_SIZE_MAX];
+    long long commanded[MOTOR_LIST_SIZE_MAX];
+
+    // Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        goto exit;
+    } else if(mm_per_sec <= 0){
+        ERROR_PRINT("Invalid speed.");
+        goto exit;
+    }
+
+    axis_sync(axis);
+
+    if(axis_plan(axis, distance, commanded, steps) == 0){
+        DEBUG_PRINT("Distance under a microstep, carried to the next move.");
+        axis_commit(axis, commanded, steps);
+        retval = 0; // Not an error
+        goto exit;
+    }
+
+    DEBUG_PRINT("Queued distance: %d mm (%d steps)", (int)distance, steps[0]);
+
+    if(stepper_queue_move(axis->motors, steps, mm_to_pps(axis, mm_per_sec), axis->num_motors) < 0){
+        ERROR_PRINT("Error attempting to queue the move.");
+        goto exit;
+    }
+
+    // Queued moves leave the motors turned in the direction of the last one
+    axis_commit(axis, commanded, steps);
+    axis->reset_dir = 1;
+    retval = 0; // Only comes on success
 
 exit:
     return retval;
@@ -254,7 +451,9 @@ int axis_ready(Axis* axis)
 }
 
 /**
- * @brief Stop an axis from moving.
+ * @brief Stop an axis from moving, immediately.
+ * 
+ * Steps may be lost at high speeds. Meant for emergency stops, see axis_stop_decel() otherwise.
  * 
  * @param[in] axis Handle of the axis to update.
  */
@@ -269,6 +468,101 @@ void axis_stop(Axis* axis)
     stepper_stop(axis->motors[0]);
 }
 
+/**
+ * @brief Ask an axis to stop, without waiting for it.
+ * 
+ * The event file descriptor of the axis becomes readable once it has stopped (see axis_get_event_fd()).
+ * 
+ * @param[in] axis Handle of the axis to update.
+ */
+void axis_stop_nowait(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return;
+    }
+
+    stepper_stop_nowait(axis->motors[0]);
+}
+
+/**
+ * @brief Ask an axis to decelerate to a stop, without waiting for it.
+ * 
+ * No step is lost, so the position of the axis stays valid. See stepper_stop_decel_nowait().
+ * 
+ * @param[in] axis Handle of the axis to update.
+ */
+void axis_stop_decel_nowait(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return;
+    }
+
+    stepper_stop_decel_nowait(axis->motors[0]);
+}
+
+/**
+ * @brief Decelerate an axis to a stop.
+ * 
+ * Function blocks until the axis has stopped. See axis_stop_decel_nowait().
+ * 
+ * @param[in] axis Handle of the axis to update.
+ * @return (double) On success, position at which the axis stopped, in mm. Otherwise, NAN.
+ */
+double axis_stop_decel(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return NAN;
+    }
+
+    if(stepper_stop_decel(axis->motors[0], NULL) < 0)
+        return NAN;
+
+    return axis_get_position(axis);
+}
+
+/**
+ * @brief Get the event file descriptor of an axis.
+ * 
+ * The descriptor becomes readable when a move of the axis finishes, or is stopped, and stays readable
+ * until cleared with axis_clear_event(). Clear it before checking axis_ready(), so no completion is missed.
+ * 
+ * @param[in] axis Handle to the axis.
+ * @return (int) File descriptor on success, negative value otherwise.
+ */
+int axis_get_event_fd(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return -1;
+    }
+
+    // Moves of the axis are led by its first motor, and finish together for all motors
+    return stepper_get_event_fd(axis->motors[0]);
+}
+
+/**
+ * @brief Clear the event file descriptor of an axis.
+ * 
+ * @param[in] axis Handle to the axis.
+ */
+void axis_clear_event(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return;
+    }
+
+    stepper_clear_event(axis->motors[0]);
+}
+
 /**
  * @brief Get the current position of an axis
  * 
@@ -283,7 +577,66 @@ double axis_get_position(Axis* axis)
         return NAN;
     }
 
-    unsigned int given_steps = stepper_get_steps(axis->motors[0]);
-    axis->position = steps_to_mm(axis, given_steps);
+    Stepper_position given;
+    if(stepper_get_position(axis->motors[0], &given) < 0)
+        return NAN;
+
+    axis->position = steps_to_mm(axis, given.steps);
     return axis->position;
 }
+
+/**
+ * @brief Get the commanded position of an axis.
+ * 
+ * Sum of the distances of the moves commanded since the axis was created, or since it was last
+ * stopped. Moves are rounded to whole microsteps, and the remainder is carried into the next move,
+ * so the actual position (see axis_get_position()) stays within half a microstep of the commanded
+ * one once the axis is idle.
+ * 
+ * @param[in] axis Handle of the axis of interest.
+ * @return (double) On success, commanded position of the axis in mm. Otherwise, NAN.
+ */
+double axis_get_commanded_position(Axis* axis)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return NAN;
+    }
+
+    axis_sync(axis);
+
+    return ldexp((double)axis->commanded[0], -AXIS_FRAC_BITS) * axis->mm_per_rotation / (double)axis->motors[0]->microsteps_per_rotation;
+}
+
+/**
+ * @brief Get the current position of an axis, and the time at which the axis reached it.
+ * 
+ * The position and the time belong to the same step of the first motor of the axis, so they
+ * can be matched with other measurements. Doesn't lock, and can be called from any thread.
+ * 
+ * @param[in] axis Handle of the axis of interest.
+ * @param[out] position Current position of the axis, in mm.
+ * @param[out] t_step CLOCK_MONOTONIC time of the last step of the axis. Zero if it hasn't moved.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int axis_get_position_stamped(Axis* axis, double* position, struct timespec* t_step)
+{
+    //Parameter validation
+    if(axis == NULL){
+        ERROR_PRINT("Axis reference is invalid.");
+        return -1;
+    } else if(position == NULL || t_step == NULL){
+        ERROR_PRINT("Output reference is invalid.");
+        return -1;
+    }
+
+    Stepper_position given;
+    if(stepper_get_position(axis->motors[0], &given) < 0)
+        return -1;
+
+    *position = steps_to_mm(axis, given.steps);
+    *t_step = given.t_step;
+
+    return 0;
+}
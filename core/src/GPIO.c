@@ -9,12 +9,15 @@
 
 #include "GPIO.h"
 #include "debug.h"
+#include <string.h>
 
 #define CONSUMER_NAME "PEF"
 
 static struct gpiod_chip* main_chip = NULL;
 static struct gpiod_chip* aon_chip = NULL;
 
+static const GPIO_Backend* selected_backend = NULL;
+
 /**
  * @brief Initialize the GPIO chip to which a pin belongs to.
  * 
@@ -67,8 +70,152 @@ exit:
     return retval;
 }
 
+/**
+ * @brief Get the line of a pin from its controller, initializing the controller if needed.
+ * 
+ * @param[in,out] pin Pin handle. Its line is set on success.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+static int gpio_gpiod_open_pin(GPIO_Pin* pin)
+{
+    // Initialize controller for the pin. If it is already initialized, function returns inmediately.
+    if(gpio_init_controller(pin->pin)){
+        ERROR_PRINT("Error initializing corresponding controller chip for pin %d.", GPIO_GET_LINE(pin->pin));
+        return -1;
+    }
+
+    DEBUG_PRINT("main=%p\naon=%p", main_chip, aon_chip);
+
+    // Register the corresponding line for a pin in its controller.
+    pin->line = gpiod_chip_get_line((GPIO_GET_CONTROLLER(pin->pin) == GPIO_MAIN_CONTROLLER_FLAG) ? main_chip : aon_chip, GPIO_GET_LINE(pin->pin));
+    if(pin->line == NULL){
+        ERROR_PRINT("Error reclaiming pin %d.", GPIO_GET_LINE(pin->pin));
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Remaining operations of the libgpiod backend map directly to the functions of the library.
+ */
+
+static int gpio_gpiod_request_pin(GPIO_Pin* pin, gpio_direction_t direction, int init_val)
+{
+    if(direction == GPIO_DIRECTION_INPUT)
+        return gpiod_line_request_input(pin->line, CONSUMER_NAME);
+    else
+        return gpiod_line_request_output(pin->line, CONSUMER_NAME, init_val);
+}
+
+static int gpio_gpiod_request_bulk(GPIO_Bulk* bulk, gpio_direction_t direction, const int init_vals[])
+{
+    gpiod_line_bulk_init(&bulk->lines);
+    for(unsigned int i = 0; i < bulk->count; i++)
+        gpiod_line_bulk_add(&bulk->lines, bulk->pins[i]->line);
+
+    if(direction == GPIO_DIRECTION_INPUT)
+        return gpiod_line_request_bulk_input(&bulk->lines, CONSUMER_NAME);
+    else
+        return gpiod_line_request_bulk_output(&bulk->lines, CONSUMER_NAME, init_vals);
+}
+
+static int gpio_gpiod_request_events(GPIO_Pin* pin)
+{
+    return gpiod_line_request_rising_edge_events(pin->line, CONSUMER_NAME);
+}
+
+static void gpio_gpiod_release_pin(GPIO_Pin* pin)
+{
+    gpiod_line_release(pin->line);
+}
+
+static void gpio_gpiod_release_bulk(GPIO_Bulk* bulk)
+{
+    gpiod_line_release_bulk(&bulk->lines);
+}
+
+static int gpio_gpiod_write(GPIO_Pin* pin, int value)
+{
+    return gpiod_line_set_value(pin->line, value);
+}
+
+static int gpio_gpiod_write_bulk(GPIO_Bulk* bulk, const int values[])
+{
+    return gpiod_line_set_value_bulk(&bulk->lines, values);
+}
+
+static int gpio_gpiod_read(GPIO_Pin* pin)
+{
+    return gpiod_line_get_value(pin->line);
+}
+
+static int gpio_gpiod_read_bulk(GPIO_Bulk* bulk, int values[])
+{
+    return gpiod_line_get_value_bulk(&bulk->lines, values);
+}
+
+static int gpio_gpiod_event_fd(GPIO_Pin* pin)
+{
+    return gpiod_line_event_get_fd(pin->line);
+}
+
+const GPIO_Backend GPIO_backend_gpiod = {
+    .name = "gpiod",
+    .open_pin = gpio_gpiod_open_pin,
+    .request_pin = gpio_gpiod_request_pin,
+    .request_bulk = gpio_gpiod_request_bulk,
+    .request_events = gpio_gpiod_request_events,
+    .release_pin = gpio_gpiod_release_pin,
+    .release_bulk = gpio_gpiod_release_bulk,
+    .write = gpio_gpiod_write,
+    .write_bulk = gpio_gpiod_write_bulk,
+    .read = gpio_gpiod_read,
+    .read_bulk = gpio_gpiod_read_bulk,
+    .event_fd = gpio_gpiod_event_fd
+};
+
+/**
+ * @brief Get the backend for new pins, selecting it from the environment the first time.
+ * 
+ * @return (const GPIO_Backend*) Backend in use.
+ */
+static const GPIO_Backend* gpio_get_backend(void)
+{
+    if(selected_backend == NULL){
+        const char* name = getenv("PEF_GPIO_BACKEND");
+        selected_backend = (name != NULL && strcmp(name, GPIO_backend_sim.name) == 0) ? &GPIO_backend_sim : &GPIO_backend_gpiod;
+        DEBUG_PRINT("Using the %s GPIO backend.", selected_backend->name);
+    }
+
+    return selected_backend;
+}
+
 /**************** PUBLIC FUNCTIONS ****************/
 
+/**
+ * @brief Select the backend of the pins initialized from now on.
+ * 
+ * If no backend is selected, the one named by the PEF_GPIO_BACKEND environment variable ("gpiod" or "sim")
+ * is used, or the libgpiod one if the variable is not set.
+ * 
+ * @param[in] backend Backend to use (eg. &GPIO_backend_sim).
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_set_backend(const GPIO_Backend* backend)
+{
+    // Parameter validation
+    if(backend == NULL){
+        ERROR_PRINT("Backend reference invalid.");
+        return -1;
+    }
+
+    selected_backend = backend;
+    DEBUG_PRINT("Using the %s GPIO backend.", backend->name);
+
+    return 0;
+}
+
 /**
  * @brief Initialize a pin on the J21 GPIO header.
  * 
@@ -79,37 +226,36 @@ exit:
  */
 GPIO_Pin* GPIO_init_pin(unsigned int pin, gpio_direction_t direction, int init_val)
 {
-    GPIO_Pin* line = NULL;
+    GPIO_Pin* handle = NULL;
 
     // Parameter validation
-    // pin value is validated by gpio_init_controller.
+    // pin value is validated by the backend.
     // direction value is validated by the switch statement.
     // init_val is not validated, but values != 0 are interpreted as 1.
-    
-    // Initialize controller for the pin. If it is already initialized, function returns inmediately.
-    if(gpio_init_controller(pin)){
-        ERROR_PRINT("Error initializing corresponding controller chip for pin %d.", GPIO_GET_LINE(pin));
+
+    handle = malloc(sizeof(GPIO_Pin));
+    if(handle == NULL){
+        ERROR_PRINT("Error allocating pin object.");
         goto exit;
     }
 
-    DEBUG_PRINT("main=%p\naon=%p", main_chip, aon_chip);
-    DEBUG_PRINT("%d", (GPIO_GET_CONTROLLER(pin) == GPIO_MAIN_CONTROLLER_FLAG));
+    memset(handle, 0, sizeof(GPIO_Pin));
+    handle->backend = gpio_get_backend();
+    handle->pin = pin;
 
-    // Register the corresponding line for a pin in its controller.
-    line = gpiod_chip_get_line((GPIO_GET_CONTROLLER(pin) == GPIO_MAIN_CONTROLLER_FLAG) ? main_chip : aon_chip, GPIO_GET_LINE(pin));
-    if(line == NULL){
-        ERROR_PRINT("Error reclaiming pin %d.", GPIO_GET_LINE(pin));
+    // Get the corresponding line for the pin
+    if(handle->backend->open_pin(handle) < 0){
+        free(handle);
+        handle = NULL;
         goto exit;
     }
 
-    // Request the bulk from driver
+    // Request the line from driver
     int retval = 0;
     switch (direction){
         case GPIO_DIRECTION_INPUT:
-            retval = gpiod_line_request_input(line, CONSUMER_NAME);
-            break;
         case GPIO_DIRECTION_OUTPUT:
-            retval = gpiod_line_request_output(line, CONSUMER_NAME, init_val);
+            retval = handle->backend->request_pin(handle, direction, init_val);
             break;
         case GPIO_DIRECTION_NONE: // Pin might be used by the caller to create a bulk later.
             retval = 0;
@@ -126,11 +272,10 @@ GPIO_Pin* GPIO_init_pin(unsigned int pin, gpio_direction_t direction, int init_v
     } else
         ERROR_PRINT("Error requesting line.");
 
-error:
-    gpiod_line_release(line);
-    line = NULL;
+    GPIO_release_pin(handle);
+    handle = NULL;
 exit:
-    return line;
+    return handle;
 }
 
 /**
@@ -139,6 +284,8 @@ exit:
  * Pins initialized this way can only be controlled groupally.
  * For controlling pins individually, initialize them with GPIO_init_pin.
  * 
+ * The bulk must be freed with GPIO_destroy_bulk.
+ * 
  * @param[in] pins Array of symbols pertaining to the pin to initialize (eg. J21_HEADER_PIN_7).
  * @param[in] direction GPIO direction (GPIO_DIRECTION_OUTPUT, GPIO_DIRECTION_INPUT, or GPIO_DIRECTION_NONE).
  *                       Applied to all pins in the bulk.
@@ -149,9 +296,11 @@ exit:
 GPIO_Bulk* GPIO_init_bulk(unsigned int pins[], gpio_direction_t direction, int init_vals[], unsigned int count)
 {
     GPIO_Bulk* bulk = NULL;
+    GPIO_Pin* handles[GPIO_BULK_MAX_PINS];
+    unsigned int opened = 0;
 
     // Parameter validation
-    // pins content is validated by gpio_init_controller
+    // pins content is validated by the backend
     // init_vals contents are not validated, but values != 0 are interpreted as 1.
     if(pins == NULL){
         ERROR_PRINT("Pin list reference invalid.");
@@ -159,7 +308,7 @@ GPIO_Bulk* GPIO_init_bulk(unsigned int pins[], gpio_direction_t direction, int i
     } else if (init_vals == NULL && direction == GPIO_DIRECTION_OUTPUT){
         ERROR_PRINT("Initial values list reference invalid.");
         goto exit;
-    } else if(count == 0 || count > GPIOD_LINE_BULK_MAX_LINES){
+    } else if(count == 0 || count > GPIO_BULK_MAX_PINS){
         ERROR_PRINT("Amount of pins is not supported.");
         goto exit;
     }
@@ -171,57 +320,165 @@ GPIO_Bulk* GPIO_init_bulk(unsigned int pins[], gpio_direction_t direction, int i
         goto exit;
     }
 
-    gpiod_line_bulk_init(bulk);
-
-    // Add the pins to the bulk
-    for(unsigned int i = 0; i < count; i++){
-        unsigned int pin = pins[i];
-
-        // Initialize controller for the pins. If it is already initialized, function returns inmediately.
-        if(gpio_init_controller(pin)){
-            ERROR_PRINT("Error initializing corresponding controller chip for pin %d.", GPIO_GET_LINE(pin));
-            goto error;
-        }
-
-        // Register the corresponding line for a pin in its controller.
-        GPIO_Pin* line = gpiod_chip_get_line((GPIO_GET_CONTROLLER(pin) == GPIO_MAIN_CONTROLLER_FLAG) ? main_chip : aon_chip, GPIO_GET_LINE(pin));
-        if(line == NULL){
-            ERROR_PRINT("Error reclaiming pin %d.", GPIO_GET_LINE(pin));
+    // Get the lines of the pins, without requesting them
+    for(opened = 0; opened < count; opened++){
+        handles[opened] = GPIO_init_pin(pins[opened], GPIO_DIRECTION_NONE, 0);
+        if(handles[opened] == NULL)
             goto error;
-        }
-
-        gpiod_line_bulk_add(bulk, line);
     }
 
     // Request the bulk from driver
-    int retval = 0;
-    switch (direction){
-        case GPIO_DIRECTION_INPUT:
-            retval = gpiod_line_request_bulk_input(bulk, CONSUMER_NAME);
-            break;
-        case GPIO_DIRECTION_OUTPUT:
-            retval = gpiod_line_request_bulk_output(bulk, CONSUMER_NAME, init_vals);
-            break;
-        default:
-            ERROR_PRINT("Invalid GPIO direction.");
-            retval = -1;
-            break;
-    }
-
-    if(retval == 0){
+    if(GPIO_request_bulk(bulk, handles, count, direction, init_vals) == 0){
         DEBUG_PRINT("Bulk initialized successfully.");
         goto exit;
-    } else 
-        ERROR_PRINT("Error requesting bulk.");
+    }
 
 error:
-    gpiod_line_release_bulk(bulk);
+    for(unsigned int i = 0; i < opened; i++)
+        GPIO_release_pin(handles[i]);
     free(bulk);
     bulk = NULL;
 exit:
     return bulk;
 }
 
+/**
+ * @brief Request pins already initialized as a bulk.
+ * 
+ * Pins must have been initialized with GPIO_DIRECTION_NONE, and can't be part of another requested bulk.
+ * All pins must be on the same GPIO controller (main or AON).
+ * 
+ * @param[out] bulk Bulk to fill. Owned by the caller.
+ * @param[in] pins Array of pins to add to the bulk.
+ * @param[in] count Amount of pins in the array.
+ * @param[in] direction GPIO direction (GPIO_DIRECTION_OUTPUT or GPIO_DIRECTION_INPUT). Applied to all pins in the bulk.
+ * @param[in] init_vals Only relevant if direction=GPIO_DIRECTION_OUTPUT. Array of initial values to write to the respective pins.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_request_bulk(GPIO_Bulk* bulk, GPIO_Pin* pins[], unsigned int count, gpio_direction_t direction, const int init_vals[])
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(bulk == NULL || pins == NULL){
+        ERROR_PRINT("Bulk or pin list reference invalid.");
+        goto exit;
+    } else if(count == 0 || count > GPIO_BULK_MAX_PINS){
+        ERROR_PRINT("Amount of pins is not supported.");
+        goto exit;
+    } else if(direction != GPIO_DIRECTION_OUTPUT && direction != GPIO_DIRECTION_INPUT){
+        ERROR_PRINT("Invalid GPIO direction.");
+        goto exit;
+    } else if(init_vals == NULL && direction == GPIO_DIRECTION_OUTPUT){
+        ERROR_PRINT("Initial values list reference invalid.");
+        goto exit;
+    }
+
+    // All pins must be driven by the same backend
+    for(unsigned int i = 0; i < count; i++){
+        if(pins[i] == NULL || pins[i]->backend != pins[0]->backend){
+            ERROR_PRINT("Pin at index %d is invalid.", i);
+            goto exit;
+        }
+    }
+
+    // Lines of a bulk are requested from a single chip, so they can't mix the main and AON controllers
+    for(unsigned int i = 1; i < count; i++){
+        if(GPIO_GET_CONTROLLER(pins[i]->pin) != GPIO_GET_CONTROLLER(pins[0]->pin)){
+            ERROR_PRINT("Pin at index %d is not on the GPIO controller of the first pin of the bulk.", i);
+            goto exit;
+        }
+    }
+
+    for(unsigned int i = 0; i < count; i++)
+        bulk->pins[i] = pins[i];
+    bulk->backend = pins[0]->backend;
+    bulk->count = count;
+
+    if(bulk->backend->request_bulk(bulk, direction, init_vals) < 0){
+        ERROR_PRINT("Error requesting bulk.");
+        goto exit;
+    }
+
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Release the pins of a bulk requested with GPIO_request_bulk.
+ * 
+ * The pins stay initialized, and can be requested again.
+ * 
+ * @param[in] bulk Bulk to release.
+ */
+void GPIO_release_bulk(GPIO_Bulk* bulk)
+{
+    if(bulk == NULL || bulk->count == 0)
+        return;
+
+    bulk->backend->release_bulk(bulk);
+    bulk->count = 0;
+}
+
+/**
+ * @brief Release a bulk initialized with GPIO_init_bulk, and free it along with the handles of its pins.
+ * 
+ * Must not be used on a bulk filled with GPIO_request_bulk, whose pins and storage belong to the caller.
+ * 
+ * @param[in] bulk Bulk to destroy.
+ */
+void GPIO_destroy_bulk(GPIO_Bulk* bulk)
+{
+    if(bulk == NULL)
+        return;
+
+    // Releasing the bulk clears its count, but not its pins
+    unsigned int count = bulk->count;
+    GPIO_release_bulk(bulk);
+    for(unsigned int i = 0; i < count; i++)
+        GPIO_release_pin(bulk->pins[i]);
+
+    free(bulk);
+}
+
+/**
+ * @brief Request a pin as an input reporting its rising edges.
+ * 
+ * Pin must have been initialized with GPIO_DIRECTION_NONE.
+ * 
+ * @param[in] pin Pin to request.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_request_events(GPIO_Pin* pin)
+{
+    // Parameter validation
+    if(pin == NULL){
+        ERROR_PRINT("Pin reference invalid.");
+        return -1;
+    }
+
+    return pin->backend->request_events(pin);
+}
+
+/**
+ * @brief Get a file descriptor that becomes readable on the rising edges of a pin.
+ * 
+ * @param[in] pin Pin requested with GPIO_request_events.
+ * @return (int) File descriptor on success. Otherwise, -1.
+ */
+int GPIO_get_event_fd(GPIO_Pin* pin)
+{
+    // Parameter validation
+    if(pin == NULL){
+        ERROR_PRINT("Pin reference invalid.");
+        return -1;
+    }
+
+    return pin->backend->event_fd(pin);
+}
+
 /**
  * @brief Get the J21 header pin constant corresponding to a pin number.
  * 
@@ -302,3 +559,20 @@ int int_to_gpio_pin(int p)
 
     return rv;
 }
+
+/**
+ * @brief Get the pin number corresponding to a J21 header pin constant.
+ * 
+ * @param[in] pin J21 header pin constant.
+ * @return (int) If pin is valid, corresponding pin number (eg. J21_HEADER_PIN_7 --> 7). Otherwise, 0.
+ */
+int gpio_pin_to_int(unsigned int pin)
+{
+    // Header pins are numbered from 1 to 40
+    for(int p = 1; p <= 40; p++){
+        if(int_to_gpio_pin(p) == (int)pin)
+            return p;
+    }
+
+    return 0;
+}
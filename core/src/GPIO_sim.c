@@ -0,0 +1,329 @@
+/*
+ * GPIO_sim.c
+ *
+ * Author: Rafael Martinez
+ * Date: 16.10.2026
+ */
+
+#define NDEBUG
+
+#include "GPIO_sim.h"
+#include "Time.h"
+#include "debug.h"
+#include <errno.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+// Lines of each simulated chip, one per possible line number of a pin
+#define SIM_CHIP_LINES 256
+#define SIM_LINES (2 * SIM_CHIP_LINES)
+
+static atomic_int values[SIM_LINES];
+static atomic_int requested[SIM_LINES];
+static int event_fds[SIM_LINES];   // Event file descriptor of each line, plus one (0: none)
+
+static GPIO_Edge* record = NULL;   // Edges recorded, up to record_capacity
+static size_t record_capacity = 0;
+static atomic_size_t recorded;
+static atomic_ulong dropped;
+
+/**
+ * @brief Get the index of the simulated line of a pin.
+ *
+ * @param[in] pin J21 header pin constant.
+ * @return (int) Index of the line, or -1 if the pin has no chip associated.
+ */
+static int gpio_sim_index(unsigned int pin)
+{
+    switch(GPIO_GET_CONTROLLER(pin)){
+        case GPIO_MAIN_CONTROLLER_FLAG:
+            return GPIO_GET_LINE(pin);
+        case GPIO_AON_CONTROLLER_FLAG:
+            return SIM_CHIP_LINES + GPIO_GET_LINE(pin);
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @brief Set the value of a simulated line, recording the edge if the value changes.
+ *
+ * @param[in] pin J21 header pin constant of the line.
+ * @param[in] value New value. Values != 0 are interpreted as 1.
+ * @param[in] t_ns Time of the change, in ns.
+ */
+static void gpio_sim_set(unsigned int pin, int value, unsigned long long t_ns)
+{
+    value = (value != 0);
+    if(atomic_exchange_explicit(&values[gpio_sim_index(pin)], value, memory_order_relaxed) == value || record_capacity == 0)
+        return;
+
+    size_t n = atomic_fetch_add_explicit(&recorded, 1, memory_order_relaxed);
+    if(n < record_capacity){
+        record[n].t_ns = t_ns;
+        record[n].pin = pin;
+        record[n].value = value;
+    } else
+        atomic_fetch_add_explicit(&dropped, 1, memory_order_relaxed);
+}
+
+/**
+ * @brief Get the current time of the clock of the delays, in ns.
+ *
+ * @return (unsigned long long) Current time, in ns. Virtual if the virtual clock is running (see Time.h).
+ */
+static inline unsigned long long gpio_sim_now_ns(void)
+{
+    struct timespec t_now;
+    Time_now(&t_now);
+    return (unsigned long long)t_now.tv_sec * 1000000000ULL + t_now.tv_nsec;
+}
+
+/**
+ * @brief Mark the line of a pin as requested, failing like the driver if it already is.
+ *
+ * @param[in] pin J21 header pin constant of the line.
+ * @return (int) On success, 0. Otherwise, -1 and errno set to EBUSY.
+ */
+static int gpio_sim_claim(unsigned int pin)
+{
+    if(atomic_exchange(&requested[gpio_sim_index(pin)], 1)){
+        ERROR_PRINT("Simulated line %d is busy.", GPIO_GET_LINE(pin));
+        errno = EBUSY;
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Operations of the simulated backend. Pins were validated when opened.
+ */
+
+static void gpio_sim_release_pin(GPIO_Pin* pin)
+{
+    int index = gpio_sim_index(pin->pin);
+
+    if(event_fds[index] != 0){
+        close(event_fds[index] - 1);
+        event_fds[index] = 0;
+    }
+    atomic_store(&requested[index], 0);
+}
+
+static int gpio_sim_open_pin(GPIO_Pin* pin)
+{
+    if(gpio_sim_index(pin->pin) < 0){
+        ERROR_PRINT("Specified pin doesn't have a chip associated.");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int gpio_sim_request_pin(GPIO_Pin* pin, gpio_direction_t direction, int init_val)
+{
+    if(gpio_sim_claim(pin->pin) < 0)
+        return -1;
+
+    if(direction == GPIO_DIRECTION_OUTPUT)
+        gpio_sim_set(pin->pin, init_val, gpio_sim_now_ns());
+
+    return 0;
+}
+
+static int gpio_sim_request_bulk(GPIO_Bulk* bulk, gpio_direction_t direction, const int init_vals[])
+{
+    // Lines of a bulk are requested all together, or none
+    for(unsigned int i = 0; i < bulk->count; i++){
+        if(gpio_sim_claim(bulk->pins[i]->pin) < 0){
+            while(i-- > 0)
+                atomic_store(&requested[gpio_sim_index(bulk->pins[i]->pin)], 0);
+            return -1;
+        }
+    }
+
+    if(direction == GPIO_DIRECTION_OUTPUT){
+        unsigned long long t_ns = gpio_sim_now_ns();
+        for(unsigned int i = 0; i < bulk->count; i++)
+            gpio_sim_set(bulk->pins[i]->pin, init_vals[i], t_ns);
+    }
+
+    return 0;
+}
+
+static int gpio_sim_request_events(GPIO_Pin* pin)
+{
+    int index = gpio_sim_index(pin->pin);
+
+    if(gpio_sim_claim(pin->pin) < 0)
+        return -1;
+
+    int fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(fd < 0){
+        ERROR_PRINT("Could not create the event file descriptor of simulated line %d.", GPIO_GET_LINE(pin->pin));
+        atomic_store(&requested[index], 0);
+        return -1;
+    }
+    event_fds[index] = fd + 1;
+
+    return 0;
+}
+
+static void gpio_sim_release_bulk(GPIO_Bulk* bulk)
+{
+    for(unsigned int i = 0; i < bulk->count; i++)
+        atomic_store(&requested[gpio_sim_index(bulk->pins[i]->pin)], 0);
+}
+
+static int gpio_sim_write(GPIO_Pin* pin, int value)
+{
+    gpio_sim_set(pin->pin, value, gpio_sim_now_ns());
+    return 0;
+}
+
+static int gpio_sim_write_bulk(GPIO_Bulk* bulk, const int values[])
+{
+    // Lines of a bulk change together, so they share the timestamp
+    unsigned long long t_ns = gpio_sim_now_ns();
+    for(unsigned int i = 0; i < bulk->count; i++)
+        gpio_sim_set(bulk->pins[i]->pin, values[i], t_ns);
+    return 0;
+}
+
+static int gpio_sim_read(GPIO_Pin* pin)
+{
+    return atomic_load_explicit(&values[gpio_sim_index(pin->pin)], memory_order_relaxed);
+}
+
+static int gpio_sim_read_bulk(GPIO_Bulk* bulk, int values[])
+{
+    for(unsigned int i = 0; i < bulk->count; i++)
+        values[i] = gpio_sim_read(bulk->pins[i]);
+    return 0;
+}
+
+static int gpio_sim_event_fd(GPIO_Pin* pin)
+{
+    return event_fds[gpio_sim_index(pin->pin)] - 1;
+}
+
+const GPIO_Backend GPIO_backend_sim = {
+    .name = "sim",
+    .open_pin = gpio_sim_open_pin,
+    .request_pin = gpio_sim_request_pin,
+    .request_bulk = gpio_sim_request_bulk,
+    .request_events = gpio_sim_request_events,
+    .release_pin = gpio_sim_release_pin,
+    .release_bulk = gpio_sim_release_bulk,
+    .write = gpio_sim_write,
+    .write_bulk = gpio_sim_write_bulk,
+    .read = gpio_sim_read,
+    .read_bulk = gpio_sim_read_bulk,
+    .event_fd = gpio_sim_event_fd
+};
+
+/************* PUBLIC API *************/
+
+/**
+ * @brief Start recording the edges of the simulated lines.
+ *
+ * Previous records are discarded. Edges past the capacity are counted, but not recorded.
+ * Must not be called while the lines are being written.
+ *
+ * @param[in] capacity Maximum amount of edges to record. 0 stops recording.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_sim_record(size_t capacity)
+{
+    free(record);
+    record = NULL;
+    record_capacity = 0;
+    atomic_store(&recorded, 0);
+    atomic_store(&dropped, 0);
+
+    if(capacity == 0)
+        return 0;
+
+    record = malloc(capacity * sizeof(GPIO_Edge));
+    if(record == NULL){
+        ERROR_PRINT("Error allocating the record of %zu edges.", capacity);
+        return -1;
+    }
+    record_capacity = capacity;
+
+    return 0;
+}
+
+/**
+ * @brief Get the edges recorded so far.
+ *
+ * Edges written by a single thread are in time order. Read them once the lines are not written anymore.
+ *
+ * @param[out] edges Set to the array of recorded edges.
+ * @return (size_t) Amount of edges in the array.
+ */
+size_t GPIO_sim_get_edges(const GPIO_Edge** edges)
+{
+    size_t n = atomic_load(&recorded);
+
+    if(edges != NULL)
+        *edges = record;
+
+    return (n < record_capacity) ? n : record_capacity;
+}
+
+/**
+ * @brief Get the amount of edges that didn't fit in the record.
+ *
+ * @return (unsigned long) Amount of edges dropped.
+ */
+unsigned long GPIO_sim_get_dropped(void)
+{
+    return atomic_load(&dropped);
+}
+
+/**
+ * @brief Get the current value of a simulated line.
+ *
+ * @param[in] pin J21 header pin constant of the line.
+ * @return (int) Value of the line, or -1 if the pin is invalid.
+ */
+int GPIO_sim_get_value(unsigned int pin)
+{
+    int index = gpio_sim_index(pin);
+
+    return (index < 0) ? -1 : atomic_load(&values[index]);
+}
+
+/**
+ * @brief Pulse a simulated input line, as an external signal would.
+ *
+ * The rising edge is signaled on the event file descriptor of the line, if it was requested with GPIO_request_events.
+ *
+ * @param[in] pin J21 header pin constant of the line.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int GPIO_sim_trigger(unsigned int pin)
+{
+    int index = gpio_sim_index(pin);
+    uint64_t one = 1;
+
+    // Parameter validation
+    if(index < 0){
+        ERROR_PRINT("Specified pin doesn't have a chip associated.");
+        return -1;
+    }
+
+    gpio_sim_set(pin, 1, gpio_sim_now_ns());
+    if(event_fds[index] != 0 && write(event_fds[index] - 1, &one, sizeof(one)) < 0){
+        ERROR_PRINT("Could not signal the event of simulated line %d.", GPIO_GET_LINE(pin));
+        return -1;
+    }
+    gpio_sim_set(pin, 0, gpio_sim_now_ns());
+
+    return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Planner.c
+ *
+ * Author: Rafael Martinez
+ * Date: 16.10.2026
+ */
+
+#define NDEBUG
+
+#include "Planner.h"
+#include "debug.h"
+
+// Cosine beyond which two moves are considered parallel
+#define PLANNER_COS_PARALLEL 0.999999
+
+/**
+ * @brief Highest speed from which a distance is enough to reach a given final speed.
+ *
+ * @param[in] v_final Final speed, in steps/s.
+ * @param[in] accel Acceleration, in steps/s².
+ * @param[in] length Distance, in steps.
+ * @return (double) Speed, in steps/s.
+ */
+static inline double reachable_speed(double v_final, double accel, double length)
+{
+    return sqrt(v_final * v_final + 2.0 * accel * length);
+}
+
+/************* PUBLIC API *************/
+
+/**
+ * @brief Initialize a planner block.
+ *
+ * The junction speed is set to 0 (the move starts from standstill) until planner_junction() is called.
+ *
+ * @param[out] block Block to initialize.
+ * @param[in] steps Array with the signed amount of steps of the move in each dimension. At least one must be non-zero.
+ * @param[in] dimensions Amount of dimensions in the steps array.
+ * @param[in] tick_rate Cruising speed of the move, in ticks/s.
+ * @param[in] tick_accel Maximum acceleration of the move, in ticks/s².
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int planner_block_init(Planner_block* block, const int steps[], unsigned int dimensions, double tick_rate, double tick_accel)
+{
+    int retval = -1;
+    double ticks = 0.0;
+
+    // Parameter validation
+    if(block == NULL){
+        ERROR_PRINT("Block reference is invalid.");
+        goto exit;
+    } else if(steps == NULL){
+        ERROR_PRINT("Step list reference is invalid.");
+        goto exit;
+    } else if(dimensions == 0 || dimensions > PLANNER_DIMENSIONS_MAX){
+        ERROR_PRINT("Invalid amount of dimensions.");
+        goto exit;
+    }
+
+    memset(block, 0, sizeof(Planner_block));
+
+    // Length is measured in step space, and ticks are the steps of the longest dimension
+    for(unsigned int i = 0; i < dimensions; i++){
+        double s = (double)steps[i];
+        block->length += s * s;
+        ticks = (fabs(s) > ticks) ? fabs(s) : ticks;
+    }
+    block->length = sqrt(block->length);
+
+    if(block->length == 0.0){
+        ERROR_PRINT("Move has no steps.");
+        goto exit;
+    }
+
+    for(unsigned int i = 0; i < dimensions; i++)
+        block->unit[i] = (double)steps[i] / block->length;
+
+    // Block member initialization (commented lines are redundant because of the memset)
+    block->dimensions = dimensions;
+    block->ratio = ticks / block->length;
+    block->v_max = tick_rate / block->ratio;
+    block->accel = tick_accel / block->ratio;
+    // block->v_junction = 0.0;
+    // block->v_entry = 0.0;
+    // block->v_exit = 0.0;
+
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Compute the maximum speed at the junction between two moves.
+ *
+ * @param[in] prev Block of the previous move. If NULL, the move starts from standstill.
+ * @param[in,out] block Block of the move whose junction speed is set.
+ * @param[in] deviation Junction deviation, in steps.
+ */
+void planner_junction(const Planner_block* prev, Planner_block* block, double deviation)
+{
+    // Parameter validation
+    if(block == NULL){
+        ERROR_PRINT("Block reference is invalid.");
+        return;
+    }
+
+    block->v_junction = 0.0;
+
+    if(prev == NULL || prev->dimensions != block->dimensions)
+        return;
+
+    // Cosine of the angle the path turns at the junction. 1 is a reversal, -1 keeps the direction.
+    double cos_theta = 0.0;
+    for(unsigned int i = 0; i < block->dimensions; i++)
+        cos_theta -= prev->unit[i] * block->unit[i];
+
+    double v_junction;
+    if(cos_theta > PLANNER_COS_PARALLEL){
+        v_junction = 0.0;
+    } else if(cos_theta < -PLANNER_COS_PARALLEL){
+        v_junction = INFINITY;
+    } else{
+        // Speed at which the centripetal acceleration of an arc deviating from the corner is the maximum one
+        double sin_half = sqrt(0.5 * (1.0 - cos_theta));
+        double accel = (prev->accel < block->accel) ? prev->accel : block->accel;
+        v_junction = sqrt(accel * deviation * sin_half / (1.0 - sin_half));
+    }
+
+    v_junction = (prev->v_max < v_junction) ? prev->v_max : v_junction;
+    v_junction = (block->v_max < v_junction) ? block->v_max : v_junction;
+    block->v_junction = v_junction;
+
+    DEBUG_PRINT("Junction: cos %.3f, %.1f steps/s", cos_theta, block->v_junction);
+}
+
+/**
+ * @brief Plan the entry and exit speeds of a sequence of moves.
+ *
+ * The last move of the sequence ends at standstill.
+ *
+ * @param[in,out] blocks Array of pointers to the blocks of the moves, in the order they are run.
+ * @param[in] count Amount of blocks in the array.
+ * @param[in] v_start Speed at which the first move starts, in steps/s along its path.
+ */
+void planner_recalculate(Planner_block* blocks[], unsigned int count, double v_start)
+{
+    // Parameter validation
+    if(blocks == NULL){
+        ERROR_PRINT("Block list reference is invalid.");
+        return;
+    }
+
+    // Backward pass: highest entry speed of each move from which the next ones can still slow down in time
+    double v_next = 0.0;
+    for(unsigned int i = count; i-- > 0;){
+        Planner_block* block = blocks[i];
+        double v_entry = reachable_speed(v_next, block->accel, block->length);
+        v_entry = (block->v_junction < v_entry) ? block->v_junction : v_entry;
+        v_entry = (block->v_max < v_entry) ? block->v_max : v_entry;
+
+        block->v_exit = v_next;
+        block->v_entry = v_entry;
+        v_next = v_entry;
+    }
+
+    // Forward pass: highest exit speed of each move that can be reached from its entry speed
+    double v_prev = v_start;
+    for(unsigned int i = 0; i < count; i++){
+        Planner_block* block = blocks[i];
+        double v_exit = reachable_speed(v_prev, block->accel, block->length);
+
+        block->v_entry = v_prev;
+        block->v_exit = (v_exit < block->v_exit) ? v_exit : block->v_exit;
+        v_prev = block->v_exit;
+    }
+}
@@ -0,0 +1,573 @@
+/*
+ * Profile.c
+ *
+ * Author: Rafael Martinez
+ * Date: 16.10.2026
+ */
+
+#define NDEBUG
+
+#include "Profile.h"
+#include "debug.h"
+
+// Correction factor for the first step of a ramp (see Austin, eq. 15)
+#define FIRST_STEP_CORRECTION 0.676
+// Iterations of the bisection that lowers the cruising speed of short S-curve moves
+#define SCURVE_BISECTION_ITERATIONS 32
+
+// Phases of an S-curve profile
+enum scurve_phases{
+    SCURVE_JERK_UP,      // Acceleration rises to its peak
+    SCURVE_ACCEL,        // Constant acceleration
+    SCURVE_JERK_DOWN,    // Acceleration falls to 0, reaching the cruising speed
+    SCURVE_CRUISE,       // Constant speed
+    SCURVE_DECEL_UP,     // Deceleration rises to its peak
+    SCURVE_DECEL,        // Constant deceleration
+    SCURVE_DECEL_DOWN    // Deceleration falls to 0, reaching standstill
+};
+
+// Timing of the acceleration half of an S-curve
+struct scurve_shape{
+    double t_jerk;  // Duration of each jerk phase, in s
+    double t_accel; // Duration of the constant acceleration phase, in s
+    double a_peak;  // Peak acceleration, in steps/s²
+    double d_accel; // Steps taken to reach the cruising speed
+};
+
+/**
+ * @brief Compute the acceleration half of an S-curve reaching a given speed.
+ *
+ * @param[in] v Cruising speed, in steps/s.
+ * @param[in] a Maximum acceleration, in steps/s².
+ * @param[in] j Maximum jerk, in steps/s³.
+ * @param[out] shape Timing of the ramp.
+ */
+static void scurve_compute_shape(double v, double a, double j, struct scurve_shape* shape)
+{
+    if(v * j >= a * a){
+        // Acceleration saturates: jerk up, constant acceleration, jerk down
+        shape->t_jerk = a / j;
+        shape->t_accel = v / a - shape->t_jerk;
+        shape->a_peak = a;
+    } else{
+        // Cruising speed is reached before the acceleration saturates
+        shape->t_jerk = sqrt(v / j);
+        shape->t_accel = 0.0;
+        shape->a_peak = j * shape->t_jerk;
+    }
+
+    // Ramp is symmetric around half the cruising speed
+    shape->d_accel = v * (2.0 * shape->t_jerk + shape->t_accel) / 2.0;
+}
+
+/**
+ * @brief Initialize the S-curve part of a profile.
+ *
+ * Phase boundaries are computed here in closed form, so advancing the profile only
+ * integrates the motion over a single step.
+ *
+ * @param[in,out] profile Profile to initialize. Steps and cruising period must be already set.
+ * @param[in] a Maximum acceleration, in steps/s².
+ * @param[in] j Maximum jerk, in steps/s³.
+ */
+static void scurve_init(Profile* profile, double a, double j)
+{
+    struct scurve_shape shape;
+    double v = (double)NANO_IN_SECOND / profile->c_min;
+
+    scurve_compute_shape(v, a, j, &shape);
+
+    // If both ramps don't fit in the move, lower the cruising speed until they do
+    if(2.0 * shape.d_accel > profile->steps){
+        double v_low = 0.0, v_high = v;
+        for(int i = 0; i < SCURVE_BISECTION_ITERATIONS; i++){
+            v = (v_low + v_high) / 2.0;
+            scurve_compute_shape(v, a, j, &shape);
+            if(2.0 * shape.d_accel > profile->steps)
+                v_high = v;
+            else
+                v_low = v;
+        }
+        v = v_low;
+        scurve_compute_shape(v, a, j, &shape);
+        profile->c_min = (double)NANO_IN_SECOND / v;
+    }
+
+    double p_jerk = j * shape.t_jerk * shape.t_jerk * shape.t_jerk / 6.0;
+    double v_jerk = j * shape.t_jerk * shape.t_jerk / 2.0;
+    double p_accel = p_jerk + v_jerk * shape.t_accel + shape.a_peak * shape.t_accel * shape.t_accel / 2.0;
+
+    // Step at which each phase ends. Deceleration mirrors the acceleration.
+    unsigned int b_jerk = (unsigned int)(p_jerk + 0.5);
+    unsigned int b_accel = (unsigned int)(p_accel + 0.5);
+    unsigned int b_ramp = (unsigned int)shape.d_accel;
+    if(b_ramp > profile->steps / 2)
+        b_ramp = profile->steps / 2;
+    if(b_accel > b_ramp)
+        b_accel = b_ramp;
+    if(b_jerk > b_accel)
+        b_jerk = b_accel;
+
+    profile->bounds[SCURVE_JERK_UP] = b_jerk;
+    profile->bounds[SCURVE_ACCEL] = b_accel;
+    profile->bounds[SCURVE_JERK_DOWN] = b_ramp;
+    profile->bounds[SCURVE_CRUISE] = profile->steps - b_ramp;
+    profile->bounds[SCURVE_DECEL_UP] = profile->steps - b_accel;
+    profile->bounds[SCURVE_DECEL] = profile->steps - b_jerk;
+    profile->bounds[SCURVE_DECEL_DOWN] = profile->steps;
+
+    // Acceleration at the start of each phase. Speed is integrated across phases, so it has no jumps.
+    const double a_start[PROFILE_SCURVE_PHASES] = {0.0, shape.a_peak, shape.a_peak, 0.0, 0.0, -shape.a_peak, -shape.a_peak};
+    const double j_phase[PROFILE_SCURVE_PHASES] = {j, 0.0, -j, 0.0, -j, 0.0, j};
+    memcpy(profile->a_start, a_start, sizeof(a_start));
+    memcpy(profile->j_phase, j_phase, sizeof(j_phase));
+    profile->v_cruise = v;
+
+    // First step from standstill, in closed form. If the jerk phase is shorter than a step, the
+    // rest of the step is taken at constant acceleration.
+    double t_first;
+    if(p_jerk >= 1.0){
+        // 1 = j*t³/6
+        t_first = cbrt(6.0 / j);
+        profile->v = j * t_first * t_first / 2.0;
+        profile->a = j * t_first;
+    } else{
+        // 1 - p_jerk = v_jerk*t + a_peak*t²/2
+        double t = (sqrt(v_jerk * v_jerk + 2.0 * shape.a_peak * (1.0 - p_jerk)) - v_jerk) / shape.a_peak;
+        t_first = shape.t_jerk + t;
+        profile->v = v_jerk + shape.a_peak * t;
+        profile->a = shape.a_peak;
+    }
+
+    // Mean speed of the first step is the lowest allowed, so the integration can't stall at the end of the move
+    profile->v_min = 1.0 / t_first;
+    profile->c = (b_ramp > 0) ? t_first * NANO_IN_SECOND : profile->c_min;
+    profile->ramp_steps = b_ramp;
+    profile->decel_steps = b_ramp;
+    profile->n = SCURVE_JERK_UP;
+}
+
+/**
+ * @brief Get the period of the next step of a trapezoidal (or constant) profile.
+ *
+ * @param[in,out] profile Profile to advance.
+ * @return (double) Period of the step, in nanoseconds.
+ */
+static double trapezoidal_next_period(Profile* profile)
+{
+    double period = profile->c_min;
+    unsigned int remaining = profile->steps - profile->step;
+
+    // Peak of a triangle profile is below the cruising speed
+    if(profile->ramp_steps + profile->decel_steps + 1 >= profile->steps)
+        period = profile->c;
+
+    if(profile->step < profile->ramp_steps){
+        // Accelerating: c(n) = c(n-1) - 2c(n-1)/(4n+1)
+        period = profile->c;
+        profile->n++;
+        profile->c -= 2.0 * profile->c / (4.0 * profile->n + 1.0);
+    } else if(remaining <= profile->decel_steps){
+        // Decelerating: walk the same ramp backwards, so both ramps are symmetric
+        profile->c = profile->c * (4.0 * profile->n + 1.0) / (4.0 * profile->n - 1.0);
+        profile->n--;
+        period = profile->c;
+    }
+
+    return period;
+}
+
+/**
+ * @brief Get the period of the next step of an S-curve profile.
+ *
+ * Speed and acceleration are integrated over a single step, with the jerk of the current phase.
+ * Cost is constant for every step.
+ *
+ * @param[in,out] profile Profile to advance.
+ * @return (double) Period of the step, in nanoseconds.
+ */
+static double scurve_next_period(Profile* profile)
+{
+    // First and last steps are computed in closed form by scurve_init()
+    if(profile->ramp_steps > 0 && (profile->step == 0 || profile->step == profile->steps - 1))
+        return profile->c;
+
+    // Enter the next phase(s). Deceleration starts from the exact cruising speed.
+    while(profile->step >= profile->bounds[profile->n]){
+        profile->n++;
+        profile->a = profile->a_start[profile->n];
+        if(profile->n == SCURVE_DECEL_UP)
+            profile->v = profile->v_cruise;
+    }
+
+    if(profile->n == SCURVE_CRUISE)
+        return profile->c_min;
+
+    // Time to cover one step, from the mean of the speeds at the start and the (predicted) end of the step
+    double j = profile->j_phase[profile->n];
+    double dt = 1.0 / profile->v;
+    double v_end = profile->v + profile->a * dt + j * dt * dt / 2.0;
+    if(v_end < profile->v_min)
+        v_end = profile->v_min;
+    dt = 2.0 / (profile->v + v_end);
+
+    profile->v += profile->a * dt + j * dt * dt / 2.0;
+    profile->a += j * dt;
+    if(profile->v < profile->v_min)
+        profile->v = profile->v_min;
+
+    return dt * NANO_IN_SECOND;
+}
+
+/**
+ * @brief Get the amount of steps left at cruising speed, from the current step of a profile.
+ *
+ * @param[in] profile Profile to check.
+ * @return (unsigned int) Steps left at cruising speed. 0 if the profile is not cruising.
+ */
+static unsigned int profile_cruise_left(const Profile* profile)
+{
+    unsigned int left = 0;
+
+    if(profile->type == PROFILE_SCURVE){
+        // First step is special even if the bounds say otherwise
+        if(profile->ramp_steps > 0 && profile->step == 0)
+            left = 0;
+        else if(profile->step >= profile->bounds[SCURVE_JERK_DOWN] && profile->step < profile->bounds[SCURVE_CRUISE])
+            left = profile->bounds[SCURVE_CRUISE] - profile->step;
+    } else if(profile->step >= profile->ramp_steps && profile->steps - profile->step > profile->decel_steps){
+        left = profile->steps - profile->decel_steps - profile->step;
+    }
+
+    return left;
+}
+
+/**
+ * @brief Get the period of the next step of the profile, without rounding.
+ *
+ * @param[in,out] profile Profile to advance.
+ * @return (double) Period of the step, in nanoseconds.
+ */
+static double profile_next_period_exact(Profile* profile)
+{
+    double period = (profile->type == PROFILE_SCURVE) ? scurve_next_period(profile) : trapezoidal_next_period(profile);
+
+    profile->step++;
+
+    // Ramp approximation might slightly overshoot the cruising speed at its end
+    return (period < profile->c_min) ? profile->c_min : period;
+}
+
+/**
+ * @brief Compile a profile into a table, allowing a given error per step.
+ *
+ * Runs of steps at cruising speed become a single segment. Ramps are split greedily into the
+ * longest segments whose linear periods stay within the tolerance of the generated ones.
+ *
+ * @param[in,out] gen Profile to compile. It is advanced to its last step.
+ * @param[out] table Table to fill.
+ * @param[in] tolerance Maximum error per step, in ns.
+ * @return (int) On success, 0. If the profile doesn't fit in the table, -1.
+ */
+static int profile_compile_pass(Profile* gen, Profile_table* table, double tolerance)
+{
+    const double scale = (double)(1LL << PROFILE_FRAC_BITS);
+
+    Profile_segment* seg = NULL;
+    double p0 = 0.0, lo = 0.0, hi = 0.0;
+
+    table->count = 0;
+    table->steps = gen->steps;
+    table->fixed_steps = gen->fixed_steps;
+
+    while(gen->step < gen->steps){
+        // Cruising steps are a single constant segment. Only its first step needs to be generated.
+        unsigned int cruise = profile_cruise_left(gen);
+        if(cruise > 0){
+            if(table->count == PROFILE_SEGMENTS_MAX)
+                return -1;
+            seg = &table->segments[table->count++];
+            seg->count = cruise;
+            seg->period = llround(profile_next_period_exact(gen) * scale);
+            seg->delta = 0;
+            gen->step += cruise - 1;
+            seg = NULL; // Ramps after cruising start a new segment
+            continue;
+        }
+
+        double p = profile_next_period_exact(gen);
+
+        // Extend the current segment if a slope exists that keeps all its steps within the tolerance
+        if(seg != NULL){
+            double k = (double)seg->count;
+            double new_lo = fmax(lo, (p - tolerance - p0) / k);
+            double new_hi = fmin(hi, (p + tolerance - p0) / k);
+            if(new_lo <= new_hi){
+                lo = new_lo;
+                hi = new_hi;
+                seg->count++;
+                seg->delta = (long long)((lo + hi) / 2.0 * scale);
+                continue;
+            }
+        }
+
+        // Otherwise, start a new segment on this step
+        if(table->count == PROFILE_SEGMENTS_MAX)
+            return -1;
+        seg = &table->segments[table->count++];
+        seg->count = 1;
+        seg->period = (long long)(p * scale);
+        seg->delta = 0;
+        p0 = p;
+        lo = -INFINITY;
+        hi = INFINITY;
+    }
+
+    return 0;
+}
+
+/************* PUBLIC API *************/
+
+/**
+ * @brief Initialize a motion profile.
+ *
+ * If accel is 0, the profile degenerates to PROFILE_CONSTANT.
+ * If jerk is 0, PROFILE_SCURVE degenerates to PROFILE_TRAPEZOIDAL.
+ *
+ * @param[out] profile Profile to initialize.
+ * @param[in] type Type of the profile.
+ * @param[in] steps Amount of steps of the move.
+ * @param[in] period_ns Period at cruising speed, in nanoseconds. May be fractional.
+ * @param[in] accel Maximum acceleration, in steps/s².
+ * @param[in] jerk Maximum jerk, in steps/s³. Only used by PROFILE_SCURVE.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_init(Profile* profile, profile_type_t type, unsigned int steps, double period_ns, unsigned int accel, unsigned int jerk)
+{
+    // Special case of a move starting and ending at standstill
+    return profile_init_blended(profile, type, steps, period_ns, accel, jerk, 0.0, 0.0);
+}
+
+/**
+ * @brief Initialize a motion profile that starts and ends at given speeds.
+ *
+ * Used to join consecutive moves without stopping. Ramps start at the entry speed and end at the exit speed,
+ * which must be reachable from each other within the move. If any of them is not 0, PROFILE_SCURVE degenerates
+ * to PROFILE_TRAPEZOIDAL.
+ *
+ * @param[out] profile Profile to initialize.
+ * @param[in] type Type of the profile.
+ * @param[in] steps Amount of steps of the move.
+ * @param[in] period_ns Period at cruising speed, in nanoseconds. May be fractional.
+ * @param[in] accel Maximum acceleration, in steps/s².
+ * @param[in] jerk Maximum jerk, in steps/s³. Only used by PROFILE_SCURVE.
+ * @param[in] v_entry Speed at the start of the move, in steps/s.
+ * @param[in] v_exit Speed at the end of the move, in steps/s.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_init_blended(Profile* profile, profile_type_t type, unsigned int steps, double period_ns, unsigned int accel, unsigned int jerk, double v_entry, double v_exit)
+{
+    // Parameter validation
+    if(profile == NULL){
+        ERROR_PRINT("Profile reference is invalid.");
+        return -1;
+    } else if(!(period_ns > 0.0)){
+        ERROR_PRINT("Period is invalid.");
+        return -1;
+    } else if(v_entry < 0.0 || v_exit < 0.0){
+        ERROR_PRINT("Entry or exit speed is invalid.");
+        return -1;
+    }
+
+    memset(profile, 0, sizeof(Profile));
+
+    profile->steps = steps;
+    profile->c_min = period_ns;
+    profile->c = profile->c_min;
+    profile->type = type;
+
+    // S-curve ramps always start and end at standstill
+    if(accel == 0)
+        profile->type = PROFILE_CONSTANT;
+    else if(type == PROFILE_SCURVE && (jerk == 0 || v_entry > 0.0 || v_exit > 0.0))
+        profile->type = PROFILE_TRAPEZOIDAL;
+
+    switch(profile->type){
+        case PROFILE_CONSTANT:
+            profile->fixed_steps = steps;
+            break;
+
+        case PROFILE_TRAPEZOIDAL:{
+            // Positions along a ramp from standstill of the cruising, entry and exit speeds: v² / 2a
+            double pps = (double)NANO_IN_SECOND / profile->c_min;
+            double n_cruise = pps * pps / (2.0 * accel);
+            double n_entry = fmin(v_entry * v_entry / (2.0 * accel), n_cruise);
+            double n_exit = fmin(v_exit * v_exit / (2.0 * accel), n_cruise);
+            double n_peak = n_cruise;
+
+            // If the move is too short to reach the cruising speed, the profile becomes a triangle
+            if(2.0 * n_peak - n_entry - n_exit > steps)
+                n_peak = (steps + n_entry + n_exit) / 2.0;
+
+            unsigned int n_start = (unsigned int)n_entry;
+            unsigned int n_top = (unsigned int)n_peak;
+            unsigned int n_end = (unsigned int)n_exit;
+            profile->ramp_steps = (n_top > n_start) ? n_top - n_start : 0;
+            profile->decel_steps = (n_top > n_end) ? n_top - n_end : 0;
+            if(profile->ramp_steps > steps)
+                profile->ramp_steps = steps;
+            if(profile->ramp_steps + profile->decel_steps > steps)
+                profile->decel_steps = steps - profile->ramp_steps;
+
+            // A higher exit speed only shortens the deceleration ramp. If the cruising speed is not
+            // reached, it also lengthens the acceleration ramp.
+            profile->fixed_steps = (n_peak < n_cruise) ? profile->ramp_steps : steps - profile->decel_steps;
+
+            // Period at the start of the ramp. From standstill, the first step needs a correction. If there
+            // is no ramp at all, the motor can start at cruising speed.
+            profile->n = n_start;
+            if(n_start > 0)
+                profile->c = sqrt(2.0 / accel) * (sqrt(n_start + 1.0) - sqrt((double)n_start)) * NANO_IN_SECOND;
+            else if(profile->ramp_steps > 0)
+                profile->c = FIRST_STEP_CORRECTION * sqrt(2.0 / accel) * NANO_IN_SECOND;
+            break;
+        }
+
+        case PROFILE_SCURVE:
+            // With any exit speed, the move would become trapezoidal, so no step is fixed
+            scurve_init(profile, (double)accel, (double)jerk);
+            break;
+
+        default:
+            ERROR_PRINT("Profile type is invalid.");
+            return -1;
+    }
+
+    DEBUG_PRINT("Profile: %u steps, %u/%u ramp steps, c0=%.0f ns, c_min=%.0f ns", steps, profile->ramp_steps, profile->decel_steps, profile->c, profile->c_min);
+
+    return 0;
+}
+
+/**
+ * @brief Get the period of the next step of the profile.
+ *
+ * Must not be called more times than the amount of steps the profile was initialized with.
+ *
+ * @param[in,out] profile Profile to advance.
+ * @return (unsigned long long) Period of the step, in nanoseconds.
+ */
+unsigned long long profile_next_period(Profile* profile)
+{
+    return (unsigned long long)profile_next_period_exact(profile);
+}
+
+/**
+ * @brief Compile a motion profile into a table of segments.
+ *
+ * The profile is read from its current state, and is not modified.
+ *
+ * @param[in] profile Initialized profile.
+ * @param[out] table Table to fill. Its read position is set to the first step.
+ * @return (int) On success, 0. Otherwise, -1.
+ */
+int profile_compile(const Profile* profile, Profile_table* table)
+{
+    // Parameter validation
+    if(profile == NULL){
+        ERROR_PRINT("Profile reference is invalid.");
+        return -1;
+    } else if(table == NULL){
+        ERROR_PRINT("Table reference is invalid.");
+        return -1;
+    }
+
+    // Long ramps might need more segments than available. Trade accuracy for length until it fits.
+    double tolerance = PROFILE_TOLERANCE_NS;
+    Profile gen = *profile;
+    while(profile_compile_pass(&gen, table, tolerance) < 0){
+        tolerance *= 2.0;
+        gen = *profile;
+    }
+
+    DEBUG_PRINT("Profile compiled into %u segments (tolerance %.0f ns)", table->count, tolerance);
+
+    profile_table_rewind(table);
+
+    return 0;
+}
+
+/**
+ * @brief Set the read position of a profile table to its first step.
+ *
+ * @param[in,out] table Table to rewind.
+ */
+void profile_table_rewind(Profile_table* table)
+{
+    if(table == NULL)
+        return;
+
+    table->index = 0;
+    table->left = (table->count > 0) ? table->segments[0].count : 0;
+    table->period = (table->count > 0) ? table->segments[0].period : 0;
+    table->residue = 0;
+}
+
+/**
+ * @brief Set the read position of a profile table to a given step.
+ *
+ * Allows switching to the table of the same move compiled with a higher exit speed, as long as
+ * the step is not past the fixed steps of the table in use.
+ *
+ * @param[in,out] table Table to update.
+ * @param[in] step Index of the next step to read.
+ */
+void profile_table_seek(Profile_table* table, unsigned int step)
+{
+    unsigned int index = 0;
+
+    if(table == NULL || table->count == 0)
+        return;
+
+    while(index + 1 < table->count && step >= table->segments[index].count){
+        step -= table->segments[index].count;
+        index++;
+    }
+
+    table->index = index;
+    table->left = (step < table->segments[index].count) ? table->segments[index].count - step : 1;
+    table->period = table->segments[index].period + (long long)step * table->segments[index].delta;
+    table->residue = 0;
+}
+
+/**
+ * @brief Find the first step of a profile table that is not faster than a given period.
+ *
+ * Meant for tables whose periods never decrease, like a deceleration ramp, so a move can continue
+ * on the table from its current speed.
+ *
+ * @param[in] table Table to search.
+ * @param[in] period_ns Period of reference, in nanoseconds.
+ * @return (unsigned int) Index of the step, or the amount of steps of the table if all of them are faster.
+ */
+unsigned int profile_table_find(const Profile_table* table, unsigned long long period_ns)
+{
+    long long target = (long long)period_ns << PROFILE_FRAC_BITS;
+    unsigned int step = 0;
+
+    if(table == NULL)
+        return 0;
+
+    for(unsigned int i = 0; i < table->count; i++){
+        const Profile_segment* segment = &table->segments[i];
+        long long last = segment->period + (long long)(segment->count - 1) * segment->delta;
+
+        if(segment->period >= target)
+            return step;
+        else if(segment->delta > 0 && last >= target)
+            return step + (unsigned int)((target - segment->period + segment->delta - 1) / segment->delta);
+
+        step += segment->count;
+    }
+
+    return table->steps;
+}
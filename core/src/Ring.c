@@ -0,0 +1,32 @@
+/*
+ * Ring.c
+ *
+ * Author: Rafael Martinez
+ * Date: 16.10.2026
+ */
+
+#define NDEBUG
+
+#include "Ring.h"
+#include "debug.h"
+
+/************* PUBLIC API *************/
+
+/**
+ * @brief Initialize an empty ring.
+ *
+ * @param[out] ring Ring to initialize.
+ */
+void ring_init(Ring* ring)
+{
+    // Parameter validation
+    if(ring == NULL){
+        ERROR_PRINT("Ring reference is invalid.");
+        return;
+    }
+
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    for(unsigned int i = 0; i < RING_CAPACITY; i++)
+        ring->slots[i] = NULL;
+}
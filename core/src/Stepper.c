@@ -9,22 +9,212 @@
 
 #include "Stepper.h"
 #include "debug.h"
+#include <errno.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#if MOTOR_LIST_SIZE_MAX > PLANNER_DIMENSIONS_MAX
+#error "Planner must support as many dimensions as motors in a request"
+#endif
+
+// Queued move of a request
+struct stepper_move{
+    unsigned int motor_steps[MOTOR_LIST_SIZE_MAX];  // Steps each motor takes
+    direction_abs_t directions[MOTOR_LIST_SIZE_MAX]; // Direction of each motor. DIRECTION_INVALID keeps the current one.
+    unsigned int ticks;             // Steps of the motor with the most steps
+    profile_type_t type;
+    double period_ns;               // Period of the ticks at cruising speed. Fractional, rounded only when compiled.
+    unsigned int accel;             // Maximum acceleration of the ticks
+    unsigned int jerk;              // Maximum jerk of the ticks
+    int compiled;                   // Table matches the planned entry and exit speeds
+    Planner_block block;
+    Profile_table table;
+};
+
+// State of the move in progress of a request
+struct stepper_cursor{
+    struct stepper_move* move;
+    unsigned int left;              // Ticks left, including the current one
+    unsigned int error[MOTOR_LIST_SIZE_MAX]; // DDA accumulator of each motor
+    int mask[2 * MOTOR_LIST_SIZE_MAX];   // Rising edge of the current tick: motors that step, then the DIR levels
+    int levels[2 * MOTOR_LIST_SIZE_MAX]; // Between the steps: STEP lines low, then the DIR levels
+    int increment[MOTOR_LIST_SIZE_MAX]; // Added to the position of each motor when it steps (1 or -1)
+    unsigned long long period_ns;   // Period of the current tick
+    unsigned long long step_ns;     // Time of the rising edge of the current tick
+    unsigned int feed;              // Feed rate applied to the table, in 2^-FEED_FRAC_BITS. Approaches the one of the leader.
+    unsigned long long feed_residue; // Remainder of the last scaled period, carried to the next one
+    Profile_table* table;           // Table in use: the one of the move, or the brake table of the request
+    unsigned int limit;             // Fixed steps of the table in use
+    int closed;                     // Exit speed of the move can't be raised anymore
+    int braking;                    // Move is decelerating to a stop (see stepper_move_brake)
+};
 
 // Step request structure
+// Each motor owns one, allocated at its initialization, which is used while the motor leads a group
 struct stepper_req{
     Stepper* motor_list[MOTOR_LIST_SIZE_MAX];
     Stepper* motor_waiting;
-    GPIO_Bulk* pin_bulk;
+    GPIO_Bulk pin_bulk;     // STEP lines of the group, then their DIR lines, kept requested between moves (see stepper_reserve_group)
+    Stepper* group[MOTOR_LIST_SIZE_MAX]; // Motors whose lines are requested in pin_bulk
+    unsigned int group_count;            // Amount of motors in group. 0 if no lines are requested.
+    pthread_mutex_t mutex;  // Shared mutex of the motors of the request
     unsigned int count;
-    unsigned int req_steps;
+    unsigned int id;        // Id of the request in the traces. Changes every time the request is created.
+    Trace* trace;           // Trace of the leader when the request was created. NULL if not traced.
+    atomic_uint stop_mask;  // Bit i is set when motor i of motor_list is asked to stop
+    struct stepper_move queue[STEPPER_QUEUE_SIZE]; // Protected by the struct_mutex of the first motor
+    unsigned int head;      // Index of the move in progress, or of the next one
+    unsigned int queued;    // Amount of moves in the queue, including the one in progress
+    int running;            // Move at head is in progress
+    double v_start;         // Planned exit speed of the move in progress, and entry speed of the next one
+    Profile_table replan;   // Table of the move in progress with a higher exit speed, handed to the pulser
+    double replan_exit;     // Exit speed of the replan table
+    double v_active_exit;   // Exit speed of the table the pulser is using
+    int replan_state;       // Ownership of the replan table (see enum replan_states). Accessed atomically.
+    Profile_table brake;    // Deceleration to standstill for a decelerating stop. Written before STOP_BRAKE is set.
+    _Alignas(STEPPER_CACHE_LINE) struct stepper_cursor cursor; // Move in progress. Written by the pulser on every tick, on its own cache line.
+    unsigned long long deadline_ns; // Pulse engine only. Absolute CLOCK_MONOTONIC time of the next edge.
+    int falling;            // Pulse engine only. Next edge is the falling one.
+};
+
+// Handover of a new table for the move in progress. Its exit speed can only be raised until
+// the pulser reaches the fixed steps of the table in use, when the handover is closed.
+enum replan_states{
+    REPLAN_IDLE,    // Table is free, and can be written by the thread queueing moves
+    REPLAN_PENDING, // Table is ready for the pulser
+    REPLAN_BUSY,    // Pulser is copying the table
+    REPLAN_CLOSED   // Move in progress can't change its exit speed anymore
 };
 
-//TODO: Substitute later for calibration value
-#define HALF_PERIOD_LIMIT 100
-#define MAX_PPS 4160
+// Fixed-point feed rate override: FEED_ONE is the programmed speed
+#define FEED_FRAC_BITS 16
+#define FEED_ONE (1U << FEED_FRAC_BITS)
+
+// Bit of the stop mask of a request asking its move in progress to decelerate to a stop
+#define STOP_BRAKE (1U << 31)
+
+// Wakeup latencies measured to calibrate the spin of TIMING_HYBRID
+#define SPIN_CALIBRATION_SAMPLES 200
+// Longest spin before an edge: half the shortest period of TIMING_HYBRID
+#define SPIN_MAX_NS (NANO_IN_SECOND / STEPPER_MAX_PPS / 2)
+// Periods the pulser may fall behind its schedule before it is restarted
+#define OVERRUN_LIMIT 2
+
+// Ids of the requests created, for the traces
+static atomic_uint request_ids = 0;
+
+// Protects the reservations of STEP and DIR lines (group members of the requests, and group_req of the motors)
+static pthread_mutex_t group_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Pulse engine: a single thread that runs the requests of a set of motors, through one bulk with all
+// their STEP and DIR lines. Motors of the engine can only be grouped among themselves.
+static struct stepper_engine{
+    Task_id_t task;         // Thread of the engine. 0 if the engine is not running.
+    GPIO_Bulk bulk;         // STEP lines of the motors of the engine, then their DIR lines
+    Stepper* motors[MOTOR_LIST_SIZE_MAX];
+    unsigned int count;
+    int values[2 * MOTOR_LIST_SIZE_MAX];    // Level of each line
+    unsigned long long window_ns;       // Edges due within this time of the earliest one are fired with it
+    stepper_timing_t timing;
+    long long spin_ns;      // Time spun before every edge with TIMING_HYBRID, calibrated by the engine thread
+    Ring submitted;         // Requests submitted and not started yet. Single producer, the engine is the consumer.
+    pthread_t producer;     // Only thread commanding the motors of the engine: the one that started it
+    atomic_uint busy;       // Bit i is set while the motor at line i has a request. Set by the producer, cleared by the engine.
+    atomic_int sleeping;    // Engine is (about to be) waiting on cv, and must be signaled when a request is submitted
+    pthread_mutex_t mutex;  // Only used to sleep on cv
+    pthread_cond_t cv;      // Signals a submitted request. Uses CLOCK_MONOTONIC.
+    Stepper_req* heap[MOTOR_LIST_SIZE_MAX];     // Requests in progress. Only accessed by the engine thread.
+    unsigned int heap_count;
+} engine;
+
+/**
+ * @brief Calibrate the time spun before every edge with TIMING_HYBRID.
+ * 
+ * Must be called from the thread that will spin, once its policy and CPU are set, since the wakeup
+ * latency depends on them. The result is capped to half the shortest period of TIMING_HYBRID, so the
+ * pulser still sleeps part of every half period: a larger latency couldn't be hidden by spinning anyway.
+ * 
+ * @return (long long) Time to spin before every edge, in nanoseconds.
+ */
+static long long stepper_calibrate_spin(void)
+{
+    long long spin = Delay_calibrate_spin(SPIN_CALIBRATION_SAMPLES);
+
+    if(spin > SPIN_MAX_NS){
+        DEBUG_PRINT("Wakeup latency of %lld ns capped to %lld ns.", spin, (long long)SPIN_MAX_NS);
+        spin = SPIN_MAX_NS;
+    }
+    DEBUG_PRINT("Spin threshold: %lld ns", spin);
+
+    return spin;
+}
+
+/**
+ * @brief Get the maximum speed supported by a timing.
+ * 
+ * @param[in] timing Timing of interest.
+ * @return (unsigned int) Maximum speed, in microsteps per second.
+ */
+static inline unsigned int stepper_max_pps(stepper_timing_t timing)
+{
+    return (timing == TIMING_HYBRID) ? STEPPER_MAX_PPS : STEPPER_MAX_PPS_SLEEP;
+}
+
+/**
+ * @brief Get the current CLOCK_MONOTONIC time.
+ * 
+ * @return (unsigned long long) Current time, in nanoseconds.
+ */
+static inline unsigned long long stepper_now_ns(void)
+{
+    struct timespec t_now;
+    Time_now(&t_now);
+    return (unsigned long long)t_now.tv_sec * NANO_IN_SECOND + t_now.tv_nsec;
+}
+
+/**
+ * @brief Delay the pulser until an edge, with the timing of the motor leading the request.
+ * 
+ * @param[in] motor Motor whose thread runs the request.
+ * @param[in] deadline Absolute CLOCK_MONOTONIC time of the edge.
+ */
+static inline void stepper_delay_until(Stepper* motor, const struct timespec* deadline)
+{
+    if(motor->timing == TIMING_HYBRID)
+        Delay_until_spin(deadline, motor->spin_ns);
+    else
+        Delay_until(deadline);
+}
+
+/**
+ * @brief Record the STEP edges of the current tick of a request in its trace.
+ *
+ * @param[in] request Request with a trace.
+ * @param[in] t_ns Time of the edges.
+ * @param[in] value 1 for the rising edges, 0 for the falling ones.
+ */
+static void stepper_trace_steps(Stepper_req* request, unsigned long long t_ns, int value)
+{
+    for(unsigned int i = 0; i < request->count; i++){
+        if(request->cursor.mask[i])
+            trace_record(request->trace, t_ns, request->id, request->motor_list[i]->step_pin->pin, TRACE_STEP, value);
+    }
+}
 
-static const int low[MOTOR_LIST_SIZE_MAX] = {0, 0, 0, 0, 0, 0, 0, 0};
-static const int high[MOTOR_LIST_SIZE_MAX] = {1, 1, 1, 1, 1, 1, 1, 1};
+/**
+ * @brief Record the DIR changes at the start of a move of a request in its trace.
+ *
+ * @param[in] request Request with a trace.
+ * @param[in] changed Bit i is set if motor i of the request changed direction.
+ * @param[in] t_ns Time of the changes.
+ */
+static void stepper_trace_directions(Stepper_req* request, unsigned int changed, unsigned long long t_ns)
+{
+    for(unsigned int i = 0; i < request->count; i++){
+        if(changed & (1U << i))
+            trace_record(request->trace, t_ns, request->id, request->motor_list[i]->dir_pin->pin, TRACE_DIR, request->motor_list[i]->dir_level);
+    }
+}
 
 /**
  * @brief Assert if absolute direction parameter has a valid value.
@@ -66,205 +256,1339 @@ static inline int stepper_is_busy(Stepper* motor)
 }
 
 /**
- * @brief Allocate space for a new request and initialize it
+ * @brief Release the STEP and DIR lines reserved by a request.
  * 
- * When controlling a single motor, a bulk of lines with only one line is created
- * When controlling multiple motors, a bulk multiple lines is created
- * Said bulk is then assigned as the target for the gpio write functions
- * For each motor in the motors[] array, their current request pointer is set to the newly created request
+ * group_mutex must have been locked previously!!!
  * 
- * @param motors Array of the motors to which the request corresponds
- * @param count Amount of motors in the array
- * @param req_steps Amount of (micro)steps to take 
- * @return (Stepper_req*) Pointer to the new request if successful, NULL otherwise
+ * @param[in,out] request Request whose lines are released. Must not be in progress.
  */
-static Stepper_req* stepper_create_new_request(Stepper* motors[], unsigned int count, unsigned int req_steps)
+static void stepper_release_group(Stepper_req* request)
 {
-    // Validation not needed, because this is an internal function, and callers validate previously.
-    // motors[] contents are validated on the initialization of motor_list.
+    if(request->group_count == 0)
+        return;
 
-    Stepper_req* request = NULL;
-    GPIO_Bulk* bulk = NULL;
-    pthread_mutex_t* req_mutex = NULL; // Allocated later to allow bulk and request to be freed separately from the mutex
+    GPIO_release_bulk(&request->pin_bulk);
 
-    // Allocate enough memory for a Stepper_req and a GPIO_Bulk.
-    // Done in the same call for efficiency.
-    void* block = malloc(sizeof(Stepper_req)+sizeof(GPIO_Bulk));
-    if(block == NULL){
-        ERROR_PRINT("Failure allocating memory.");
-        goto exit;
+    for(unsigned int i = 0; i < request->group_count; i++)
+        request->group[i]->group_req = NULL;
+    request->group_count = 0;
+}
+
+/**
+ * @brief Check that the STEP and DIR lines of a group of motors are on the same GPIO controller.
+ * 
+ * The lines of a group are requested as a single bulk, and a bulk can't mix the main and AON controllers.
+ * 
+ * @param[in] motors Array of the motors of the group.
+ * @param[in] count Amount of motors in the array.
+ * @return (int) 0 if all lines share the controller, -1 otherwise.
+ */
+static int stepper_check_controller(Stepper* motors[], unsigned int count)
+{
+    unsigned int controller = GPIO_GET_CONTROLLER(motors[0]->step_pin->pin);
+
+    for(unsigned int i = 0; i < count; i++){
+        if(GPIO_GET_CONTROLLER(motors[i]->step_pin->pin) != controller || GPIO_GET_CONTROLLER(motors[i]->dir_pin->pin) != controller){
+            ERROR_PRINT("STEP and DIR lines of motor %u are not on the GPIO controller of the first STEP line of the group.", i);
+            return -1;
+        }
     }
 
-    memset(block, 0, sizeof(Stepper_req)+sizeof(GPIO_Bulk));
+    return 0;
+}
+
+/**
+ * @brief Reserve the STEP and DIR lines of a group of motors in the bulk of a request.
+ * 
+ * Requesting the lines from the driver takes a few system calls, so the lines stay requested
+ * after the request finishes, and are reused by the next request of the same group (same motors,
+ * in the same order). A line can only be requested once, so the reservations of other (idle)
+ * requests holding lines of the group are released first.
+ * A bulk can't mix the main and AON controllers, so groups with lines on both are refused.
+ * The STEP lines come first in the bulk, followed by the DIR lines in the same order. DIR lines
+ * are requested with the level they were last driven to, which is only changed when a move starts.
+ * group_mutex must have been locked previously!!!
+ * 
+ * @param[in,out] request Request to reserve the lines for.
+ * @param[in] motors Array of the motors of the group.
+ * @param[in] count Amount of motors in the array.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_reserve_group(Stepper_req* request, Stepper* motors[], unsigned int count)
+{
+    // Reuse the lines reserved by the last request of the same group
+    int same_group = (request->group_count == count);
+    for(unsigned int i = 0; i < count && same_group; i++)
+        same_group = (request->group[i] == motors[i]);
+
+    if(same_group)
+        return 0;
 
-    request = block;  // request is the base of the block
-    bulk = block + sizeof(Stepper_req);
+    if(stepper_check_controller(motors, count) < 0)
+        return -1;
 
-    // Initialize motor_list
+    stepper_release_group(request);
     for(unsigned int i = 0; i < count; i++){
-        if(motors[i] == NULL){
-            ERROR_PRINT("Motor reference at index %d is invalid.", i);
-            goto failure;
-        }
-        request->motor_list[i] = motors[i];
+        if(motors[i]->group_req != NULL)
+            stepper_release_group(motors[i]->group_req);
     }
-    request->count = count;
-    // request->motor_waiting = NULL;  // Redundant because of the memset
 
-    // Create and initialize bulk of lines
     // To control multiple motors simultaneously, all lines must be requested together
-    gpiod_line_bulk_init(bulk);
+    GPIO_Pin* pins[2 * MOTOR_LIST_SIZE_MAX];
+    int init_vals[2 * MOTOR_LIST_SIZE_MAX];
+    for(unsigned int i = 0; i < count; i++){
+        pins[i] = motors[i]->step_pin;
+        pins[count + i] = motors[i]->dir_pin;
+        init_vals[i] = 0;
+        init_vals[count + i] = motors[i]->dir_level;
+    }
+
+    if(GPIO_request_bulk(&request->pin_bulk, pins, 2 * count, GPIO_DIRECTION_OUTPUT, init_vals) < 0){
+        ERROR_PRINT("Error requesting line bulk.");
+        return -1;
+    }
+
+    for(unsigned int i = 0; i < count; i++){
+        request->group[i] = motors[i];
+        motors[i]->group_req = request;
+    }
+    request->group_count = count;
+
+    DEBUG_PRINT("Reserved the STEP and DIR lines of a group of %d motors.", count);
+
+    return 0;
+}
+
+/**
+ * @brief Reset the request of the first motor of a group for a new move, without attaching it to the motors.
+ * 
+ * @param[out] request Request to reset. Must not be in progress.
+ * @param[in] motors Array of the motors of the request. Must be valid.
+ * @param[in] count Amount of motors in the array.
+ */
+static void stepper_reset_request(Stepper_req* request, Stepper* motors[], unsigned int count)
+{
     for(unsigned int i = 0; i < count; i++)
-        gpiod_line_bulk_add(bulk, motors[i]->step_pin);
-    
-    if(gpiod_line_request_bulk_output(bulk, "PEF", low) < 0){
-        ERROR_PRINT("Error requesting line bulk\n");
-        goto failure;
-    } 
+        request->motor_list[i] = motors[i];
 
-    // Set bulk as target for the request
-    request->pin_bulk = bulk;
-    request->req_steps = req_steps;
+    // Reset the state left by the last request. The queue doesn't need to be cleared.
+    request->count = count;
+    request->id = atomic_fetch_add(&request_ids, 1) + 1;
+    request->trace = motors[0]->trace;
+    request->motor_waiting = NULL;
+    atomic_store(&request->stop_mask, 0);
+    request->cursor.period_ns = 0;
+    request->cursor.braking = 0;
+    request->cursor.feed = atomic_load(&motors[0]->feed);
+    request->cursor.feed_residue = 0;
+    request->head = 0;
+    request->queued = 0;
+    request->running = 0;
+    request->v_start = 0.0;
+}
 
-    // Create mutex to protect the request
-    req_mutex = malloc(sizeof(pthread_mutex_t));
-    if(req_mutex == NULL){
-        ERROR_PRINT("Failure allocating memory.");
-        goto failure;
+/**
+ * @brief Point the motors of a request to it, which makes them busy.
+ * 
+ * @param[in] request Request of the motors.
+ */
+static void stepper_attach_request(Stepper_req* request)
+{
+    for(unsigned int i = 0; i < request->count; i++){
+        request->motor_list[i]->req_bit = 1U << i;
+        request->motor_list[i]->current_req = request;
+        request->motor_list[i]->shared_mutex = &request->mutex;
     }
+}
 
-    if(pthread_mutex_init(req_mutex, NULL) != 0){
-        ERROR_PRINT("Failure initializing mutex.");
-        goto failure;
+/**
+ * @brief Initialize the request of the first motor of a group for a new move
+ * 
+ * No memory is allocated: the request (and its mutex) is the one owned by the first motor of the list
+ * The STEP and DIR lines of the motors are reserved in the bulk of the request, which is the target for the gpio write functions
+ * If the last request of the motor was for the same group, the lines are still reserved and are not requested again
+ * For each motor in the motors[] array, their current request pointer is set to the request
+ * The queue of moves of the request starts empty
+ * Requests of the motors of the pulse engine are created by stepper_engine_enqueue() instead
+ * 
+ * @param motors Array of the motors to which the request corresponds
+ * @param count Amount of motors in the array
+ * @return (Stepper_req*) Pointer to the request if successful, NULL otherwise
+ */
+static Stepper_req* stepper_create_new_request(Stepper* motors[], unsigned int count)
+{
+    // Validation not needed, because this is an internal function, and callers validate previously.
+    // motors[] contents are validated on the initialization of motor_list.
+
+    Stepper_req* request = motors[0]->own_req;
+
+    for(unsigned int i = 0; i < count; i++){
+        if(motors[i] == NULL){
+            ERROR_PRINT("Motor reference at index %d is invalid.", i);
+            return NULL;
+        }
     }
 
-    // Point all motors in the list to this request
-    // struct_mutex doesn't need to be locked because a new request cannot be created while there is a pending req
+    stepper_reset_request(request, motors, count);
+
+    // Reservations are only taken from idle motors, so they are checked again while no other request can start
+    pthread_mutex_lock(&group_mutex);
     for(unsigned int i = 0; i < count; i++){
-        motors[i]->current_req = request;
-        motors[i]->shared_mutex = req_mutex;
+        if(stepper_is_busy(motors[i])){
+            ERROR_PRINT("A motor in the list is busy, try again later.");
+            request = NULL;
+            goto exit;
+        }
     }
 
-    goto exit;
+    // Motors of the pulse engine are stepped through the bulk of the engine, and their requests are
+    // created by stepper_engine_enqueue(), so they can't be grouped with these motors
+    for(unsigned int i = 0; i < count; i++){
+        if(motors[i]->engine_line >= 0){
+            ERROR_PRINT("Motors of the pulse engine can't be grouped with other motors.");
+            request = NULL;
+            goto exit;
+        }
+    }
+
+    if(stepper_reserve_group(request, motors, count) < 0){
+        ERROR_PRINT("Error reserving the STEP and DIR lines.");
+        request = NULL;
+        goto exit;
+    }
+
+    // Point all motors in the list to this request
+    // struct_mutex doesn't need to be locked because a new request cannot be created while there is a pending req
+    stepper_attach_request(request);
 
-failure:
-    gpiod_line_release_bulk(bulk);
-    free(block);
-    free(req_mutex);
-    request = NULL;
 exit:
+    pthread_mutex_unlock(&group_mutex);
     return request;
 }
 
 /**
- * @brief Delete a stepper request.
+ * @brief Finish a stepper request.
  * 
  * Shared mutex must have been locked previously!!!
  * For each motor in the motor_list of the request, the current request pointer and mutex pointer are reset to NULL
- * Mutex must still be freed after this call
+ * The request is not freed, and can be used again by its owner. Its STEP and DIR lines stay reserved.
  * 
- * @param[in] request Pointer to the request to free.
+ * @param[in] request Pointer to the request to finish.
  */
 static void stepper_destroy_request(Stepper_req* request)
 {
-    // Release the pin bulk
-    gpiod_line_release_bulk(request->pin_bulk);
+    // Remove reference to this request from all motors in the motor_list
+    for(unsigned int i = 0; i < request->count; i++){
+        request->motor_list[i]->current_req = NULL;
+        request->motor_list[i]->shared_mutex = NULL;
+    }
+}
+
+/**
+ * @brief Compile the profile of a queued move, with its planned entry and exit speeds.
+ * 
+ * @param[in,out] move Move to compile.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_compile_move(struct stepper_move* move)
+{
+    Profile profile;
+    double v_entry = move->block.v_entry * move->block.ratio;
+    double v_exit = move->block.v_exit * move->block.ratio;
+
+    if(profile_init_blended(&profile, move->type, move->ticks, move->period_ns, move->accel, move->jerk, v_entry, v_exit) < 0){
+        ERROR_PRINT("Error initializing the motion profile.");
+        return -1;
+    }
+
+    if(profile_compile(&profile, &move->table) < 0){
+        ERROR_PRINT("Error compiling the motion profile.");
+        return -1;
+    }
+
+    move->compiled = 1;
+
+    return 0;
+}
+
+/**
+ * @brief Compile the brake table of a request, from the current speed of its move in progress to standstill.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * Brakes at the maximum acceleration of the move. With an entry speed, S-curve profiles are
+ * trapezoidal anyway (see profile_init_blended()), so the brake is always trapezoidal.
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ * @return (int) 0 on success, negative value if the move can't be ramped down.
+ */
+static int stepper_compile_brake(Stepper_req* request)
+{
+    struct stepper_move* move = &request->queue[request->head];
+    unsigned long long period_ns = __atomic_load_n(&request->cursor.period_ns, __ATOMIC_RELAXED);
+    Profile profile;
+
+    // Moves without acceleration limit stop abruptly anyway, and a move that hasn't ticked is at standstill
+    if(!request->running || move->accel == 0 || period_ns == 0)
+        return -1;
+
+    // Steps to decelerate from the current speed: v² / 2a
+    double pps = (double)NANO_IN_SECOND / period_ns;
+    unsigned int steps = (unsigned int)ceil(pps * pps / (2.0 * move->accel));
+    if(steps == 0)
+        steps = 1;
+
+    if(profile_init_blended(&profile, PROFILE_TRAPEZOIDAL, steps, period_ns, move->accel, 0, pps, 0.0) < 0)
+        return -1;
+
+    return profile_compile(&profile, &request->brake);
+}
+
+/**
+ * @brief Hand a table with a higher exit speed for the move in progress to the pulser.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ * @param[in] move Move in progress.
+ * @param[in] v_exit New exit speed, in steps/s along the path of the move.
+ * @return (int) 0 if the pulser will use the new table, negative value if it is too late.
+ */
+static int stepper_replan_running(Stepper_req* request, struct stepper_move* move, double v_exit)
+{
+    Profile profile;
+    int state = REPLAN_IDLE;
+
+    // Take ownership of the replan table. A table the pulser hasn't taken yet is replaced.
+    while(1){
+        state = __atomic_load_n(&request->replan_state, __ATOMIC_ACQUIRE);
+        if(state == REPLAN_CLOSED)
+            return -1;
+        else if(state == REPLAN_BUSY)
+            continue;
+        else if(state == REPLAN_PENDING && !__atomic_compare_exchange_n(&request->replan_state, &state, REPLAN_IDLE, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+            continue;
+        break;
+    }
+
+    if(profile_init_blended(&profile, move->type, move->ticks, move->period_ns, move->accel, move->jerk,
+                            move->block.v_entry * move->block.ratio, v_exit * move->block.ratio) < 0)
+        return -1;
+
+    if(profile_compile(&profile, &request->replan) < 0)
+        return -1;
+
+    request->replan_exit = v_exit;
+
+    // Fails if the pulser closed the handover meanwhile
+    state = REPLAN_IDLE;
+    if(!__atomic_compare_exchange_n(&request->replan_state, &state, REPLAN_PENDING, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return -1;
+
+    return 0;
+}
+
+/**
+ * @brief Plan the entry and exit speeds of the moves of a request.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * Only moves that haven't started, and whose speeds changed, are compiled again. The move in
+ * progress may only raise its exit speed, if it hasn't started decelerating.
+ * 
+ * @param[in,out] request Request to plan.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_plan_request(Stepper_req* request)
+{
+    Planner_block* blocks[STEPPER_QUEUE_SIZE];
+    double v_entry[STEPPER_QUEUE_SIZE], v_exit[STEPPER_QUEUE_SIZE];
+    unsigned int count = request->queued;
+    unsigned int first = request->running ? 1 : 0;
+
+    for(unsigned int i = 0; i < count; i++){
+        blocks[i] = &request->queue[(request->head + i) % STEPPER_QUEUE_SIZE].block;
+        v_entry[i] = blocks[i]->v_entry;
+        v_exit[i] = blocks[i]->v_exit;
+    }
+
+    // Move in progress keeps its entry speed
+    planner_recalculate(blocks, count, request->running ? blocks[0]->v_entry : 0.0);
+
+    if(request->running){
+        struct stepper_move* current = &request->queue[request->head];
+        if(current->block.v_exit > request->v_start){
+            if(stepper_replan_running(request, current, current->block.v_exit) == 0)
+                request->v_start = current->block.v_exit;
+            else
+                request->v_start = request->v_active_exit;
+        }
+
+        // Moves after it start from the exit speed it will actually have
+        current->block.v_exit = request->v_start;
+        planner_recalculate(&blocks[1], count - 1, request->v_start);
+    }
+
+    for(unsigned int i = first; i < count; i++){
+        struct stepper_move* move = &request->queue[(request->head + i) % STEPPER_QUEUE_SIZE];
+        if(move->compiled && blocks[i]->v_entry == v_entry[i] && blocks[i]->v_exit == v_exit[i])
+            continue;
+
+        if(stepper_compile_move(move) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Add a move at the end of the queue of a request, and plan the queue again.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * The move is joined with the last one in the queue, if any.
+ * 
+ * @param[in,out] request Request to update.
+ * @param[in] steps Array with the signed amount of steps each motor of the request takes.
+ *                  Positive steps are taken in the positive direction of the motor.
+ * @param[in] period_ns Period of the ticks of the move at cruising speed, in ns. May be fractional.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_push_move(Stepper_req* request, const int steps[], double period_ns)
+{
+    if(request->queued == STEPPER_QUEUE_SIZE){
+        ERROR_PRINT("Move queue is full, try again later.");
+        return -1;
+    }
+
+    struct stepper_move* prev = (request->queued > 0) ? &request->queue[(request->head + request->queued - 1) % STEPPER_QUEUE_SIZE] : NULL;
+    struct stepper_move* move = &request->queue[(request->head + request->queued) % STEPPER_QUEUE_SIZE];
+    Stepper** motors = request->motor_list;
+
+    memset(move, 0, sizeof(struct stepper_move));
+
+    // Motors in a request step together, so the move is ramped only if all of them have an acceleration
+    // (and jerk) limit, and then limited by the slowest one. Profile type is the one of the first motor.
+    move->accel = motors[0]->max_accel;
+    move->jerk = motors[0]->max_jerk;
+    for(unsigned int i = 0; i < request->count; i++){
+        move->motor_steps[i] = (steps[i] < 0) ? -steps[i] : steps[i];
+        move->ticks = (move->motor_steps[i] > move->ticks) ? move->motor_steps[i] : move->ticks;
+        if(steps[i] == 0)
+            move->directions[i] = DIRECTION_INVALID;
+        else
+            move->directions[i] = (steps[i] > 0) ? motors[i]->pos_direction : !motors[i]->pos_direction;
+        move->accel = (motors[i]->max_accel < move->accel) ? motors[i]->max_accel : move->accel;
+        move->jerk = (motors[i]->max_jerk < move->jerk) ? motors[i]->max_jerk : move->jerk;
+    }
+    move->type = motors[0]->profile;
+    move->period_ns = period_ns;
+
+    if(planner_block_init(&move->block, steps, request->count, NANO_IN_SECOND / period_ns, (double)move->accel) < 0){
+        ERROR_PRINT("Error initializing the planner block.");
+        return -1;
+    }
+
+    // Moves without acceleration limit can't be joined, since they start and stop abruptly
+    if(move->accel > 0 && prev != NULL && prev->accel > 0)
+        planner_junction(&prev->block, &move->block, STEPPER_JUNCTION_DEVIATION);
+
+    request->queued++;
+
+    if(stepper_plan_request(request) < 0){
+        request->queued--;
+        // Moves before this one must be planned again to stop at the end of the queue
+        stepper_plan_request(request);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Hand a new request to the pulse engine.
+ * 
+ * The request is pushed to the lock-free ring of the engine, which is only signaled if it is sleeping.
+ * 
+ * @param[in] request Request to run.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_engine_submit(Stepper_req* request)
+{
+    // The virtual clock can't advance until the engine starts the request
+    Time_virtual_hold();
+
+    // Can't be full: there are less requests than motors in the engine
+    if(ring_push(&engine.submitted, request) < 0){
+        ERROR_PRINT("Pulse engine ring is full.");
+        Time_virtual_release();
+        return -1;
+    }
+    Time_virtual_notify();
+
+    // Ordered after the push, so either the engine sees the request, or we see it sleeping
+    atomic_thread_fence(memory_order_seq_cst);
+    if(atomic_load(&engine.sleeping)){
+        pthread_mutex_lock(&engine.mutex);
+        pthread_cond_signal(&engine.cv);
+        pthread_mutex_unlock(&engine.mutex);
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Start a new request with a move on an idle group of motors of the pulse engine.
+ * 
+ * Only the producer thread of the engine creates requests for its motors, and the engine doesn't touch
+ * the requests of idle motors, so the request is filled and handed to the engine without locking.
+ * 
+ * @param[in] motors Array of pointers to the motors to move. All in the engine, and idle.
+ * @param[in] steps Array with the signed amount of steps each motor takes.
+ * @param[in] period_ns Period of the ticks of the move at cruising speed, in ns. May be fractional.
+ * @param[in] count Amount of motors in the arrays.
+ * @param[in] lines Mask of the lines of the motors in the engine.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_engine_enqueue(Stepper* motors[], const int steps[], double period_ns, unsigned int count, unsigned int lines)
+{
+    Stepper_req* request = motors[0]->own_req;
+
+    stepper_reset_request(request, motors, count);
+    if(stepper_push_move(request, steps, period_ns) < 0){
+        ERROR_PRINT("Error queueing the move.");
+        return -1;
+    }
+
+    stepper_attach_request(request);
+    atomic_fetch_or_explicit(&engine.busy, lines, memory_order_relaxed);
+
+    if(stepper_engine_submit(request) < 0){
+        stepper_destroy_request(request);
+        atomic_fetch_and_explicit(&engine.busy, ~lines, memory_order_relaxed);
+        return -1;
+    }
+
+    return 0;
+}
+
+/**
+ * @brief Queue a move on a group of motors, creating a new request if the group is idle.
+ * 
+ * @param[in] motors Array of pointers to the motors to move.
+ * @param[in] steps Array with the signed amount of steps each motor takes.
+ * @param[in] period_ns Period of the ticks of the move at cruising speed, in ns. May be fractional.
+ * @param[in] count Amount of motors in the arrays.
+ * @param[in] append If 0, the move is refused unless the group is idle.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+static int stepper_enqueue(Stepper* motors[], const int steps[], double period_ns, unsigned int count, int append)
+{
+    int retval = -1;
+    int new_request = 0;
+    Stepper* leader = motors[0];
+    unsigned int lines = 0;
+
+    // Motors of the pulse engine are commanded from a single thread, since the ring of the engine has a
+    // single producer. Idle groups are started without locking.
+    if(leader->engine_line >= 0){
+        if(!pthread_equal(pthread_self(), engine.producer)){
+            ERROR_PRINT("Motors of the pulse engine can only be commanded from the thread that started it.");
+            return -1;
+        }
+
+        for(unsigned int i = 0; i < count; i++){
+            if(motors[i] == NULL){
+                ERROR_PRINT("Motor reference at index %d is invalid.", i);
+                return -1;
+            } else if(motors[i]->engine_line < 0){
+                ERROR_PRINT("Motors of the pulse engine can't be grouped with other motors.");
+                return -1;
+            }
+            lines |= 1U << motors[i]->engine_line;
+        }
+
+        // Acquires the last writes of the engine to the requests of the motors
+        if((atomic_load_explicit(&engine.busy, memory_order_acquire) & lines) == 0)
+            return stepper_engine_enqueue(motors, steps, period_ns, count, lines);
+    }
+
+    pthread_mutex_lock(&leader->struct_mutex);
+
+    Stepper_req* request = leader->current_req;
+    if(request == NULL && leader->engine_line >= 0){
+        // The request of the leader finished after the check. Its lines were cleared before struct_mutex was
+        // unlocked, so the lines still set belong to other requests.
+        pthread_mutex_unlock(&leader->struct_mutex);
+        if((atomic_load_explicit(&engine.busy, memory_order_acquire) & lines) != 0){
+            ERROR_PRINT("A motor in the list is busy, try again later.");
+            return -1;
+        }
+        return stepper_engine_enqueue(motors, steps, period_ns, count, lines);
+    } else if(request == NULL){
+        // A new request can only be created if no motor of the group is part of another one
+        for(unsigned int i = 0; i < count; i++){
+            if(motors[i] == NULL){
+                ERROR_PRINT("Motor reference at index %d is invalid.", i);
+                goto exit;
+            } else if(stepper_is_busy(motors[i])){
+                ERROR_PRINT("A motor in the list is busy, try again later.");
+                goto exit;
+            }
+        }
+
+        request = stepper_create_new_request(motors, count);
+        if(request == NULL){
+            ERROR_PRINT("Error creating the new request.");
+            goto exit;
+        }
+        new_request = 1;
+    } else{
+        // Moves can only be appended to a request of the same group of motors, in the same order
+        int same_group = append && (request->count == count);
+        for(unsigned int i = 0; i < count && same_group; i++)
+            same_group = (request->motor_list[i] == motors[i]);
+
+        if(!same_group){
+            ERROR_PRINT("Motor is still completing last request, try again later.");
+            goto exit;
+        } else if(atomic_load(&request->stop_mask) != 0){
+            ERROR_PRINT("Motor is stopping, try again later.");
+            goto exit;
+        }
+    }
+
+    if(stepper_push_move(request, steps, period_ns) < 0){
+        ERROR_PRINT("Error queueing the move.");
+        if(new_request)
+            stepper_destroy_request(request);
+        goto exit;
+    }
+
+    // Signal the first motor in the motors array
+    if(new_request){
+        // The virtual clock can't advance until the pulser runs the request
+        Time_virtual_hold();
+        leader->req_available = 1;
+        pthread_cond_signal(&leader->req_cv);
+    }
+
+    retval = 0;
+
+exit:
+    pthread_mutex_unlock(&leader->struct_mutex);
+    return retval;
+}
+
+#ifndef NDEBUG
+/**
+ * @brief (DEBUG FUNCTION) Print the contents of a stepper object
+ * 
+ * @param[in] motor Pointer to the stepper object to print
+ */
+static void stepper_print(Stepper* motor)
+{
+    DEBUG_PRINT("Dir Pin: %p", motor->dir_pin);
+    DEBUG_PRINT("Step Pin: %p", motor->step_pin);
+    DEBUG_PRINT("Positive dir: %d", motor->pos_direction);
+    DEBUG_PRINT("Current dir: %d", motor->curr_direction);
+    DEBUG_PRINT("Period: %.3f ns", motor->period_ns);
+    DEBUG_PRINT("Max accel: %d", motor->max_accel);
+    DEBUG_PRINT("Max jerk: %d", motor->max_jerk);
+    DEBUG_PRINT("Profile: %d", motor->profile);
+    DEBUG_PRINT("MS/rot: %d", motor->microsteps_per_rotation);
+    DEBUG_PRINT("Steps: %lld", atomic_load(&motor->steps));
+    DEBUG_PRINT("Request bit: %d", motor->req_bit);
+    DEBUG_PRINT("Overruns: %d", motor->overruns);
+    DEBUG_PRINT("Name: %s\n", motor->name);
+}
+#endif
+
+/**
+ * @brief Start running a queued move of a request.
+ * 
+ * The DIR levels of the motors are set in the values written on every edge of the move. The caller
+ * writes the DIR lines that change before the first step, and holds them for STEPPER_DIR_SETUP_NS.
+ * 
+ * @param[in,out] request Request whose move starts.
+ * @param[in] move Move to run.
+ * @return (unsigned int) Mask of the motors whose DIR line changes. Bit i is motor i of the request.
+ */
+static unsigned int stepper_move_start(Stepper_req* request, struct stepper_move* move)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+    unsigned int changed = 0;
+
+    // Motors change direction only between moves, which are joined at standstill when they reverse.
+    // Directions set while the motor was idle are also driven here.
+    for(unsigned int i = 0; i < request->count; i++){
+        Stepper* node = request->motor_list[i];
+        if(move->directions[i] != DIRECTION_INVALID)
+            node->curr_direction = move->directions[i];
+        if(node->curr_direction != node->dir_level){
+            node->dir_level = node->curr_direction;
+            changed |= 1U << i;
+        }
+        cursor->levels[i] = 0;
+        cursor->mask[request->count + i] = node->dir_level;
+        cursor->levels[request->count + i] = node->dir_level;
+        cursor->increment[i] = (node->curr_direction == node->pos_direction) ? 1 : -1;
+    }
+
+    cursor->move = move;
+    cursor->table = &move->table;
+    cursor->left = move->ticks;
+    cursor->limit = move->table.fixed_steps;
+    cursor->closed = 0;
+
+    // Starting at half a tick centers the steps of the slower motors along the move
+    for(unsigned int i = 0; i < request->count; i++)
+        cursor->error[i] = move->ticks / 2;
+
+    return changed;
+}
+
+/**
+ * @brief Apply the feed rate override of the leader of a request to the period of a tick.
+ * 
+ * The feed rate of the request approaches the one of its leader by at most the change of speed
+ * the acceleration of the move allows in a tick: a·dt / v, or a·T·T_table / 10^18 with periods
+ * in ns. Integer only, and a single division per tick once the rate is reached.
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ * @param[in] period_ns Period of the tick from the table, in ns.
+ * @return (unsigned long long) Period of the tick at the current feed rate, in ns.
+ */
+static inline unsigned long long stepper_feed_period(Stepper_req* request, unsigned long long period_ns)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+    unsigned int target = atomic_load_explicit(&request->motor_list[0]->feed, memory_order_relaxed);
+
+    if(cursor->feed != target){
+        unsigned long long accel = cursor->move->accel;
+        unsigned long long current_ns = (period_ns << FEED_FRAC_BITS) / cursor->feed;
+        // (a·T / 10^3) · (T_table / 10^3) · 2^16 / 10^12, split to stay within 64 bits
+        unsigned long long change = (accel * current_ns / 1000) * (period_ns / 1000) / 15258789ULL;
+        if(change == 0)
+            change = 1;
+
+        if(accel == 0 || change >= (unsigned long long)abs((int)target - (int)cursor->feed))
+            cursor->feed = target;
+        else if(target > cursor->feed)
+            cursor->feed += change;
+        else
+            cursor->feed -= change;
+    }
+
+    if(cursor->feed == FEED_ONE)
+        return period_ns;
+
+    // Remainder of the division is carried to the next tick, like the fraction of the table
+    unsigned long long scaled = (period_ns << FEED_FRAC_BITS) + cursor->feed_residue;
+    cursor->feed_residue = scaled % cursor->feed;
+    return scaled / cursor->feed;
+}
+
+/**
+ * @brief Compute the next tick of the move in progress of a request.
+ * 
+ * Every tick of the move, a DDA (Bresenham) decides which motors take a step, so motors with
+ * different amounts of steps finish together. The period of the tick and the motors that step
+ * on it are left in the cursor of the request.
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ */
+static void stepper_move_tick(Stepper_req* request)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+    struct stepper_move* move = cursor->move;
+    Profile_table* table = cursor->table;
+    unsigned int ticks = move->ticks;
+
+    // Moves queued after this one started may raise its exit speed, until it reaches its fixed steps
+    if(!cursor->closed){
+        unsigned int step = ticks - cursor->left;
+        do{
+            int state = __atomic_load_n(&request->replan_state, __ATOMIC_ACQUIRE);
+            if(state == REPLAN_PENDING){
+                if(__atomic_compare_exchange_n(&request->replan_state, &state, REPLAN_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+                    memcpy(table, &request->replan, sizeof(Profile_table));
+                    profile_table_seek(table, step);
+                    cursor->limit = table->fixed_steps;
+                    request->v_active_exit = request->replan_exit;
+                    __atomic_store_n(&request->replan_state, REPLAN_IDLE, __ATOMIC_RELEASE);
+                }
+            } else if(step >= cursor->limit){
+                cursor->closed = __atomic_compare_exchange_n(&request->replan_state, &state, REPLAN_CLOSED, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+            }
+        } while(step >= cursor->limit && !cursor->closed); // A table arriving at the limit must still be taken
+    }
+
+    cursor->period_ns = profile_table_next(table);
+    if(!cursor->braking)
+        cursor->period_ns = stepper_feed_period(request, cursor->period_ns);
+
+    // Select the motors that step on this tick
+    for(unsigned int i = 0; i < request->count; i++){
+        cursor->error[i] += move->motor_steps[i];
+        cursor->mask[i] = (cursor->error[i] >= ticks);
+        if(cursor->mask[i])
+            cursor->error[i] -= ticks;
+    }
+}
+
+/**
+ * @brief Publish the position of a motor after a step.
+ * 
+ * Only the thread running the request of the motor writes its position, so the seqlock needs no
+ * lock for writers. Readers retry if the sequence changed while they read (see stepper_get_position).
+ * 
+ * @param[in,out] motor Motor that stepped.
+ * @param[in] delta Step taken: 1 in the positive direction, -1 in the opposite one.
+ * @param[in] step_ns Time of the step, in nanoseconds.
+ */
+static inline void stepper_publish_position(Stepper* motor, long long delta, unsigned long long step_ns)
+{
+    unsigned int seq = atomic_load_explicit(&motor->position_seq, memory_order_relaxed);
+    long long steps = atomic_load_explicit(&motor->steps, memory_order_relaxed);
+
+    atomic_store_explicit(&motor->position_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&motor->steps, steps + delta, memory_order_relaxed);
+    atomic_store_explicit(&motor->step_ns, step_ns, memory_order_relaxed);
+    atomic_store_explicit(&motor->position_seq, seq + 2, memory_order_release);
+}
+
+/**
+ * @brief Switch the move in progress of a request to the brake table, to decelerate to a stop.
+ * 
+ * The brake table starts at the speed the move had when the stop was asked, so the move continues
+ * from the first step of the table that is not faster than its current tick. The last move of the
+ * queue is kept on its own table if it stops sooner on it.
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ */
+static void stepper_move_brake(Stepper_req* request)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+    Profile_table* brake = &request->brake;
+    unsigned int step = profile_table_find(brake, cursor->period_ns);
+    unsigned int left = brake->steps - step;
+
+    // Exit speed can't change anymore
+    cursor->braking = 1;
+    cursor->closed = 1;
+
+    if(request->v_active_exit == 0.0 && cursor->left - 1 <= left)
+        return;
+
+    profile_table_seek(brake, step);
+    cursor->table = brake;
+    cursor->left = left + 1; // Includes the tick just taken
+}
+
+/**
+ * @brief Count the steps of the last tick of the move in progress of a request.
+ * 
+ * The increment of every motor is fixed when its move starts, and stop requests are gathered
+ * in a single mask, so a tick only adds the increments of the motors that stepped.
+ * A decelerating stop switches the move to the brake table, and is reported when the move ends.
+ * 
+ * @param[in,out] request Request whose move is in progress.
+ * @return (int) 1 if a motor of the request was asked to stop immediately, 0 otherwise.
+ */
+static int stepper_move_account(Stepper_req* request)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+
+    for(unsigned int i = 0; i < request->count; i++){
+        if(cursor->mask[i])
+            stepper_publish_position(request->motor_list[i], cursor->increment[i], cursor->step_ns);
+    }
+
+    unsigned int stop = atomic_load_explicit(&request->stop_mask, memory_order_relaxed);
+    if((stop & STOP_BRAKE) && !request->cursor.braking){
+        // Brake table was written before the bit was set
+        atomic_thread_fence(memory_order_acquire);
+        stepper_move_brake(request);
+    }
+
+    return (stop & ~STOP_BRAKE) != 0;
+}
+
+/**
+ * @brief Run a queued move of a request.
+ * 
+ * All the motors that step on a tick are pulsed with a single bulk write, which also keeps the DIR lines.
+ * Edges are scheduled against absolute deadlines measured from the start of the request, so
+ * GPIO write time and wakeup latency are not added to the period of every step, and consecutive
+ * moves follow each other without a gap.
+ * 
+ * @param[in] motor Motor whose thread runs the request.
+ * @param[in] move Move to run.
+ * @param[in,out] t_start Start of the schedule.
+ * @param[in,out] elapsed_ns Time elapsed since the start of the schedule until the last edge.
+ * @return (int) 1 if the request was stopped, 0 otherwise.
+ */
+static int stepper_run_move(Stepper* motor, struct stepper_move* move, struct timespec* t_start, unsigned long long* elapsed_ns)
+{
+    Stepper_req* request = motor->current_req;
+    struct stepper_cursor* cursor = &request->cursor;
+    struct timespec t_deadline, t_now;
+    int stop = 0;
+
+    // Every DIR line that changes is written at once, and held for the setup time of the driver before the first step
+    unsigned int changed = stepper_move_start(request, move);
+    if(changed){
+        GPIO_write_bulk(&request->pin_bulk, cursor->levels);
+        unsigned long long dir_ns = stepper_now_ns();
+        if(request->trace != NULL)
+            stepper_trace_directions(request, changed, dir_ns);
+        dir_ns += STEPPER_DIR_SETUP_NS;
+        struct timespec t_setup = {.tv_sec = dir_ns / NANO_IN_SECOND, .tv_nsec = dir_ns % NANO_IN_SECOND};
+        Delay_until_spin(&t_setup, STEPPER_DIR_SETUP_NS);
+    }
+
+    do{
+        stepper_move_tick(request);
+        unsigned long long period_ns = cursor->period_ns;
+
+        // Pulse the pins
+        GPIO_write_bulk(&request->pin_bulk, cursor->mask);
+        cursor->step_ns = stepper_now_ns();
+        if(request->trace != NULL)
+            stepper_trace_steps(request, cursor->step_ns, 1);
+        *elapsed_ns += period_ns / 2;
+        add_time_ns(t_start, *elapsed_ns, &t_deadline);
+        stepper_delay_until(motor, &t_deadline);
+
+        GPIO_write_bulk(&request->pin_bulk, cursor->levels);
+        if(request->trace != NULL)
+            stepper_trace_steps(request, stepper_now_ns(), 0);
+        *elapsed_ns += period_ns - period_ns / 2;
+        add_time_ns(t_start, *elapsed_ns, &t_deadline);
+        stepper_delay_until(motor, &t_deadline);
+
+        // Small delays are caught up by the following (shorter) periods. If the pulser fell
+        // behind by more than OVERRUN_LIMIT periods, catching up would mean a burst of steps
+        // the motor can't follow, so the schedule is restarted from the current time instead.
+        Time_now(&t_now);
+        if(diff_time_ns(&t_now, &t_deadline) > (long long)(OVERRUN_LIMIT * period_ns)){
+            motor->overruns++;
+            *t_start = t_now;
+            *elapsed_ns = 0;
+        }
+
+        stop = stepper_move_account(request);
+    } while(--cursor->left && !stop);
+
+    return stop || cursor->braking;
+}
+
+/**
+ * @brief Take the move at the head of the queue of a request to run it.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * 
+ * @param[in,out] request Request to update.
+ * @return (struct stepper_move*) Move to run, or NULL if the queue is empty.
+ */
+static struct stepper_move* stepper_take_move(Stepper_req* request)
+{
+    if(request->queued == 0)
+        return NULL;
+
+    struct stepper_move* move = &request->queue[request->head];
+    request->running = 1;
+    request->v_start = move->block.v_exit;
+    request->v_active_exit = move->block.v_exit;
+    request->replan_state = REPLAN_IDLE;
+
+    return move;
+}
+
+/**
+ * @brief Remove the move in progress from the queue of a request, after running it.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * 
+ * @param[in,out] request Request to update.
+ */
+static void stepper_drop_move(Stepper_req* request)
+{
+    request->running = 0;
+    request->head = (request->head + 1) % STEPPER_QUEUE_SIZE;
+    request->queued--;
+}
+
+/**
+ * @brief Finish a request whose moves were run, and wake up the thread waiting for it.
+ * 
+ * Struct mutex of the first motor of the request must have been locked previously!!!
+ * It is unlocked by this function. Moves left in the queue are dropped.
+ * 
+ * @param[in] leader First motor of the request.
+ * @param[in,out] request Request to finish.
+ */
+static void stepper_finish_request(Stepper* leader, Stepper_req* request)
+{
+    // Moves left in the queue are dropped if the request was stopped
+    request->queued = 0;
+
+    // struct_mutex is still locked, so no move can be queued on the request while it is finished
+    Stepper* waiting_motor = NULL;
+
+    pthread_mutex_lock(&request->mutex);
+    waiting_motor = request->motor_waiting;
+    stepper_destroy_request(request);
+    pthread_mutex_unlock(&request->mutex);
+
+    // Motors are idle now. The request can be reused once struct_mutex is unlocked, so its motor list is read before.
+    const uint64_t event = 1;
+    unsigned int lines = 0;
+    for(unsigned int i = 0; i < request->count; i++){
+        if(write(request->motor_list[i]->event_fd, &event, sizeof(event)) < 0)
+            ERROR_PRINT("Could not signal the end of the request of motor %s.", request->motor_list[i]->name);
+        lines |= (request->motor_list[i]->engine_line >= 0) ? 1U << request->motor_list[i]->engine_line : 0;
+    }
+
+    // Motors of the pulse engine can be commanded again without locking. Releases the writes to the request.
+    if(lines != 0)
+        atomic_fetch_and_explicit(&engine.busy, ~lines, memory_order_release);
+    pthread_mutex_unlock(&leader->struct_mutex);
+
+    // Tell thread waiting for the motor to stop that it is finished. It released its hold on the
+    // virtual clock to wait, so it is held again on its behalf before the pulser releases its own.
+    if(waiting_motor != NULL){
+        Time_virtual_hold();
+        pthread_cond_signal(&waiting_motor->wait_cv);
+    }
+}
+
+/**
+ * @brief Motor controlling function
+ * 
+ * For each initialized motor, a thread is created with this function as its entry point.
+ * If multiple motors are to be controlled simulatenously, only the thread for the first motor
+ * in the motor_list of the respective request is awakened. 
+ * The moves queued on the request are run back to back, until the queue is empty or a motor
+ * of the request is stopped.
+ * 
+ * @param[in] arg Pointer to the initialized Stepper object
+ */
+static void motor_pulser(void* arg)
+{
+    Stepper* motor = arg;
+
+    while(1){
+        // Wait until a step request is made
+        pthread_mutex_lock(&motor->struct_mutex);
+        while(!motor->req_available)
+            pthread_cond_wait(&motor->req_cv, &motor->struct_mutex);
+        motor->req_available = 0;
+        pthread_mutex_unlock(&motor->struct_mutex);
+
+        Stepper_req* request = motor->current_req;
+        struct stepper_move* move = NULL;
+        unsigned long long elapsed_ns = 0;
+        struct timespec t_start;
+        int stop = 0;
+
+        // Calibrated here, on the policy and CPU of this thread, before its first request with TIMING_HYBRID.
+        // Spinning has no use on the virtual clock.
+        if(motor->timing == TIMING_HYBRID && motor->spin_ns < 0 && !Time_is_virtual())
+            motor->spin_ns = stepper_calibrate_spin();
+
+        Time_now(&t_start);
+
+        // The queue is modified under the struct_mutex of this motor. While a move runs, only the
+        // moves after it may be planned again.
+        pthread_mutex_lock(&motor->struct_mutex);
+        while(!stop && (move = stepper_take_move(request)) != NULL){
+            pthread_mutex_unlock(&motor->struct_mutex);
+
+            stop = stepper_run_move(motor, move, &t_start, &elapsed_ns);
+
+            pthread_mutex_lock(&motor->struct_mutex);
+            stepper_drop_move(request);
+        }
+
+        stepper_finish_request(motor, request);
+        Time_virtual_release();
+    }
+}
+
+/**
+ * @brief Add a request to the heap of the pulse engine, ordered by the deadline of its next edge.
+ * 
+ * @param[in] request Request to add.
+ */
+static void stepper_engine_push(Stepper_req* request)
+{
+    unsigned int i = engine.heap_count++;
+
+    // Sift up
+    while(i > 0){
+        unsigned int parent = (i - 1) / 2;
+        if(engine.heap[parent]->deadline_ns <= request->deadline_ns)
+            break;
+        engine.heap[i] = engine.heap[parent];
+        i = parent;
+    }
+    engine.heap[i] = request;
+}
+
+/**
+ * @brief Remove the request with the earliest next edge from the heap of the pulse engine.
+ * 
+ * @return (Stepper_req*) Request removed.
+ */
+static Stepper_req* stepper_engine_pop(void)
+{
+    Stepper_req* top = engine.heap[0];
+    Stepper_req* last = engine.heap[--engine.heap_count];
+    unsigned int i = 0;
+
+    // Sift the last request down from the root
+    while(1){
+        unsigned int child = 2 * i + 1;
+        if(child >= engine.heap_count)
+            break;
+        if(child + 1 < engine.heap_count && engine.heap[child + 1]->deadline_ns < engine.heap[child]->deadline_ns)
+            child++;
+        if(last->deadline_ns <= engine.heap[child]->deadline_ns)
+            break;
+        engine.heap[i] = engine.heap[child];
+        i = child;
+    }
+    engine.heap[i] = last;
+
+    return top;
+}
+
+/**
+ * @brief Drive the DIR lines of the motors of a request of the pulse engine that change direction.
+ * 
+ * The lines are written with a single bulk write, and the next rising edge of the request is delayed
+ * until they are set up. The coalescing window is added, since edges are fired at most that early.
+ * 
+ * @param[in,out] request Request whose move starts.
+ * @param[in] changed Mask of the motors whose DIR line changes, as returned by stepper_move_start().
+ */
+static void stepper_engine_direction(Stepper_req* request, unsigned int changed)
+{
+    for(unsigned int i = 0; i < request->count; i++)
+        engine.values[engine.count + request->motor_list[i]->engine_line] = request->cursor.levels[request->count + i];
+
+    GPIO_write_bulk(&engine.bulk, engine.values);
+    unsigned long long dir_ns = stepper_now_ns();
+    if(request->trace != NULL)
+        stepper_trace_directions(request, changed, dir_ns);
+
+    unsigned long long setup_ns = dir_ns + STEPPER_DIR_SETUP_NS + engine.window_ns;
+    if(request->deadline_ns < setup_ns)
+        request->deadline_ns = setup_ns;
+}
+
+/**
+ * @brief Start running the first move of a request on the pulse engine.
+ * 
+ * @param[in,out] request Request to start.
+ * @param[in] now_ns Current time, in nanoseconds.
+ * @return (int) 0 if the request has a move to run, negative value if it was finished.
+ */
+static int stepper_engine_start(Stepper_req* request, unsigned long long now_ns)
+{
+    Stepper* leader = request->motor_list[0];
+
+    pthread_mutex_lock(&leader->struct_mutex);
+    struct stepper_move* move = stepper_take_move(request);
+    if(move == NULL){
+        stepper_finish_request(leader, request);
+        return -1;
+    }
+    pthread_mutex_unlock(&leader->struct_mutex);
+
+    unsigned int changed = stepper_move_start(request, move);
+    request->deadline_ns = now_ns;
+    request->falling = 0;
+    if(changed)
+        stepper_engine_direction(request, changed);
+
+    return 0;
+}
+
+/**
+ * @brief Schedule the next edge of a request on the pulse engine, after firing its current one.
+ * 
+ * After a falling edge, the steps are counted, and the next move is started when the move in
+ * progress ends.
+ * 
+ * @param[in,out] request Request whose edge was fired.
+ * @param[in] now_ns Time at which the edge was fired, in nanoseconds.
+ * @return (int) 0 if the request has another edge, negative value if it was finished.
+ */
+static int stepper_engine_advance(Stepper_req* request, unsigned long long now_ns)
+{
+    struct stepper_cursor* cursor = &request->cursor;
+    Stepper* leader = request->motor_list[0];
+    unsigned long long period_ns = cursor->period_ns;
+
+    if(!request->falling){
+        cursor->step_ns = now_ns;
+        request->deadline_ns += period_ns / 2;
+        request->falling = 1;
+        return 0;
+    }
+
+    request->deadline_ns += period_ns - period_ns / 2;
+    request->falling = 0;
+
+    // Same overrun policy as stepper_run_move()
+    if(now_ns > request->deadline_ns + OVERRUN_LIMIT * period_ns){
+        leader->overruns++;
+        request->deadline_ns = now_ns;
+    }
 
-    // Remove reference to this request from all motors in the motor_list
-    for(unsigned int i = 0; i < request->count; i++){
-        request->motor_list[i]->current_req = NULL;
-        request->motor_list[i]->shared_mutex = NULL;
+    int stop = stepper_move_account(request);
+    if(--cursor->left && !stop)
+        return 0;
+
+    // Move ended, continue with the next one in the queue, unless the request was stopped
+    stop |= cursor->braking;
+    pthread_mutex_lock(&leader->struct_mutex);
+    stepper_drop_move(request);
+    struct stepper_move* move = stop ? NULL : stepper_take_move(request);
+    if(move == NULL){
+        stepper_finish_request(leader, request);
+        return -1;
     }
+    pthread_mutex_unlock(&leader->struct_mutex);
 
-    // Free the request
-    free(request);  // request is the base of the malloc'ed block
+    unsigned int changed = stepper_move_start(request, move);
+    if(changed)
+        stepper_engine_direction(request, changed);
+
+    return 0;
 }
 
-#ifndef NDEBUG
 /**
- * @brief (DEBUG FUNCTION) Print the contents of a stepper object
+ * @brief Check if there are requests submitted to the pulse engine.
  * 
- * @param[in] motor Pointer to the stepper object to print
+ * @param[in] arg Not used.
+ * @return (int) 1 if a request was submitted, 0 otherwise.
  */
-static void stepper_print(Stepper* motor)
+static int stepper_engine_submitted(void* arg)
 {
-    DEBUG_PRINT("Dir Pin: %p", motor->dir_pin);
-    DEBUG_PRINT("Step Pin: %p", motor->step_pin);
-    DEBUG_PRINT("Positive dir: %d", motor->pos_direction);
-    DEBUG_PRINT("Current dir: %d", motor->curr_direction);
-    DEBUG_PRINT("Half period: %d", motor->half_period);
-    DEBUG_PRINT("MS/rot: %d", motor->microsteps_per_rotation);
-    DEBUG_PRINT("Steps: %d", motor->steps);
-    DEBUG_PRINT("Stop: %d", motor->stop);
-    DEBUG_PRINT("Name: %s\n", motor->name);
+    return !ring_empty(&engine.submitted);
 }
-#endif
 
 /**
- * @brief Motor controlling function
+ * @brief Sleep the pulse engine until an edge, or until a new request is submitted.
  * 
- * For each initialized motor, a thread is created with this function as its entry point.
- * If multiple motors are to be controlled simulatenously, only the thread for the first motor
- * in the motor_list of the respective request is awakened. 
+ * Requests are submitted without locking. Producers only take the mutex to signal the engine
+ * if it announced that it is going to sleep.
  * 
- * @param[in] arg Pointer to the initialized Stepper object
+ * @param[in] deadline_ns Absolute CLOCK_MONOTONIC time of the edge, in nanoseconds. If 0, there is no
+ *                        edge, and the engine sleeps until a request is submitted.
  */
-static void motor_pulser(void* arg)
+static void stepper_engine_sleep(unsigned long long deadline_ns)
 {
-    Stepper* motor = arg;
+    // On the virtual clock, the engine sleeps exactly until the edge, unless a request is submitted
+    if(deadline_ns != 0 && Time_is_virtual()){
+        struct timespec t_deadline = {.tv_sec = deadline_ns / NANO_IN_SECOND, .tv_nsec = deadline_ns % NANO_IN_SECOND};
+        Time_virtual_wait(&t_deadline, stepper_engine_submitted, NULL);
+        return;
+    }
 
-    while(1){
-        // Wait until a step request is made
-        pthread_mutex_lock(&motor->struct_mutex);
-        while(!motor->req_available)
-            pthread_cond_wait(&motor->req_cv, &motor->struct_mutex);
-        motor->req_available = 0;
-        pthread_mutex_unlock(&motor->struct_mutex);
+    long long spin = (engine.timing == TIMING_HYBRID) ? engine.spin_ns : 0;
+    unsigned long long wake_ns = deadline_ns - spin;
+    struct timespec t_wake = {.tv_sec = wake_ns / NANO_IN_SECOND, .tv_nsec = wake_ns % NANO_IN_SECOND};
+
+    // The ring is checked again after announcing the sleep, so a request submitted meanwhile is not missed
+    atomic_store(&engine.sleeping, 1);
+    pthread_mutex_lock(&engine.mutex);
+    if(deadline_ns == 0){
+        while(ring_empty(&engine.submitted))
+            pthread_cond_wait(&engine.cv, &engine.mutex);
+    } else{
+        while(ring_empty(&engine.submitted) && pthread_cond_timedwait(&engine.cv, &engine.mutex, &t_wake) != ETIMEDOUT);
+    }
+    pthread_mutex_unlock(&engine.mutex);
+    atomic_store(&engine.sleeping, 0);
 
-        // Create timespec for sleeping bewteen transitions
-        struct timespec pulse_duration;
-        microsec_to_timespec(&pulse_duration, motor->half_period);
+    // New requests are started before sleeping again
+    if(deadline_ns == 0 || !ring_empty(&engine.submitted))
+        return;
 
-        unsigned int num_motors = motor->current_req->count;
-        int stop = 0;
+    while(stepper_now_ns() < deadline_ns);
+}
 
-        do{
-            // Pulse the pin
-            GPIO_write_bulk(motor->current_req->pin_bulk, high);
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &pulse_duration, NULL);
-            GPIO_write_bulk(motor->current_req->pin_bulk, low);
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &pulse_duration, NULL);
-
-            // Update step counter for each motor in the request and check if they requested to stop
-            for(unsigned int i = 0; i < num_motors; i++){
-                Stepper* node = motor->current_req->motor_list[i];
-                if(node->curr_direction == node->pos_direction)
-                    node->steps++;
-                else
-                    node->steps--;
-                
-                stop |= node->stop;
-            }
-        } while(--motor->current_req->req_steps && !stop);
+/**
+ * @brief Pulse engine thread.
+ * 
+ * Runs the requests of all the motors of the engine. The requests are kept in a heap ordered by
+ * the deadline of their next edge. Every edge due within the coalescing window of the earliest
+ * one is fired with the same bulk write.
+ * 
+ * @param[in] arg Not used.
+ */
+static void stepper_engine_main(void* arg)
+{
+    Stepper_req* fired[MOTOR_LIST_SIZE_MAX];
+    Stepper_req* request = NULL;
+    unsigned int count = 0;
+    int holding = 0;    // Engine holds the virtual clock. Only while it has requests.
 
-        // Free the request
-        pthread_mutex_t* shr_mutex = motor->shared_mutex;
-        Stepper* waiting_motor = NULL;
+    // Calibrated on the policy and CPU of the engine thread. Submitted requests wait in the ring meanwhile.
+    if(engine.timing == TIMING_HYBRID && !Time_is_virtual())
+        engine.spin_ns = stepper_calibrate_spin();
 
-        pthread_mutex_lock(shr_mutex);
-        waiting_motor = motor->current_req->motor_waiting;
-        stepper_destroy_request(motor->current_req);
-        pthread_mutex_unlock(shr_mutex);
+    while(1){
+        // Wait for a request if there is nothing to run
+        if(engine.heap_count == 0){
+            if(holding)
+                Time_virtual_release();
+            holding = 0;
+            stepper_engine_sleep(0);
+        }
 
-        if(waiting_motor != NULL){
-            // Clear
-            waiting_motor->stop = 0;
+        // Start the submitted requests. The engine keeps a single hold of the virtual clock,
+        // out of the ones taken by the submitters.
+        unsigned long long now_ns = stepper_now_ns();
+        while((request = ring_pop(&engine.submitted)) != NULL){
+            if(holding)
+                Time_virtual_release();
+            holding = 1;
+            if(stepper_engine_start(request, now_ns) == 0)
+                stepper_engine_push(request);
+        }
 
-            // Tell thread waiting for the motor to stop that it is finished
-            pthread_cond_signal(&waiting_motor->wait_cv);
+        if(engine.heap_count == 0)
+            continue;
+
+        stepper_engine_sleep(engine.heap[0]->deadline_ns);
+        now_ns = stepper_now_ns();
+        if(engine.heap[0]->deadline_ns > now_ns + engine.window_ns)
+            continue;
+
+        // Coalesce the edges due within the window in a single write
+        count = 0;
+        while(engine.heap_count > 0 && engine.heap[0]->deadline_ns <= now_ns + engine.window_ns){
+            request = stepper_engine_pop();
+            if(!request->falling)
+                stepper_move_tick(request);
+            for(unsigned int i = 0; i < request->count; i++)
+                engine.values[request->motor_list[i]->engine_line] = request->falling ? 0 : request->cursor.mask[i];
+            fired[count++] = request;
         }
 
-        free(shr_mutex);
+        GPIO_write_bulk(&engine.bulk, engine.values);
+        now_ns = stepper_now_ns();
+
+        for(unsigned int i = 0; i < count; i++){
+            if(fired[i]->trace != NULL)
+                stepper_trace_steps(fired[i], now_ns, !fired[i]->falling);
+            if(stepper_engine_advance(fired[i], now_ns) == 0)
+                stepper_engine_push(fired[i]);
+        }
     }
 }
 
@@ -278,6 +1602,8 @@ static void motor_pulser(void* arg)
  *                      Value must be from the defined symbols in GPIO.h.
  * @param[in] dir_pin   Pin controlling the DIR input of the stepper driver.
  *                      Value must be from the defined symbols in GPIO.h 
+ *                      Must be on the same GPIO controller (main or AON) as step_pin, and as the
+ *                      lines of the motors moved along with this one.
  * @param[in] microstep Microstep configuration of the stepper driver.
  *                      Valid values are FULL, HALF, QUARTER, EIGHT, and SIXTEENTH.
  * @param[in] steps_per_rotation Amount of full steps in a single rotation of the stepper motor.
@@ -302,19 +1628,24 @@ Stepper* stepper_init(const char* name, int step_pin, int dir_pin, unsigned int
     } else if(!is_valid_direction_abs(init_dir)){
         ERROR_PRINT("Direction is invalid.");
         goto exit;
+    } else if(GPIO_GET_CONTROLLER((unsigned int)step_pin) != GPIO_GET_CONTROLLER((unsigned int)dir_pin)){
+        // Both lines are requested in the same bulk
+        ERROR_PRINT("STEP and DIR pins are not on the same GPIO controller.");
+        goto exit;
     }
 
-    // Create motor object
-    motor = malloc(sizeof(Stepper));
-    if(motor == NULL){
+    // Create motor object, aligned so its pulser block starts a cache line
+    if(posix_memalign((void**)&motor, STEPPER_CACHE_LINE, sizeof(Stepper)) != 0){
         ERROR_PRINT("Failure allocating memory.");
+        motor = NULL;
         goto exit;
     }
 
     memset(motor, 0, sizeof(Stepper));
 
     // Attempt to reclaim dir_pin
-    motor->dir_pin = GPIO_init_pin(dir_pin, GPIO_DIRECTION_OUTPUT, 0);
+    // Like step_pin, it is only requested in bulk, so a direction change is written together with the other lines of the group
+    motor->dir_pin = GPIO_init_pin(dir_pin, GPIO_DIRECTION_NONE, 0);
     if(motor->dir_pin == NULL){
         ERROR_PRINT("Could not initialize direction pin (pin %d).", GPIO_GET_LINE(dir_pin));
         goto failure;
@@ -329,23 +1660,59 @@ Stepper* stepper_init(const char* name, int step_pin, int dir_pin, unsigned int
         goto failure;
     }
 
+    // Request used while the motor leads a group. Allocated only here, so moves don't touch the heap.
+    if(posix_memalign((void**)&motor->own_req, STEPPER_CACHE_LINE, sizeof(Stepper_req)) != 0){
+        ERROR_PRINT("Failure allocating memory.");
+        motor->own_req = NULL;
+        goto failure;
+    }
+
+    memset(motor->own_req, 0, sizeof(Stepper_req));
+    pthread_mutex_init(&motor->own_req->mutex, NULL);
+
+    // Signaled when the requests of the motor finish, so they can be waited with select()
+    motor->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(motor->event_fd < 0){
+        ERROR_PRINT("Could not create the event file descriptor - %s", strerror(errno));
+        goto failure;
+    }
+
     // Initilialize the state of the motor (commented lines are redundant because of the memset)
     // motor->current_req = NULL;
+    // motor->group_req = NULL;
     // motor->shared_mutex = NULL;
     pthread_mutex_init(&motor->struct_mutex, NULL);
     pthread_cond_init(&motor->req_cv, NULL);
     pthread_cond_init(&motor->wait_cv, NULL);
     strncpy(motor->name, name, MOTOR_NAME_LEN-1);
     motor->pos_direction = init_dir;
-    stepper_set_direction_abs(motor, init_dir); 
-    // motor->half_period = 0;
+    motor->curr_direction = init_dir;
+    motor->dir_level = init_dir;
+    // motor->period_ns = 0.0;
+    // motor->max_accel = 0;
+    // motor->max_jerk = 0;
+    motor->profile = PROFILE_TRAPEZOIDAL;
+    // motor->timing = TIMING_SLEEP;
+    motor->engine_line = -1;
+    motor->spin_ns = -1;
+    atomic_init(&motor->feed, FEED_ONE);
+    // motor->trace = NULL;
     motor->microsteps_per_rotation = microstep * steps_per_rotation;
+    // motor->position_seq = 0;
     // motor->steps = 0;
-    // motor->stop = 0;
+    // motor->step_ns = 0;
+    // motor->overruns = 0;
+    // motor->req_bit = 0;
     // motor->req_available = 0;
 
-    // Create handling thread for the motor
-    if(CreateTask(name, 1024, motor_pulser, motor) == 0){
+    // Create handling thread for the motor, with real-time priority so other processes don't delay the steps
+    Task_attr attr;
+    Task_attr_init(&attr, STEPPER_TASK_STACK_SIZE);
+    attr.policy = STEPPER_TASK_POLICY;
+    attr.priority = STEPPER_TASK_PRIORITY;
+    attr.lock_stack = 1;
+
+    if(CreateTask_attr(name, &attr, motor_pulser, motor) == 0){
         ERROR_PRINT("Could not create handler thread for the motor.");
         goto failure;
     }
@@ -353,6 +1720,13 @@ Stepper* stepper_init(const char* name, int step_pin, int dir_pin, unsigned int
     goto exit;
 
 failure:
+    if(motor->event_fd > 0)
+        close(motor->event_fd);
+    if(motor->step_pin != NULL)
+        GPIO_release_pin(motor->step_pin);
+    if(motor->dir_pin != NULL)
+        GPIO_release_pin(motor->dir_pin);
+    free(motor->own_req);
     free(motor);
     motor = NULL;
 exit:
@@ -376,6 +1750,10 @@ void stepper_destroy(Stepper* motor)
         return;
     }
 
+    // Lines of the pulse engine can only be released together
+    if(motor->engine_line >= 0)
+        stepper_engine_destroy();
+
     // Stop handler thread
     stepper_stop(motor); // Stopping the current request will also call stepper_destroy_request
     Task_kill(Task_get_id_by_name(motor->name));
@@ -384,17 +1762,28 @@ void stepper_destroy(Stepper* motor)
     pthread_cond_destroy(&motor->wait_cv);
     pthread_cond_destroy(&motor->req_cv);
     pthread_mutex_destroy(&motor->struct_mutex);
-
-    // Release all reserved lines
-    gpiod_line_release(motor->step_pin);
-    gpiod_line_release(motor->dir_pin);
-
+    pthread_mutex_destroy(&motor->own_req->mutex);
+
+    // Release all reserved lines, including the group reservations holding the STEP line
+    pthread_mutex_lock(&group_mutex);
+    if(motor->group_req != NULL)
+        stepper_release_group(motor->group_req);
+    stepper_release_group(motor->own_req);
+    pthread_mutex_unlock(&group_mutex);
+    GPIO_release_pin(motor->step_pin);
+    GPIO_release_pin(motor->dir_pin);
+
+    close(motor->event_fd);
+    free(motor->own_req);
     free(motor);
 }
 
 /**
  * @brief Set the absolute turning direction of the motor.
  * 
+ * No line is written: the DIR line of the motor is changed by the pulser at the start of the next move,
+ * in the same bulk write as the DIR lines of the rest of its group, and before its first step.
+ * 
  * @param[in] motor Pointer to the motor to update.
  * @param[in] direction New direction (DIRECTION_CLOCKWISE, DIRECTION_COUNTERCLOCKWISE).
  * @return (int) 0 on success, negative value otherwise.
@@ -418,12 +1807,6 @@ int stepper_set_direction_abs(Stepper* motor, direction_abs_t direction)
         goto exit;
     }
 
-    // Try to change direction
-    if(gpiod_line_set_value(motor->dir_pin, direction) < 0){
-        ERROR_PRINT("Error setting absolute direction for motor.");
-        goto exit;
-    }
-
     //On success, update the stepper struct
     motor->curr_direction = direction;
     retval = 0;
@@ -501,10 +1884,10 @@ direction_rel_t stepper_get_direction_rel(Stepper* motor)
  * was initialized.
  * 
  * @param[in] motor Pointer to the motor to update.
- * @param[in] pps New speed, in microsteps per second.
+ * @param[in] pps New speed, in microsteps per second. May be fractional.
  * @return (int) 0 on success, negative value otherwise and errno set to specific error value.
  */
-int stepper_set_speed(Stepper* motor, unsigned int pps)
+int stepper_set_speed(Stepper* motor, double pps)
 {
     //Special case of calling set_speed_multiple with only one motor in the list
     return stepper_set_speed_multiple(&motor, pps, 1);
@@ -517,11 +1900,11 @@ int stepper_set_speed(Stepper* motor, unsigned int pps)
  * was initialized.
  * 
  * @param[in] motors Array of pointers to motors, which are the motors to be updated.
- * @param[in] pps New speed for the motors, in microsteps per second.
+ * @param[in] pps New speed for the motors, in microsteps per second. May be fractional.
  * @param[in] count Amount of motors in the motors array.
  * @return (int) 0 on success, negative value otherwise.
  */
-int stepper_set_speed_multiple(Stepper* motors[], unsigned int pps, unsigned int count)
+int stepper_set_speed_multiple(Stepper* motors[], double pps, unsigned int count)
 {
     int retval = -1;
 
@@ -529,7 +1912,7 @@ int stepper_set_speed_multiple(Stepper* motors[], unsigned int pps, unsigned int
     if(motors == NULL){
         ERROR_PRINT("Motor list reference invalid.");
         goto exit;
-    } else if(pps == 0){
+    } else if(!(pps > 0.0)){
         ERROR_PRINT("Invalid pps value.");
         goto exit;
     } else if(count == 0 || count > MOTOR_LIST_SIZE_MAX){
@@ -537,27 +1920,282 @@ int stepper_set_speed_multiple(Stepper* motors[], unsigned int pps, unsigned int
         goto exit;
     }
 
-    // Limit the speed if it exceeds maximum supported value
-    if(pps > MAX_PPS){
-        ERROR_PRINT("Specified speed exceeds supported maximum, limited to %d.", MAX_PPS);
-        pps = MAX_PPS;
+    for(unsigned int i = 0; i < count; i++){
+        // For each motor in the list, check if the speed can be changed, and if
+        // their pointer points to a valid address
+        if(motors[i] == NULL){
+            ERROR_PRINT("Motor reference at index %d is invalid.", i);
+            goto exit;
+        } else if(stepper_is_busy(motors[i])){
+            ERROR_PRINT("A motor in the list is busy, try again later.");
+            goto exit;
+        }
+
+        // Limit the speed if it exceeds maximum supported value for the timing of the motor
+        unsigned int max_pps = stepper_max_pps(motors[i]->timing);
+        double motor_pps = pps;
+        if(motor_pps > max_pps){
+            ERROR_PRINT("Specified speed exceeds supported maximum, limited to %d.", max_pps);
+            motor_pps = max_pps;
+        }
+
+        // Update the motor speed. Period is kept fractional, so the rate isn't rounded to whole ns.
+        motors[i]->period_ns = (double)NANO_IN_SECOND / motor_pps;
+    }
+
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Override the feed rate of the moves led by a motor.
+ * 
+ * Scales the speed of the moves of the requests the motor leads (it is the first of their group),
+ * including the move in progress, which picks the new rate up at its next step. The speed changes
+ * gradually, at the maximum acceleration of the move. Moves without acceleration limit change at once.
+ * Meant for throttling the motors without stopping them.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] percent Feed rate, in percent of the programmed speed (STEPPER_FEED_MIN to 100).
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_feed(Stepper* motor, double percent)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    } else if(!(percent >= STEPPER_FEED_MIN && percent <= 100.0)){
+        ERROR_PRINT("Feed rate out of range.");
+        goto exit;
+    }
+
+    // Picked up by the move in progress at its next tick
+    atomic_store_explicit(&motor->feed, (unsigned int)(percent / 100.0 * FEED_ONE), memory_order_relaxed);
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Set the maximum acceleration of the motor, in microsteps per second squared.
+ * 
+ * Moves of a motor with an acceleration limit follow a trapezoidal profile: the motor ramps
+ * up to the speed set with stepper_set_speed(), and ramps down before the last step.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] accel New maximum acceleration, in microsteps/s². 0 disables the ramps.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_acceleration(Stepper* motor, unsigned int accel)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    }
+
+    // Check if acceleration can be changed
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
+    }
+
+    motor->max_accel = accel;
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Set the maximum jerk of the motor, in microsteps per second cubed.
+ * 
+ * Only used by moves with the PROFILE_SCURVE profile.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] jerk New maximum jerk, in microsteps/s³. 0 turns S-curve moves into trapezoidal ones.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_jerk(Stepper* motor, unsigned int jerk)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    }
+
+    // Check if jerk can be changed
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
+    }
+
+    motor->max_jerk = jerk;
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Set the motion profile used by the next moves of the motor.
+ * 
+ * When stepping multiple motors, the profile of the first motor of the list is used.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] type PROFILE_CONSTANT, PROFILE_TRAPEZOIDAL or PROFILE_SCURVE.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_profile(Stepper* motor, profile_type_t type)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    } else if(type != PROFILE_CONSTANT && type != PROFILE_TRAPEZOIDAL && type != PROFILE_SCURVE){
+        ERROR_PRINT("Profile type invalid.");
+        goto exit;
+    }
+
+    // Check if profile can be changed
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
+    }
+
+    motor->profile = type;
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Set the timing of the pulses of the moves led by the motor.
+ * 
+ * With TIMING_HYBRID, the time spun before every edge is calibrated by the thread of the motor,
+ * by measuring its wakeup latency before it runs its first move with this timing. It is at most
+ * half the shortest period of the timing. The speed of the motor is limited to the maximum of the new timing.
+ * When stepping multiple motors, the timing of the first motor of the list is used.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] timing TIMING_SLEEP or TIMING_HYBRID.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_timing(Stepper* motor, stepper_timing_t timing)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    } else if(timing != TIMING_SLEEP && timing != TIMING_HYBRID){
+        ERROR_PRINT("Timing invalid.");
+        goto exit;
+    }
+
+    // Check if timing can be changed
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
+    }
+
+    motor->timing = timing;
+
+    // Speed set for the previous timing may not be supported anymore
+    double min_period_ns = (double)NANO_IN_SECOND / stepper_max_pps(timing);
+    if(motor->period_ns != 0.0 && motor->period_ns < min_period_ns){
+        ERROR_PRINT("Speed of the motor exceeds supported maximum, limited to %d.", stepper_max_pps(timing));
+        motor->period_ns = min_period_ns;
+    }
+
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Restrict the thread of the motor to a single CPU.
+ * 
+ * Moves led by the motor run on that CPU. Best used with a CPU isolated from the scheduler (isolcpus),
+ * and with TIMING_HYBRID. The spin of TIMING_HYBRID is calibrated again on the new CPU, so the motor must be idle.
+ * 
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] cpu Index of the CPU.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_cpu(Stepper* motor, int cpu)
+{
+    int retval = -1;
+
+    // Parameter validation
+    // cpu is validated by Task_set_affinity
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    }
+
+    // Check if the CPU can be changed
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
+    }
+
+    if(Task_set_affinity(Task_get_id_by_name(motor->name), cpu) < 0){
+        ERROR_PRINT("Error setting the CPU of the motor.");
+        goto exit;
+    }
+
+    motor->spin_ns = -1;
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Record the edges of the requests led by the motor in a trace.
+ *
+ * Every STEP edge and every DIR change made by the pulser is recorded with its time and the id of its request.
+ * Directions set with stepper_set_direction_abs() and stepper_set_direction_rel() are recorded when the next move drives them.
+ * A trace has a single writer, so it may only be shared by motors whose requests run on the same thread,
+ * like the motors of the pulse engine. The motor must be idle.
+ *
+ * @param[in] motor Pointer to the motor to update.
+ * @param[in] trace Trace to record the edges in, or NULL to stop recording them. Not owned by the motor.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_set_trace(Stepper* motor, Trace* trace)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        goto exit;
+    }
+
+    // Requests keep the trace they were created with, so the old one can be destroyed once the motor is idle
+    if(stepper_is_busy(motor)){
+        ERROR_PRINT("Motor is busy, try again later.");
+        goto exit;
     }
 
-    for(unsigned int i = 0; i < count; i++){
-        // For each motor in the list, check if the speed can be changed, and if
-        // their pointer points to a valid address
-        if(stepper_is_busy(motors[i])){
-            ERROR_PRINT("A motor in the list is busy, try again later.");
-            goto exit;
-        } else if(motors[i] == NULL){
-            ERROR_PRINT("Motor reference at index %d is invalid.", i);
-            goto exit;
-        }
-
-        // TODO: take into account calibration value
-        // Update the motor speed
-        motors[i]->half_period = 500000/pps;
-    }
+    motor->trace = trace;
 
     retval = 0;
 
@@ -566,8 +2204,8 @@ exit:
 }
 
 /**
- * @brief Step a motor. 
- * 
+ * @brief Step a motor.
+ *
  * Steps are taken in the direction previously specified in the initialization of the 
  * Stepper object or by the stepper_set_direction (either absolute or relative) function.
  * 
@@ -593,19 +2231,64 @@ int stepper_step(Stepper* motor, unsigned int steps)
  * @return (int) 0 on success, negative value otherwise.
  */
 int stepper_step_multiple(Stepper* motors[], unsigned int steps, int count)
+{
+    unsigned int steps_list[MOTOR_LIST_SIZE_MAX];
+
+    // Special case of a coordinated move where all motors take the same amount of steps
+    if(count > 0 && count <= MOTOR_LIST_SIZE_MAX){
+        for(int i = 0; i < count; i++)
+            steps_list[i] = steps;
+    }
+
+    return stepper_step_coordinated(motors, steps_list, count);
+}
+
+/**
+ * @brief Step multiple motors, each a different amount of steps.
+ * 
+ * Motors start and finish together: the motor with the most steps steps on every tick, and the
+ * steps of the rest are spread evenly along the move. Ticks follow the speed and profile of the
+ * first motor of the list. Motors with 0 steps are held (as busy) but not stepped.
+ * Steps are taken in the direction previously specified in the initialization of each 
+ * Stepper object or by the stepper_set_direction (either absolute or relative) function.
+ * 
+ * @param[in] motors Array of pointers to Stepper objects, which are the motors to be stepped.
+ * @param[in] steps Array with the amount of steps each motor takes. At least one must be non-zero.
+ * @param[in] count Amount of motors in the motors and steps arrays.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_step_coordinated(Stepper* motors[], const unsigned int steps[], int count)
 {
     int retval = -1;
+    unsigned int total = 0;
+    int signed_steps[MOTOR_LIST_SIZE_MAX];
 
     // Parameter validation
     if(motors == NULL){
         ERROR_PRINT("Motor list reference invalid.");
         goto exit;
-    } else if(steps == 0){
-        ERROR_PRINT("Invalid value for steps.");
-        goto exit;        
-    } else if(count == 0 || count > MOTOR_LIST_SIZE_MAX){
+    } else if(steps == NULL){
+        ERROR_PRINT("Step list reference invalid.");
+        goto exit;
+    } else if(count <= 0 || count > MOTOR_LIST_SIZE_MAX){
         ERROR_PRINT("Invalid amount of motors.");
         goto exit;
+    } else if(motors[0] == NULL){
+        ERROR_PRINT("Motor reference at index 0 is invalid.");
+        goto exit;
+    }
+
+    for(int i = 0; i < count; i++){
+        if(steps[i] > INT_MAX){
+            ERROR_PRINT("Invalid value for steps.");
+            goto exit;
+        }
+        total |= steps[i];
+    }
+
+    if(total == 0){
+        ERROR_PRINT("Invalid value for steps.");
+        goto exit;
     }
 
     // Check if a new request can be assigned
@@ -614,16 +2297,87 @@ int stepper_step_multiple(Stepper* motors[], unsigned int steps, int count)
         goto exit;
     }
 
+    // Steps are taken in the current direction of each motor
+    for(int i = 0; i < count; i++){
+        if(motors[i] == NULL){
+            ERROR_PRINT("Motor reference at index %d is invalid.", i);
+            goto exit;
+        }
+        signed_steps[i] = (motors[i]->curr_direction == motors[i]->pos_direction) ? (int)steps[i] : -(int)steps[i];
+    }
+
     // Create the new request
-    Stepper_req* request = stepper_create_new_request(motors, count, steps);
-    if(request == NULL){
+    if(stepper_enqueue(motors, signed_steps, motors[0]->period_ns, count, 0) < 0){
         ERROR_PRINT("Error creating the new request.");
         goto exit;
     }
 
-    // Signal the first motor in the motors array
-    motors[0]->req_available = 1;
-    pthread_cond_signal(&motors[0]->req_cv);
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Queue a move on a group of motors.
+ * 
+ * If the group is idle, the move starts right away. If the group is already moving, the move
+ * is run after the ones queued before it, and joined with the previous one without stopping
+ * if their directions allow it (see Planner.h). Reversals and moves of motors without an
+ * acceleration limit are joined at standstill. Moves can only be queued on the same group of
+ * motors, in the same order, as the one that is moving.
+ * Motors are turned in the direction of the sign of their steps, and keep that direction
+ * after the move.
+ * 
+ * @param[in] motors Array of pointers to Stepper objects, which are the motors to be stepped.
+ * @param[in] steps Array with the signed amount of steps each motor takes. Positive steps are
+ *                  taken in the positive direction of the motor. At least one must be non-zero.
+ * @param[in] pps Speed of the motor with the most steps, in microsteps per second. May be fractional.
+ * @param[in] count Amount of motors in the motors and steps arrays.
+ * @return (int) 0 on success, negative value otherwise (e.g. the queue is full).
+ */
+int stepper_queue_move(Stepper* motors[], const int steps[], double pps, int count)
+{
+    int retval = -1;
+    int total = 0;
+
+    // Parameter validation
+    if(motors == NULL){
+        ERROR_PRINT("Motor list reference invalid.");
+        goto exit;
+    } else if(steps == NULL){
+        ERROR_PRINT("Step list reference invalid.");
+        goto exit;
+    } else if(!(pps > 0.0)){
+        ERROR_PRINT("Invalid pps value.");
+        goto exit;
+    } else if(count <= 0 || count > MOTOR_LIST_SIZE_MAX){
+        ERROR_PRINT("Invalid amount of motors.");
+        goto exit;
+    } else if(motors[0] == NULL){
+        ERROR_PRINT("Motor reference at index 0 is invalid.");
+        goto exit;
+    }
+
+    for(int i = 0; i < count; i++)
+        total |= steps[i];
+
+    if(total == 0){
+        ERROR_PRINT("Invalid value for steps.");
+        goto exit;
+    }
+
+    // Limit the speed if it exceeds maximum supported value for the timing of the group
+    unsigned int max_pps = stepper_max_pps(motors[0]->timing);
+    if(pps > max_pps){
+        ERROR_PRINT("Specified speed exceeds supported maximum, limited to %d.", max_pps);
+        pps = max_pps;
+    }
+
+    if(stepper_enqueue(motors, steps, (double)NANO_IN_SECOND / pps, count, 1) < 0){
+        ERROR_PRINT("Error queueing the move.");
+        goto exit;
+    }
 
     retval = 0;
 
@@ -645,15 +2399,53 @@ int stepper_get_steps(Stepper* motor)
         return INT_MIN;
     }
     
-    // Mutex is not needed
-    // Worst case is that we get one step less than the value of the actual counter. 
-    // Not critical, and saves the performance loss from mutexes
-    return motor->steps;
+    return (int)atomic_load_explicit(&motor->steps, memory_order_relaxed);
+}
+
+/**
+ * @brief Get the amount of steps taken by the motor, and the time of the last step.
+ * 
+ * The pulser publishes both through a seqlock, so they are read consistently without locking,
+ * from any thread.
+ * 
+ * @param[in] motor Pointer to the motor of interest.
+ * @param[out] position Steps taken and time of the last one.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_get_position(Stepper* motor, Stepper_position* position)
+{
+    unsigned int seq_start, seq_end;
+    unsigned long long step_ns;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference invalid.");
+        return -1;
+    } else if(position == NULL){
+        ERROR_PRINT("Position reference invalid.");
+        return -1;
+    }
+
+    // Read again if the pulser published a step meanwhile
+    do{
+        seq_start = atomic_load_explicit(&motor->position_seq, memory_order_acquire);
+        position->steps = atomic_load_explicit(&motor->steps, memory_order_relaxed);
+        step_ns = atomic_load_explicit(&motor->step_ns, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        seq_end = atomic_load_explicit(&motor->position_seq, memory_order_relaxed);
+    } while((seq_start & 1) || seq_start != seq_end);
+
+    position->t_step.tv_sec = step_ns / NANO_IN_SECOND;
+    position->t_step.tv_nsec = step_ns % NANO_IN_SECOND;
+
+    return 0;
 }
 
 /**
- * @brief Stop a motor.
+ * @brief Stop a motor immediately.
  * 
+ * The motor stops on its next step, without decelerating, so steps may be lost at high speeds.
+ * Meant for emergency stops, see stepper_stop_decel() otherwise.
  * Function blocks until the motor has stopped. 
  * 
  * @param[in] motor Pointer to the motor to be stopped.
@@ -666,12 +2458,94 @@ void stepper_stop(Stepper* motor)
         return;
     }
 
-    // Only stop the motor if it is busy
-    motor->stop = stepper_is_busy(motor);
-    
-    // Block only if the stop "signal" was sent
-    if(motor->stop)
+    // Only wait for the motor if it was busy
+    if(stepper_is_busy(motor)){
+        stepper_stop_nowait(motor);
+        stepper_wait(motor);
+    }
+}
+
+/**
+ * @brief Ask a motor to stop, without waiting for it.
+ * 
+ * The event file descriptor of the motor becomes readable once it has stopped (see stepper_get_event_fd()).
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ */
+void stepper_stop_nowait(Stepper* motor)
+{
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference is invalid");
+        return;
+    }
+
+    // Only stop the motor if it is busy. The pulser checks the stop mask of the request on every tick.
+    Stepper_req* request = motor->current_req;
+    if(request != NULL)
+        atomic_fetch_or(&request->stop_mask, motor->req_bit);
+}
+
+/**
+ * @brief Ask a motor to decelerate to a stop, without waiting for it.
+ * 
+ * The request of the motor ramps down from its current speed at the maximum acceleration of its
+ * move in progress, so no step is lost and the position stays valid. Queued moves are dropped.
+ * If the move has no acceleration limit, or hasn't started yet, the motor stops immediately.
+ * The event file descriptor of the motor becomes readable once it has stopped (see stepper_get_event_fd()).
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ */
+void stepper_stop_decel_nowait(Stepper* motor)
+{
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference is invalid");
+        return;
+    }
+
+    Stepper_req* request = motor->current_req;
+    if(request == NULL)
+        return;
+
+    // Requests are owned by their first motor, whose struct_mutex protects the move in progress
+    Stepper* leader = request->motor_list[0];
+    pthread_mutex_lock(&leader->struct_mutex);
+
+    // Request may have finished meanwhile, or be stopping already
+    if(motor->current_req == request && atomic_load(&request->stop_mask) == 0){
+        if(stepper_compile_brake(request) == 0)
+            atomic_fetch_or_explicit(&request->stop_mask, STOP_BRAKE, memory_order_release);
+        else
+            atomic_fetch_or(&request->stop_mask, motor->req_bit);
+    }
+
+    pthread_mutex_unlock(&leader->struct_mutex);
+}
+
+/**
+ * @brief Decelerate a motor to a stop.
+ * 
+ * Function blocks until the motor has stopped. See stepper_stop_decel_nowait().
+ * 
+ * @param[in] motor Pointer to the motor to be stopped.
+ * @param[out] position Position at which the motor stopped. Can be NULL.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_stop_decel(Stepper* motor, Stepper_position* position)
+{
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference is invalid");
+        return -1;
+    }
+
+    if(stepper_is_busy(motor)){
+        stepper_stop_decel_nowait(motor);
         stepper_wait(motor);
+    }
+
+    return (position != NULL) ? stepper_get_position(motor, position) : 0;
 }
 
 /**
@@ -695,8 +2569,13 @@ void stepper_wait(Stepper* motor)
         pthread_mutex_lock(motor->shared_mutex);
         DEBUG_PRINT("shr_mutex lock ok");
 
-        motor->current_req->motor_waiting = motor;
-        flag = 1;
+        // The request may have finished meanwhile. Otherwise, the handler holds the virtual
+        // clock again on our behalf when it finishes (see stepper_finish_request).
+        if(motor->current_req != NULL){
+            motor->current_req->motor_waiting = motor;
+            Time_virtual_release();
+            flag = 1;
+        }
         
         DEBUG_PRINT("shr_mutex unlocking: %p", motor->shared_mutex);
         pthread_mutex_unlock(motor->shared_mutex);
@@ -729,6 +2608,48 @@ int stepper_ready(Stepper* motor)
     return !stepper_is_busy(motor);
 }
 
+/**
+ * @brief Get the event file descriptor of a motor.
+ * 
+ * The descriptor (an eventfd) becomes readable when a request of the motor finishes, or is stopped,
+ * so the completion of moves can be waited with select() or poll() together with other descriptors.
+ * It stays readable until cleared with stepper_clear_event(). Clear it before checking stepper_ready(),
+ * so no completion is missed.
+ * 
+ * @param[in] motor Handle to the motor.
+ * @return (int) File descriptor on success, negative value otherwise.
+ */
+int stepper_get_event_fd(Stepper* motor)
+{
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference is invalid");
+        return -1;
+    }
+
+    return motor->event_fd;
+}
+
+/**
+ * @brief Clear the event file descriptor of a motor.
+ * 
+ * @param[in] motor Handle to the motor.
+ */
+void stepper_clear_event(Stepper* motor)
+{
+    uint64_t events;
+
+    // Parameter validation
+    if(motor == NULL){
+        ERROR_PRINT("Motor reference is invalid");
+        return;
+    }
+
+    // Non-blocking, fails with EAGAIN if there was no event
+    if(read(motor->event_fd, &events, sizeof(events)) < 0 && errno != EAGAIN)
+        ERROR_PRINT("Could not clear the event file descriptor - %s", strerror(errno));
+}
+
 /**
  * @brief Function to assert if microstep parameter has a valid value
  * 
@@ -755,3 +2676,159 @@ int is_valid_microstep(int microstep)
 
     return retval;
 }
+
+/**
+ * @brief Start the pulse engine, which runs the moves of a set of motors from a single thread.
+ * 
+ * The STEP and DIR lines of the motors are requested in a single bulk, owned by the engine. The engine keeps
+ * the deadlines of the next edges of all its requests in a heap, sleeps until the earliest one, and
+ * fires every edge due within window_ns of it with a single bulk write. Independent motors then step
+ * with tight relative timing, and a single thread wakes up instead of one per group.
+ * Motors of the engine can be grouped among themselves in any way, but not with other motors.
+ * All the lines must be on the same GPIO controller (main or AON).
+ * New requests are handed to the engine through a lock-free single-producer ring, so the moves of the
+ * motors of the engine can only be commanded from the thread calling this function; other threads are
+ * refused. Moves on idle motors are started without locking. Moves queued behind a move in progress
+ * take the mutex of the leader of the group, since the planner rewrites the queued moves.
+ * All motors must be idle.
+ * 
+ * @param[in] motors Array of pointers to the motors of the engine.
+ * @param[in] count Amount of motors in the array.
+ * @param[in] window_ns Coalescing window, in nanoseconds. Edges are fired at most this early.
+ * @param[in] timing Timing of the engine. Also set as the timing of the motors, which limits their speed.
+ *                   With TIMING_HYBRID, the engine thread calibrates its spin when it starts.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int stepper_engine_init(Stepper* motors[], unsigned int count, unsigned long long window_ns, stepper_timing_t timing)
+{
+    int retval = -1;
+
+    // Parameter validation
+    if(motors == NULL){
+        ERROR_PRINT("Motor list reference invalid.");
+        goto exit;
+    } else if(count == 0 || count > MOTOR_LIST_SIZE_MAX){
+        ERROR_PRINT("Invalid amount of motors.");
+        goto exit;
+    } else if(engine.task != 0){
+        ERROR_PRINT("Pulse engine is already running.");
+        goto exit;
+    }
+
+    for(unsigned int i = 0; i < count; i++){
+        if(motors[i] == NULL){
+            ERROR_PRINT("Motor reference at index %d is invalid.", i);
+            goto exit;
+        } else if(stepper_set_timing(motors[i], timing) < 0){
+            ERROR_PRINT("Error setting the timing of the motor at index %d.", i);
+            goto exit;
+        }
+    }
+
+    pthread_mutex_lock(&group_mutex);
+
+    for(unsigned int i = 0; i < count; i++){
+        if(stepper_is_busy(motors[i])){
+            ERROR_PRINT("A motor in the list is busy, try again later.");
+            pthread_mutex_unlock(&group_mutex);
+            goto exit;
+        }
+    }
+
+    if(stepper_check_controller(motors, count) < 0){
+        pthread_mutex_unlock(&group_mutex);
+        goto exit;
+    }
+
+    // Lines reserved by the last requests of the motors are taken by the engine
+    for(unsigned int i = 0; i < count; i++){
+        if(motors[i]->group_req != NULL)
+            stepper_release_group(motors[i]->group_req);
+    }
+
+    // STEP lines first, then the DIR lines at their last level
+    GPIO_Pin* pins[2 * MOTOR_LIST_SIZE_MAX];
+    for(unsigned int i = 0; i < count; i++){
+        pins[i] = motors[i]->step_pin;
+        pins[count + i] = motors[i]->dir_pin;
+        engine.values[i] = 0;
+        engine.values[count + i] = motors[i]->dir_level;
+    }
+
+    if(GPIO_request_bulk(&engine.bulk, pins, 2 * count, GPIO_DIRECTION_OUTPUT, engine.values) < 0){
+        ERROR_PRINT("Error requesting line bulk.");
+        pthread_mutex_unlock(&group_mutex);
+        goto exit;
+    }
+
+    for(unsigned int i = 0; i < count; i++){
+        engine.motors[i] = motors[i];
+        motors[i]->engine_line = i;
+    }
+    engine.count = count;
+
+    pthread_mutex_unlock(&group_mutex);
+
+    // Engine state is initialized on every start, since the last thread might have been killed while holding the mutex
+    pthread_condattr_t cv_attr;
+    pthread_condattr_init(&cv_attr);
+    pthread_condattr_setclock(&cv_attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&engine.cv, &cv_attr);
+    pthread_condattr_destroy(&cv_attr);
+    pthread_mutex_init(&engine.mutex, NULL);
+    engine.window_ns = window_ns;
+    engine.timing = timing;
+    engine.spin_ns = 0;
+    ring_init(&engine.submitted);
+    engine.producer = pthread_self();
+    atomic_init(&engine.busy, 0);
+    atomic_init(&engine.sleeping, 0);
+    engine.heap_count = 0;
+
+    Task_attr attr;
+    Task_attr_init(&attr, STEPPER_TASK_STACK_SIZE);
+    attr.policy = STEPPER_TASK_POLICY;
+    attr.priority = STEPPER_TASK_PRIORITY;
+    attr.lock_stack = 1;
+
+    engine.task = CreateTask_attr(STEPPER_ENGINE_NAME, &attr, stepper_engine_main, NULL);
+    if(engine.task == 0){
+        ERROR_PRINT("Could not create the thread of the pulse engine.");
+        stepper_engine_destroy();
+        goto exit;
+    }
+
+    retval = 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Stop the pulse engine.
+ * 
+ * The motors of the engine are stopped, its STEP and DIR lines are released, and the motors go back to
+ * being run by their own threads.
+ */
+void stepper_engine_destroy(void)
+{
+    if(engine.count == 0)
+        return;
+
+    for(unsigned int i = 0; i < engine.count; i++)
+        stepper_stop(engine.motors[i]);
+
+    if(engine.task != 0){
+        Task_kill(engine.task);
+        engine.task = 0;
+        pthread_cond_destroy(&engine.cv);
+        pthread_mutex_destroy(&engine.mutex);
+    }
+
+    pthread_mutex_lock(&group_mutex);
+    GPIO_release_bulk(&engine.bulk);
+    for(unsigned int i = 0; i < engine.count; i++)
+        engine.motors[i]->engine_line = -1;
+    engine.count = 0;
+    pthread_mutex_unlock(&group_mutex);
+}
@@ -9,11 +9,17 @@
 
 #include "Tasks.h"
 #include "debug.h"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <errno.h>
+
+// Part of the stack kept out of the prefault, for the frames already in use and the TLS
+#define STACK_PREFAULT_RESERVE (8*1024)
 
 typedef struct task_info{
     Task_t entry_func;
     pthread_t thread_id;
-    size_t stack_size;
+    Task_attr attr;
     char name[TASK_NAME_LEN];
     void* arg;
 } task_info_t;
@@ -126,6 +132,68 @@ static void list_delete_task(pthread_t thread_id)
 #endif
 }
 
+/**
+ * @brief Touch every page of a part of the stack, so it is faulted in before the task needs it.
+ * 
+ * @param[in] size Bytes of stack to touch, below the frame of the caller.
+ */
+static void __attribute__((noinline)) prefault_stack(size_t size)
+{
+    char touch[size];
+    long page = sysconf(_SC_PAGESIZE);
+
+    for(size_t i = 0; i < size; i += page)
+        touch[i] = 0;
+
+    // Keeps the stores, which would otherwise be dropped since the array is never read
+    __asm__ __volatile__("" : : "r"(touch) : "memory");
+}
+
+/**
+ * @brief Apply the attributes of a task to the calling thread.
+ * 
+ * Attributes that can't be applied are reported, and skipped.
+ * 
+ * @param[in] task Task of the calling thread.
+ */
+static void apply_attributes(task_info_t* task)
+{
+    Task_attr* attr = &task->attr;
+    int rv = 0;
+
+    if(attr->policy != SCHED_OTHER){
+        struct sched_param param = {.sched_priority = attr->priority};
+        rv = pthread_setschedparam(pthread_self(), attr->policy, &param);
+        if(rv != 0)
+            ERROR_PRINT("Could not set the scheduling policy of task '%s' (%s), using the default one.", task->name, strerror(rv));
+    }
+
+    if(CPU_COUNT(&attr->affinity) > 0){
+        rv = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &attr->affinity);
+        if(rv != 0)
+            ERROR_PRINT("Could not set the CPU affinity of task '%s' (%s), running on any CPU.", task->name, strerror(rv));
+    }
+
+    if(attr->lock_stack){
+        // Locking faults in the whole stack. Without the privileges, faulting it in still avoids page faults
+        // on its first use, although the pages might be swapped out later.
+        pthread_attr_t attribs;
+        void* stack_addr = NULL;
+        size_t stack_size = 0;
+
+        if(pthread_getattr_np(pthread_self(), &attribs) == 0){
+            pthread_attr_getstack(&attribs, &stack_addr, &stack_size);
+            pthread_attr_destroy(&attribs);
+        }
+
+        if(stack_addr == NULL || mlock(stack_addr, stack_size) != 0){
+            ERROR_PRINT("Could not lock the stack of task '%s' (%s), prefaulting it instead.", task->name, strerror(errno));
+            if(attr->stack_size > STACK_PREFAULT_RESERVE)
+                prefault_stack(attr->stack_size - STACK_PREFAULT_RESERVE);
+        }
+    }
+}
+
 /**
  * @brief Entry point for new threads. Calls user-specified entry function after registering the thread in the task_list.
  * 
@@ -139,6 +207,7 @@ static void* thread_main(void* arg)
     // Finish setting up the task
     task->thread_id = pthread_self();
     pthread_setname_np(pthread_self(), task->name);
+    apply_attributes(task);
     
     // Go to the entry point
     task->entry_func(task->arg);
@@ -160,6 +229,52 @@ static void* thread_main(void* arg)
  * @return (Task_id_t) On success: Numerical id of the new task. On failure: 0. 
  */
 Task_id_t CreateTask(const char* name, size_t stack_size, Task_t entry_func, void* arg)
+{
+    Task_attr attr;
+
+    // Special case of creating a task with the default attributes
+    Task_attr_init(&attr, stack_size);
+    return CreateTask_attr(name, &attr, entry_func, arg);
+}
+
+/**
+ * @brief Initialize the attributes of a task with the defaults.
+ * 
+ * @param[out] attr Attributes to initialize.
+ * @param[in] stack_size Size in bytes for the stack of the task.
+ */
+void Task_attr_init(Task_attr* attr, size_t stack_size)
+{
+    // Parameter validation
+    if(attr == NULL){
+        ERROR_PRINT("Attributes reference is invalid.");
+        return;
+    }
+
+    memset(attr, 0, sizeof(Task_attr));
+
+    // Initialize attributes (commented lines are redundant because of the memset)
+    attr->stack_size = stack_size;
+    attr->policy = SCHED_OTHER;
+    // attr->priority = 0;
+    CPU_ZERO(&attr->affinity);
+    // attr->lock_stack = 0;
+}
+
+/**
+ * @brief Create and start a new task with the given attributes.
+ * 
+ * The task applies its attributes before calling entry_func. If the scheduling policy, the affinity,
+ * or the stack lock can't be applied (e.g. the process is not privileged), an error is printed and
+ * the task runs without them.
+ * 
+ * @param[in] name       String. Name of the task.
+ * @param[in] attr       Attributes of the task.
+ * @param[in] entry_func Entry function for the task.
+ * @param[in] arg        Argument passed to the new task.
+ * @return (Task_id_t) On success: Numerical id of the new task. On failure: 0. 
+ */
+Task_id_t CreateTask_attr(const char* name, const Task_attr* attr, Task_t entry_func, void* arg)
 {
     pthread_t thread_id = 0;
 
@@ -167,19 +282,21 @@ Task_id_t CreateTask(const char* name, size_t stack_size, Task_t entry_func, voi
     if(name == NULL){
         ERROR_PRINT("Name string is invalid.");
         goto exit;
-    } else if(stack_size == 0 || stack_size > MAX_STACK_SIZE){
+    } else if(attr == NULL){
+        ERROR_PRINT("Attributes reference is invalid.");
+        goto exit;
+    } else if(attr->stack_size == 0 || attr->stack_size > MAX_STACK_SIZE){
         ERROR_PRINT("Stack size is invalid.");
         goto exit;
     } else if(entry_func == NULL){
         ERROR_PRINT("Invalid entry point for the task.");
         goto exit;
+    } else if(attr->policy != SCHED_OTHER && (attr->priority < sched_get_priority_min(attr->policy) || 
+                                              attr->priority > sched_get_priority_max(attr->policy))){
+        ERROR_PRINT("Priority is invalid for the scheduling policy.");
+        goto exit;
     }
 
-    // Setup the thread
-    pthread_attr_t attribs;
-    pthread_attr_init(&attribs);
-    pthread_attr_setstacksize(&attribs, stack_size);
-
     // Create new linked list entry
     task_info_t* info = malloc(sizeof(task_info_t));
     if(info == NULL){
@@ -192,10 +309,19 @@ Task_id_t CreateTask(const char* name, size_t stack_size, Task_t entry_func, voi
     // Initialize node (commented lines are redundant because of the memset)
     info->entry_func = entry_func;
     strncpy(info->name, name, TASK_NAME_LEN-1);
-    info->stack_size = stack_size;
+    info->attr = *attr;
     info->arg = arg;
     // info->thread_id = 0;
 
+    // Smaller stacks are refused by pthread_attr_setstacksize
+    if(info->attr.stack_size < (size_t)PTHREAD_STACK_MIN)
+        info->attr.stack_size = (size_t)PTHREAD_STACK_MIN;
+
+    // Setup the thread
+    pthread_attr_t attribs;
+    pthread_attr_init(&attribs);
+    pthread_attr_setstacksize(&attribs, info->attr.stack_size);
+
     list_insert_task(info);
 
     // Create the thread
@@ -204,6 +330,8 @@ Task_id_t CreateTask(const char* name, size_t stack_size, Task_t entry_func, voi
         thread_id = 0;
     }
 
+    pthread_attr_destroy(&attribs);
+
 exit:
     return thread_id;
 }
@@ -255,3 +383,39 @@ void Task_kill(Task_id_t task_id)
     // Kill it asynchronously
     pthread_cancel(task_id);
 }
+
+/**
+ * @brief Restrict a running task to a single CPU.
+ * 
+ * @param[in] task_id Id of the task.
+ * @param[in] cpu Index of the CPU.
+ * @return (int) 0 on success, negative value otherwise.
+ */
+int Task_set_affinity(Task_id_t task_id, int cpu)
+{
+    int retval = -1;
+    cpu_set_t cpus;
+
+    // Parameter validation
+    if(task_id == 0){
+        ERROR_PRINT("Task id is invalid.");
+        goto exit;
+    } else if(cpu < 0 || cpu >= CPU_SETSIZE){
+        ERROR_PRINT("CPU index is invalid.");
+        goto exit;
+    }
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+
+    int rv = pthread_setaffinity_np(task_id, sizeof(cpu_set_t), &cpus);
+    if(rv != 0){
+        ERROR_PRINT("Could not set the CPU affinity of the task (%s).", strerror(rv));
+        goto exit;
+    }
+
+    retval = 0;
+
+exit:
+    return retval;
+}
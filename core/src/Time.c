@@ -9,6 +9,249 @@
 
 #include "Time.h"
 #include "debug.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+// Thread sleeping on the virtual clock
+struct virtual_sleeper{
+    unsigned long long deadline_ns;
+    int used;
+    int woken;      // Deadline was reached, and the clock was held again on behalf of the thread
+};
+
+// Virtual clock. Its time and the sleepers are protected by the mutex.
+static struct virtual_clock{
+    atomic_int enabled;
+    atomic_ullong now_ns;
+    int holds;      // Holds not released. The clock only advances when there are none.
+    pthread_mutex_t mutex;
+    pthread_cond_t cv;      // Signals that the clock advanced, or that the conditions of the sleepers may be met
+    struct virtual_sleeper sleepers[TIME_VIRTUAL_SLEEPERS_MAX];
+} virtual_clock = {.mutex = PTHREAD_MUTEX_INITIALIZER, .cv = PTHREAD_COND_INITIALIZER};
+
+/**
+ * @brief Advance the virtual clock to the earliest deadline, if it isn't held.
+ * 
+ * The mutex of the clock must have been locked previously!!!
+ * Threads whose deadline is reached are woken up, and the clock is held on their behalf.
+ */
+static void time_virtual_advance(void)
+{
+    unsigned long long next_ns = 0;
+    int found = 0;
+
+    if(virtual_clock.holds > 0)
+        return;
+
+    for(int i = 0; i < TIME_VIRTUAL_SLEEPERS_MAX; i++){
+        struct virtual_sleeper* sleeper = &virtual_clock.sleepers[i];
+        if(sleeper->used && !sleeper->woken && (!found || sleeper->deadline_ns < next_ns)){
+            next_ns = sleeper->deadline_ns;
+            found = 1;
+        }
+    }
+
+    if(!found)
+        return;
+
+    if(next_ns > atomic_load(&virtual_clock.now_ns))
+        atomic_store(&virtual_clock.now_ns, next_ns);
+
+    for(int i = 0; i < TIME_VIRTUAL_SLEEPERS_MAX; i++){
+        struct virtual_sleeper* sleeper = &virtual_clock.sleepers[i];
+        if(sleeper->used && !sleeper->woken && sleeper->deadline_ns <= next_ns){
+            sleeper->woken = 1;
+            virtual_clock.holds++;
+        }
+    }
+    pthread_cond_broadcast(&virtual_clock.cv);
+}
+
+/**
+ * @brief Delay for a relative time, on CLOCK_MONOTONIC or on the virtual clock.
+ * 
+ * @param[in] del Time to pause
+ */
+static void delay_relative(const struct timespec* del)
+{
+    struct timespec t_deadline;
+
+    if(!Time_is_virtual()){
+        clock_nanosleep(CLOCK_MONOTONIC, 0, del, NULL);
+        return;
+    }
+
+    Time_now(&t_deadline);
+    add_time(&t_deadline, del, &t_deadline);
+    Time_virtual_wait(&t_deadline, NULL, NULL);
+}
+
+/**
+ * @brief Get the current time of the clock used by the delays
+ * 
+ * CLOCK_MONOTONIC, or the virtual clock once Time_virtual_start() was called.
+ * 
+ * @param[out] t Current time
+ */
+void Time_now(struct timespec* t)
+{
+    if(!Time_is_virtual()){
+        clock_gettime(CLOCK_MONOTONIC, t);
+        return;
+    }
+
+    unsigned long long now_ns = atomic_load(&virtual_clock.now_ns);
+    t->tv_sec = now_ns / NANO_IN_SECOND;
+    t->tv_nsec = now_ns % NANO_IN_SECOND;
+}
+
+/**
+ * @brief Switch the delays to a virtual clock
+ * 
+ * The virtual clock starts at TIME_VIRTUAL_START_NS, and only advances when every hold on it was
+ * released (see Time_virtual_hold()), to the earliest deadline of the threads sleeping on it. The
+ * calling thread holds the clock from then on, and releases it while it sleeps. Delays of threads that
+ * don't hold the clock must not be used. There is no way back to CLOCK_MONOTONIC.
+ * 
+ * @return (int) 0 on success, -1 if the virtual clock was already started.
+ */
+int Time_virtual_start(void)
+{
+    int retval = -1;
+
+    pthread_mutex_lock(&virtual_clock.mutex);
+
+    if(atomic_load(&virtual_clock.enabled)){
+        ERROR_PRINT("Virtual clock already started.");
+        goto exit;
+    }
+
+    // The calling thread holds the clock
+    atomic_store(&virtual_clock.now_ns, TIME_VIRTUAL_START_NS);
+    virtual_clock.holds = 1;
+    atomic_store(&virtual_clock.enabled, 1);
+
+    retval = 0;
+
+exit:
+    pthread_mutex_unlock(&virtual_clock.mutex);
+    return retval;
+}
+
+/**
+ * @brief Check if the delays use the virtual clock
+ * 
+ * @return (int) 1 if Time_virtual_start() was called, 0 otherwise.
+ */
+int Time_is_virtual(void)
+{
+    return atomic_load_explicit(&virtual_clock.enabled, memory_order_relaxed);
+}
+
+/**
+ * @brief Keep the virtual clock from advancing
+ * 
+ * Taken on behalf of a thread that is about to run on virtual time (eg. before waking it up), which releases
+ * it with Time_virtual_release() when it stops running. Holds are counted, not bound to a thread, so a
+ * hold may be handed from a thread to another. No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_hold(void)
+{
+    if(!Time_is_virtual())
+        return;
+
+    pthread_mutex_lock(&virtual_clock.mutex);
+    virtual_clock.holds++;
+    pthread_mutex_unlock(&virtual_clock.mutex);
+}
+
+/**
+ * @brief Release a hold on the virtual clock, advancing it if it was the last one
+ * 
+ * No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_release(void)
+{
+    if(!Time_is_virtual())
+        return;
+
+    pthread_mutex_lock(&virtual_clock.mutex);
+    virtual_clock.holds--;
+    time_virtual_advance();
+    pthread_mutex_unlock(&virtual_clock.mutex);
+}
+
+/**
+ * @brief Sleep on the virtual clock until a deadline, or until a condition is met
+ * 
+ * The hold of the calling thread is released while it sleeps. The condition is checked when the sleep
+ * starts, and every time Time_virtual_notify() is called.
+ * 
+ * @param[in] deadline Absolute time of the virtual clock at which to wake up
+ * @param[in] ready Condition that ends the sleep early. May be NULL.
+ * @param[in] arg Argument of ready.
+ * @return (int) 1 if the sleep ended because of the condition, 0 otherwise.
+ */
+int Time_virtual_wait(const struct timespec* deadline, int (*ready)(void*), void* arg)
+{
+    unsigned long long deadline_ns = (unsigned long long)deadline->tv_sec * NANO_IN_SECOND + deadline->tv_nsec;
+    struct virtual_sleeper* sleeper = NULL;
+    int retval = 0;
+
+    pthread_mutex_lock(&virtual_clock.mutex);
+
+    if(ready != NULL && ready(arg)){
+        retval = 1;
+        goto exit;
+    } else if(deadline_ns <= atomic_load(&virtual_clock.now_ns))
+        goto exit;
+
+    for(int i = 0; i < TIME_VIRTUAL_SLEEPERS_MAX && sleeper == NULL; i++){
+        if(!virtual_clock.sleepers[i].used)
+            sleeper = &virtual_clock.sleepers[i];
+    }
+    if(sleeper == NULL){
+        ERROR_PRINT("Too many threads sleeping on the virtual clock.");
+        goto exit;
+    }
+
+    sleeper->deadline_ns = deadline_ns;
+    sleeper->woken = 0;
+    sleeper->used = 1;
+
+    virtual_clock.holds--;
+    time_virtual_advance();
+
+    while(!sleeper->woken && !(ready != NULL && ready(arg)))
+        pthread_cond_wait(&virtual_clock.cv, &virtual_clock.mutex);
+
+    // Woken up by the condition: the clock wasn't held on behalf of the thread
+    if(!sleeper->woken){
+        virtual_clock.holds++;
+        retval = 1;
+    }
+    sleeper->used = 0;
+
+exit:
+    pthread_mutex_unlock(&virtual_clock.mutex);
+    return retval;
+}
+
+/**
+ * @brief Check again the conditions of the threads sleeping on the virtual clock
+ * 
+ * No effect on CLOCK_MONOTONIC.
+ */
+void Time_virtual_notify(void)
+{
+    if(!Time_is_virtual())
+        return;
+
+    pthread_mutex_lock(&virtual_clock.mutex);
+    pthread_cond_broadcast(&virtual_clock.cv);
+    pthread_mutex_unlock(&virtual_clock.mutex);
+}
 
 /**
  * @brief Millisecond delay
@@ -24,7 +267,7 @@ void Delay_ms(long ms)
     long ns = (ms % MILLI_IN_SECOND) * NANO_IN_MILLI;
 
     struct timespec del = {.tv_nsec = ns, .tv_sec = s};
-    clock_nanosleep(CLOCK_MONOTONIC, 0, &del, NULL);
+    delay_relative(&del);
 }
 
 /**
@@ -41,7 +284,7 @@ void Delay_us(long us)
     long ns = (us % MICRO_IN_SECOND) * NANO_IN_MICRO;
 
     struct timespec del = {.tv_nsec = ns, .tv_sec = s};
-    clock_nanosleep(CLOCK_MONOTONIC, 0, &del, NULL);
+    delay_relative(&del);
 }
 
 /**
@@ -58,7 +301,93 @@ void Delay_ns(long ns)
     ns = ns % NANO_IN_SECOND;
 
     struct timespec del = {.tv_nsec = ns, .tv_sec = s};
-    clock_nanosleep(CLOCK_MONOTONIC, 0, &del, NULL);
+    delay_relative(&del);
+}
+
+/**
+ * @brief Delay until an absolute time
+ * 
+ * Sleeps against CLOCK_MONOTONIC with TIMER_ABSTIME, so consecutive calls with increasing
+ * deadlines don't accumulate wakeup latency. Returns inmediately if the deadline already passed.
+ * With the virtual clock, sleeps with Time_virtual_wait().
+ * 
+ * @param[in] deadline Absolute CLOCK_MONOTONIC time at which to wake up
+ */
+void Delay_until(const struct timespec* deadline)
+{
+    if(Time_is_virtual()){
+        Time_virtual_wait(deadline, NULL, NULL);
+        return;
+    }
+
+    // Deadline is absolute, so an interrupted sleep can simply be restarted
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, deadline, NULL) == EINTR);
+}
+
+/**
+ * @brief Delay until an absolute time, sleeping first and then spinning
+ * 
+ * Sleeps like Delay_until() until spin_ns before the deadline, and busy-waits on CLOCK_MONOTONIC
+ * for the rest. With spin_ns larger than the wakeup latency of the sleep, the deadline is met with the
+ * resolution of the clock, at the cost of keeping the CPU busy while spinning.
+ * Returns inmediately if the deadline already passed. With the virtual clock, only sleeps.
+ * 
+ * @param[in] deadline Absolute CLOCK_MONOTONIC time at which to wake up
+ * @param[in] spin_ns Time before the deadline from which to spin, in nanoseconds. 0 only sleeps.
+ */
+void Delay_until_spin(const struct timespec* deadline, long long spin_ns)
+{
+    struct timespec t_wake, t_now;
+
+    // The virtual clock doesn't advance while the thread spins
+    if(spin_ns <= 0 || Time_is_virtual()){
+        Delay_until(deadline);
+        return;
+    }
+
+    // Sleep until the start of the spin. The sleep returns inmediately if it already passed.
+    t_wake.tv_sec = deadline->tv_sec - (time_t)(spin_ns / NANO_IN_SECOND);
+    t_wake.tv_nsec = deadline->tv_nsec - (long)(spin_ns % NANO_IN_SECOND);
+    if(t_wake.tv_nsec < 0){
+        t_wake.tv_nsec += NANO_IN_SECOND;
+        t_wake.tv_sec--;
+    }
+    Delay_until(&t_wake);
+
+    do{
+        clock_gettime(CLOCK_MONOTONIC, &t_now);
+    } while(diff_time_ns(&t_now, deadline) < 0);
+}
+
+/**
+ * @brief Measure the wakeup latency of Delay_until()
+ * 
+ * Sleeps samples times, DELAY_CALIBRATION_INTERVAL_NS each, and measures how late each wakeup is.
+ * The result is the spin time for Delay_until_spin() that meets every measured deadline. Latency
+ * depends on the scheduling policy and the core of the calling thread, so it should be called from
+ * a thread configured like the one which will use Delay_until_spin().
+ * 
+ * @param[in] samples Amount of sleeps to measure.
+ * @return (long long) Largest measured latency, in nanoseconds.
+ */
+long long Delay_calibrate_spin(unsigned int samples)
+{
+    struct timespec t_deadline, t_now;
+    long long latency = 0;
+
+    Time_now(&t_now);
+    for(unsigned int i = 0; i < samples; i++){
+        add_time_ns(&t_now, DELAY_CALIBRATION_INTERVAL_NS, &t_deadline);
+        Delay_until(&t_deadline);
+        Time_now(&t_now);
+
+        long long late = diff_time_ns(&t_now, &t_deadline);
+        latency = (late > latency) ? late : latency;
+    }
+
+    DEBUG_PRINT("Wakeup latency: %lld ns (%u samples)", latency, samples);
+
+    return latency;
 }
 
 /**
@@ -72,7 +401,7 @@ void add_time(const struct timespec* ta, const struct timespec* tb, struct times
 {
     long ns = ta->tv_nsec + tb->tv_nsec;
     time_t s = ta->tv_sec + tb->tv_sec;
-    if(ns > NANO_IN_SECOND){
+    if(ns >= NANO_IN_SECOND){
         ns -= NANO_IN_SECOND;
         s++;
     }
@@ -123,6 +452,32 @@ void mul_time(const struct timespec* ta, unsigned int b, struct timespec* result
     result->tv_sec = (time_t)s, result->tv_nsec = (long)ns;
 }
 
+/**
+ * @brief Add an amount of nanoseconds to a timespec
+ * 
+ * @param[in] ta Time
+ * @param[in] ns Nanoseconds to add
+ * @param[out] result ta + ns, in a timespec struct
+ */
+void add_time_ns(const struct timespec* ta, unsigned long long ns, struct timespec* result)
+{
+    ns += ta->tv_nsec;
+    result->tv_sec = ta->tv_sec + (time_t)(ns / NANO_IN_SECOND);
+    result->tv_nsec = (long)(ns % NANO_IN_SECOND);
+}
+
+/**
+ * @brief Get the difference between two timespec structs in nanoseconds
+ * 
+ * @param[in] ta Time A
+ * @param[in] tb Time B
+ * @return (long long) A-B, in nanoseconds. Negative if tb > ta.
+ */
+long long diff_time_ns(const struct timespec* ta, const struct timespec* tb)
+{
+    return (long long)(ta->tv_sec - tb->tv_sec) * NANO_IN_SECOND + (ta->tv_nsec - tb->tv_nsec);
+}
+
 /**
  * @brief Divide a timespec by a positive integer. Returns 0 if b == 0 
  * 
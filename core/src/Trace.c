@@ -0,0 +1,395 @@
+/*
+ * Trace.c
+ *
+ * Author: Rafael Martinez
+ * Date: 16.10.2026
+ */
+
+#define NDEBUG
+
+#include "Trace.h"
+#include "GPIO.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Header of the files written by trace_save()
+#define TRACE_MAGIC "PEFTRACE"
+#define TRACE_VERSION 1
+
+// Maximum amount of lines in a VCD
+#define TRACE_VCD_LINES_MAX 64
+
+struct trace_file_header{
+    char magic[8];
+    unsigned int version;
+    unsigned int event_size;
+    unsigned long long count;
+};
+
+// Line of a VCD
+struct trace_vcd_line{
+    unsigned int pin;
+    trace_signal_t signal;
+    char id[4];         // Identifier of the wire
+    char req_id[4];     // Identifier of the request variable. STEP lines only.
+    unsigned int request; // Last request dumped. 0 before the first one.
+};
+
+/**
+ * @brief Build the VCD identifier of a variable.
+ *
+ * @param[in] index Index of the variable.
+ * @param[out] id Identifier, made of printable characters. Up to 3 characters long.
+ */
+static void trace_vcd_id(unsigned int index, char id[4])
+{
+    unsigned int i = 0;
+
+    do{
+        id[i++] = '!' + (index % 94);
+        index /= 94;
+    } while(index > 0 && i < 3);
+    id[i] = '\0';
+}
+
+/************* PUBLIC API *************/
+
+/**
+ * @brief Create an empty trace.
+ *
+ * @param[in] capacity Amount of events kept. Must be a power of two.
+ * @return (Trace*) On success, pointer to the new trace. Otherwise, NULL.
+ */
+Trace* trace_create(size_t capacity)
+{
+    Trace* trace = NULL;
+
+    // Parameter validation
+    if(capacity == 0 || (capacity & (capacity - 1)) != 0){
+        ERROR_PRINT("Capacity of the trace must be a power of two.");
+        goto exit;
+    }
+
+    if(posix_memalign((void**)&trace, TRACE_CACHE_LINE, sizeof(Trace)) != 0){
+        ERROR_PRINT("Could not allocate the trace.");
+        trace = NULL;
+        goto exit;
+    }
+
+    // Touched now, so the pulser doesn't take page faults on the first laps of the ring
+    trace->events = malloc(capacity * sizeof(Trace_event));
+    if(trace->events == NULL){
+        ERROR_PRINT("Could not allocate the events of the trace.");
+        free(trace);
+        trace = NULL;
+        goto exit;
+    }
+    memset(trace->events, 0, capacity * sizeof(Trace_event));
+
+    trace->mask = capacity - 1;
+    atomic_init(&trace->head, 0);
+
+exit:
+    return trace;
+}
+
+/**
+ * @brief Destroy a trace. It must not be attached to a pulser anymore.
+ *
+ * @param[in] trace Trace to destroy. May be NULL.
+ */
+void trace_destroy(Trace* trace)
+{
+    if(trace == NULL)
+        return;
+
+    free(trace->events);
+    free(trace);
+}
+
+/**
+ * @brief Copy the events of a trace, oldest first. May be called while the writer runs.
+ * @details Events overwritten by the writer during the copy are left out.
+ *
+ * @param[in] trace Trace to copy.
+ * @param[out] events Array receiving the events.
+ * @param[in] max Amount of events that fit in the array.
+ * @return (size_t) Amount of events copied.
+ */
+size_t trace_snapshot(Trace* trace, Trace_event events[], size_t max)
+{
+    // Parameter validation
+    if(trace == NULL || events == NULL){
+        ERROR_PRINT("Invalid trace or events reference.");
+        return 0;
+    }
+
+    size_t capacity = trace->mask + 1;
+    size_t head = atomic_load_explicit(&trace->head, memory_order_acquire);
+    size_t first = (head > capacity) ? head - capacity : 0;
+    if(head - first > max)
+        first = head - max;
+
+    for(size_t i = first; i < head; i++)
+        events[i - first] = trace->events[i & trace->mask];
+
+    // Like a seqlock: the copy is checked against the events the writer published meanwhile. The slot
+    // of the event being written may be torn, so it is left out as well.
+    atomic_thread_fence(memory_order_acquire);
+    size_t now = atomic_load_explicit(&trace->head, memory_order_relaxed);
+    size_t valid = (now + 1 > capacity) ? now + 1 - capacity : 0;
+    size_t count = head - first;
+
+    if(valid > first){
+        size_t dropped = valid - first;
+        if(dropped >= count)
+            return 0;
+        memmove(events, &events[dropped], (count - dropped) * sizeof(Trace_event));
+        count -= dropped;
+    }
+
+    return count;
+}
+
+/**
+ * @brief Save the events of a trace to a binary file.
+ *
+ * @param[in] trace Trace to save. May be running.
+ * @param[in] path Path of the file. Overwritten if it exists.
+ * @return (int) 0 on success, -1 otherwise.
+ */
+int trace_save(Trace* trace, const char* path)
+{
+    int retval = -1;
+    Trace_event* events = NULL;
+    FILE* file = NULL;
+
+    // Parameter validation
+    if(trace == NULL || path == NULL){
+        ERROR_PRINT("Invalid trace or path reference.");
+        goto exit;
+    }
+
+    events = malloc((trace->mask + 1) * sizeof(Trace_event));
+    if(events == NULL){
+        ERROR_PRINT("Could not allocate the snapshot of the trace.");
+        goto exit;
+    }
+
+    struct trace_file_header header;
+    memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+    header.version = TRACE_VERSION;
+    header.event_size = sizeof(Trace_event);
+    header.count = trace_snapshot(trace, events, trace->mask + 1);
+
+    file = fopen(path, "wb");
+    if(file == NULL){
+        ERROR_PRINT("Could not open %s.", path);
+        goto exit;
+    }
+
+    if(fwrite(&header, sizeof(header), 1, file) != 1 ||
+       fwrite(events, sizeof(Trace_event), header.count, file) != header.count){
+        ERROR_PRINT("Could not write %s.", path);
+        goto exit;
+    }
+
+    retval = 0;
+
+exit:
+    if(file != NULL && fclose(file) != 0)
+        retval = -1;
+    free(events);
+    return retval;
+}
+
+/**
+ * @brief Load the events saved by trace_save().
+ *
+ * @param[in] path Path of the file.
+ * @param[out] events On success, points to the events read, to be freed by the caller.
+ * @return (long) Amount of events read on success, -1 otherwise.
+ */
+long trace_load(const char* path, Trace_event** events)
+{
+    long retval = -1;
+    struct trace_file_header header;
+    FILE* file = NULL;
+
+    // Parameter validation
+    if(path == NULL || events == NULL){
+        ERROR_PRINT("Invalid path or events reference.");
+        goto exit;
+    }
+
+    file = fopen(path, "rb");
+    if(file == NULL){
+        ERROR_PRINT("Could not open %s.", path);
+        goto exit;
+    }
+
+    if(fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+       header.version != TRACE_VERSION || header.event_size != sizeof(Trace_event)){
+        ERROR_PRINT("%s is not a trace file.", path);
+        goto exit;
+    }
+
+    *events = malloc((header.count > 0 ? header.count : 1) * sizeof(Trace_event));
+    if(*events == NULL){
+        ERROR_PRINT("Could not allocate the events.");
+        goto exit;
+    }
+
+    if(fread(*events, sizeof(Trace_event), header.count, file) != header.count){
+        ERROR_PRINT("%s is truncated.", path);
+        free(*events);
+        *events = NULL;
+        goto exit;
+    }
+
+    retval = header.count;
+
+exit:
+    if(file != NULL)
+        fclose(file);
+    return retval;
+}
+
+/**
+ * @brief Write events as a Value Change Dump, with a 1 ns timescale.
+ * @details Every line is a wire named after its signal and J21 header pin (eg. step_23). The request
+ *          driving the edges is dumped as an integer variable.
+ *
+ * @param[in] events Events, oldest first.
+ * @param[in] count Amount of events.
+ * @param[in,out] out Stream the VCD is written to.
+ * @return (int) 0 on success, -1 otherwise.
+ */
+int trace_write_vcd(const Trace_event events[], size_t count, FILE* out)
+{
+    int retval = -1;
+    struct trace_vcd_line lines[TRACE_VCD_LINES_MAX];
+    unsigned int nlines = 0, nvars = 0;
+
+    // Parameter validation
+    if((events == NULL && count > 0) || out == NULL){
+        ERROR_PRINT("Invalid events or stream reference.");
+        goto exit;
+    }
+
+    // Declare a wire for every line in the events, and a request variable for every STEP line
+    for(size_t i = 0; i < count; i++){
+        unsigned int l = 0;
+        while(l < nlines && (lines[l].pin != events[i].pin || lines[l].signal != events[i].signal))
+            l++;
+        if(l < nlines)
+            continue;
+
+        if(nlines == TRACE_VCD_LINES_MAX){
+            ERROR_PRINT("Too many lines in the trace.");
+            goto exit;
+        }
+        lines[l].pin = events[i].pin;
+        lines[l].signal = events[i].signal;
+        lines[l].request = 0;
+        trace_vcd_id(nvars++, lines[l].id);
+        if(lines[l].signal == TRACE_STEP)
+            trace_vcd_id(nvars++, lines[l].req_id);
+        nlines++;
+    }
+
+    unsigned long long t0 = (count > 0) ? events[0].t_ns : 0;
+    fprintf(out, "$comment CLOCK_MONOTONIC time of the first edge: %llu ns $end\n", t0);
+    fprintf(out, "$timescale 1 ns $end\n");
+    fprintf(out, "$scope module stepper $end\n");
+    for(unsigned int l = 0; l < nlines; l++){
+        const char* name = (lines[l].signal == TRACE_STEP) ? "step" : "dir";
+        int number = gpio_pin_to_int(lines[l].pin);
+        fprintf(out, "$var wire 1 %s %s_%d $end\n", lines[l].id, name, number);
+        if(lines[l].signal == TRACE_STEP)
+            fprintf(out, "$var integer 32 %s request_%d $end\n", lines[l].req_id, number);
+    }
+    fprintf(out, "$upscope $end\n");
+    fprintf(out, "$enddefinitions $end\n");
+
+    // Levels are unknown until the first edge of every line
+    fprintf(out, "$dumpvars\n");
+    for(unsigned int l = 0; l < nlines; l++){
+        fprintf(out, "x%s\n", lines[l].id);
+        if(lines[l].signal == TRACE_STEP)
+            fprintf(out, "bx %s\n", lines[l].req_id);
+    }
+    fprintf(out, "$end\n");
+
+    // Times must not go back. Edges of a pulser are recorded in order, so it only happens across pulsers.
+    unsigned long long t_last = 0;
+    int first = 1;
+    for(size_t i = 0; i < count; i++){
+        unsigned long long t = (events[i].t_ns > t0) ? events[i].t_ns - t0 : 0;
+        if(first || t > t_last){
+            fprintf(out, "#%llu\n", t);
+            t_last = t;
+            first = 0;
+        }
+
+        unsigned int l = 0;
+        while(lines[l].pin != events[i].pin || lines[l].signal != events[i].signal)
+            l++;
+        fprintf(out, "%d%s\n", events[i].value != 0, lines[l].id);
+        if(lines[l].signal == TRACE_STEP && events[i].request != lines[l].request){
+            lines[l].request = events[i].request;
+            fputc('b', out);
+            for(int bit = 31; bit >= 0; bit--)
+                fputc((events[i].request >> bit) & 1 ? '1' : '0', out);
+            fprintf(out, " %s\n", lines[l].req_id);
+        }
+    }
+
+    retval = ferror(out) ? -1 : 0;
+
+exit:
+    return retval;
+}
+
+/**
+ * @brief Build the histogram of the step periods of a line, measured between consecutive rising edges.
+ * @details Periods spanning two requests are left out, since the line may have been idle in between.
+ *
+ * @param[in] events Events, oldest first.
+ * @param[in] count Amount of events.
+ * @param[in] pin Pin of the STEP line.
+ * @param[in] bin_ns Width of the bins, in nanoseconds.
+ * @param[out] bins Counts of the periods in [i*bin_ns, (i+1)*bin_ns). Longer periods are counted in the last one.
+ * @param[in] nbins Amount of bins.
+ * @return (long) Amount of periods counted on success, -1 otherwise.
+ */
+long trace_histogram(const Trace_event events[], size_t count, unsigned int pin, unsigned long long bin_ns,
+                     unsigned int bins[], unsigned int nbins)
+{
+    long periods = 0;
+    const Trace_event* last = NULL;
+
+    // Parameter validation
+    if((events == NULL && count > 0) || bins == NULL || nbins == 0 || bin_ns == 0){
+        ERROR_PRINT("Invalid histogram parameters.");
+        return -1;
+    }
+
+    memset(bins, 0, nbins * sizeof(unsigned int));
+
+    for(size_t i = 0; i < count; i++){
+        const Trace_event* event = &events[i];
+        if(event->pin != pin || event->signal != TRACE_STEP || event->value == 0)
+            continue;
+
+        if(last != NULL && last->request == event->request && event->t_ns >= last->t_ns){
+            unsigned long long bin = (event->t_ns - last->t_ns) / bin_ns;
+            bins[(bin < nbins) ? bin : nbins - 1]++;
+            periods++;
+        }
+        last = event;
+    }
+
+    return periods;
+}
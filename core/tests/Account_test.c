@@ -0,0 +1,119 @@
+#include "Stepper.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Cost of counting the steps of a tick, for groups of 1, 2, 4 and 8 motors. The loop used before
+ * (direction compared and stop flag read for every motor) is compared with the one used now (increments
+ * fixed at the start of the move and a single stop mask).
+ * Both loops are copies of the pulser code, run on Stepper objects that are not initialized with
+ * stepper_init(), so no thread or line is involved.
+ */
+
+#define TEST_TICKS 10000000UL
+
+static Stepper* motors[MOTOR_LIST_SIZE_MAX];
+static volatile unsigned int stop_flags[MOTOR_LIST_SIZE_MAX];
+static atomic_uint stop_mask;
+static int increment[MOTOR_LIST_SIZE_MAX];
+static int mask[MOTOR_LIST_SIZE_MAX];
+
+static inline void publish(Stepper* motor, long long delta, unsigned long long step_ns)
+{
+    unsigned int seq = atomic_load_explicit(&motor->position_seq, memory_order_relaxed);
+    long long steps = atomic_load_explicit(&motor->steps, memory_order_relaxed);
+
+    atomic_store_explicit(&motor->position_seq, seq + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&motor->steps, steps + delta, memory_order_relaxed);
+    atomic_store_explicit(&motor->step_ns, step_ns, memory_order_relaxed);
+    atomic_store_explicit(&motor->position_seq, seq + 2, memory_order_release);
+}
+
+static __attribute__((noinline)) int account_legacy(unsigned int count, unsigned long long step_ns)
+{
+    int stop = 0;
+
+    for(unsigned int i = 0; i < count; i++){
+        Stepper* node = motors[i];
+        if(mask[i])
+            publish(node, (node->curr_direction == node->pos_direction) ? 1 : -1, step_ns);
+        stop |= stop_flags[i];
+    }
+
+    return stop;
+}
+
+static __attribute__((noinline)) int account(unsigned int count, unsigned long long step_ns)
+{
+    for(unsigned int i = 0; i < count; i++){
+        if(mask[i])
+            publish(motors[i], increment[i], step_ns);
+    }
+
+    return atomic_load_explicit(&stop_mask, memory_order_relaxed) != 0;
+}
+
+static double run(int (*func)(unsigned int, unsigned long long), unsigned int count)
+{
+    struct timespec t0, t1;
+    int stop = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for(unsigned long n = 0; n < TEST_TICKS; n++){
+        // The DDA of a coordinated move steps the slower motors on part of the ticks
+        for(unsigned int i = 0; i < count; i++)
+            mask[i] = ((n >> i) & 1) | (i == 0);
+        stop |= func(count, n);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    return stop ? -1.0 : (double)diff_time_ns(&t1, &t0) / TEST_TICKS;
+}
+
+int main(void)
+{
+    const unsigned int sizes[] = {1, 2, 4, 8};
+    int retval = 0;
+
+    for(int i = 0; i < MOTOR_LIST_SIZE_MAX; i++){
+        if(posix_memalign((void**)&motors[i], STEPPER_CACHE_LINE, sizeof(Stepper)) != 0){
+            puts("Allocation FAILED!");
+            return -1;
+        }
+        memset(motors[i], 0, sizeof(Stepper));
+        motors[i]->pos_direction = DIRECTION_CLOCKWISE;
+        motors[i]->curr_direction = (i % 2) ? DIRECTION_COUNTERCLOCKWISE : DIRECTION_CLOCKWISE;
+        increment[i] = (motors[i]->curr_direction == motors[i]->pos_direction) ? 1 : -1;
+    }
+
+    printf("###### TEST -- STEP ACCOUNTING PER TICK (%lu ticks) ######\n", TEST_TICKS);
+    printf("motors   legacy (ns)   current (ns)\n");
+    for(int s = 0; s < 4; s++){
+        long long start[MOTOR_LIST_SIZE_MAX], middle[MOTOR_LIST_SIZE_MAX];
+        for(unsigned int i = 0; i < sizes[s]; i++)
+            start[i] = atomic_load(&motors[i]->steps);
+        double legacy = run(account_legacy, sizes[s]);
+
+        for(unsigned int i = 0; i < sizes[s]; i++)
+            middle[i] = atomic_load(&motors[i]->steps);
+        double current = run(account, sizes[s]);
+
+        printf("%6u   %11.2f   %12.2f\n", sizes[s], legacy, current);
+
+        // Both loops must count the same steps
+        for(unsigned int i = 0; i < sizes[s]; i++){
+            if(middle[i] - start[i] != atomic_load(&motors[i]->steps) - middle[i]){
+                printf("Motor %u counted differently by the loops FAILED!\n", i);
+                retval = -1;
+            }
+        }
+    }
+
+    for(int i = 0; i < MOTOR_LIST_SIZE_MAX; i++)
+        free(motors[i]);
+
+    return retval;
+}
@@ -0,0 +1,92 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "debug.h"
+#include <stdio.h>
+
+/*
+ * Counts the heap allocations done by the library while moving. Linked with
+ * -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free (see the alloc target),
+ * so only calls made from the objects of the project are counted: allocations done
+ * inside shared libraries (eg. libgpiod) are not seen.
+ */
+
+#define TEST_MOVES 10000
+#define TEST_STEPS 2
+#define TEST_PPS 4000
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t n, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static volatile int counting = 0;
+static volatile unsigned long allocs = 0;
+static volatile unsigned long frees = 0;
+
+void* __wrap_malloc(size_t size)
+{
+    if(counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t n, size_t size)
+{
+    if(counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_calloc(n, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+    if(counting)
+        __atomic_add_fetch(&allocs, 1, __ATOMIC_RELAXED);
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr)
+{
+    if(counting && ptr != NULL)
+        __atomic_add_fetch(&frees, 1, __ATOMIC_RELAXED);
+    __real_free(ptr);
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    Stepper* motor_A = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    Stepper* motor_B = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor_A == NULL || motor_B == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    Stepper* axis[] = {motor_A, motor_B};
+    unsigned int steps[] = {TEST_STEPS, TEST_STEPS / 2};
+    stepper_set_speed_multiple(axis, TEST_PPS, 2);
+
+    printf("###### TEST -- ALLOCATIONS IN %d MOVES ######\n", TEST_MOVES);
+    counting = 1;
+    for(int i = 0; i < TEST_MOVES; i++){
+        if(i % 2)
+            stepper_step(motor_A, TEST_STEPS);
+        else
+            stepper_step_coordinated(axis, steps, 2);
+        stepper_wait(motor_A);
+        stepper_wait(motor_B);
+    }
+    counting = 0;
+
+    printf("Allocations: %lu, frees: %lu\n", allocs, frees);
+    if(allocs != 0 || frees != 0){
+        puts("FAILED!");
+        retval = -1;
+    } else
+        puts("PASSED");
+
+    stepper_destroy(motor_A);
+    stepper_destroy(motor_B);
+
+    return retval;
+}
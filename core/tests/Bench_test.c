@@ -0,0 +1,188 @@
+#include "Stepper.h"
+#include "Trace.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+
+/*
+ * Benchmarks stepper_step_multiple() with 1 to 8 motors, at fractions of the maximum speed of the timing.
+ * The edges of every run are recorded in a trace, from which the achieved speed, the jitter of the step
+ * periods of the first motor and the latency from the command to the first edge are measured. CPU usage
+ * is the one of the whole process (pulsers included) during the run.
+ * Results are written as CSV, one line per run, to stdout or to the given file, to be compared between builds.
+ *
+ * Usage: bench_test [sleep|hybrid] [output file]
+ */
+
+#define BENCH_MOTORS 8
+#define BENCH_SECONDS 0.5
+
+static const unsigned int step_pins[BENCH_MOTORS] = {
+    J21_HEADER_PIN_23, J21_HEADER_PIN_19, J21_HEADER_PIN_21, J21_HEADER_PIN_29,
+    J21_HEADER_PIN_33, J21_HEADER_PIN_36, J21_HEADER_PIN_38, J21_HEADER_PIN_7
+};
+static const unsigned int dir_pins[BENCH_MOTORS] = {
+    J21_HEADER_PIN_24, J21_HEADER_PIN_18, J21_HEADER_PIN_10, J21_HEADER_PIN_11,
+    J21_HEADER_PIN_35, J21_HEADER_PIN_37, J21_HEADER_PIN_40, J21_HEADER_PIN_8
+};
+static const double speed_fractions[] = {0.125, 0.25, 0.5, 1.0};
+
+static Stepper* motors[BENCH_MOTORS];
+
+struct bench_result{
+    unsigned int steps;         // Steps taken by the first motor
+    double achieved_pps;        // Speed measured between the first and the last rising edge
+    long long jitter_ns[4];     // p50, p99, p99.9 and max of the deviation of the periods from the nominal one
+    long long latency_ns;       // Command to the first rising edge
+    double cpu_percent;         // CPU time of the process over the wall time of the run
+};
+
+static int compare_ll(const void* a, const void* b)
+{
+    long long x = *(const long long*)a, y = *(const long long*)b;
+    return (x > y) - (x < y);
+}
+
+static long long percentile(const long long sorted[], size_t n, double p)
+{
+    size_t i = (size_t)(p * n);
+    return sorted[(i < n) ? i : n - 1];
+}
+
+static long long cpu_time_ns(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+}
+
+static int run(unsigned int count, double pps, struct bench_result* result)
+{
+    unsigned int steps = (unsigned int)(pps * BENCH_SECONDS);
+    struct timespec t_cmd, t_end;
+    int retval = -1;
+
+    // Both edges of every step of every motor, rounded up to a power of two
+    size_t capacity = 1;
+    while(capacity < 2 * (size_t)steps * count)
+        capacity <<= 1;
+
+    Trace* trace = trace_create(capacity);
+    Trace_event* events = malloc(capacity * sizeof(Trace_event));
+    long long* periods = malloc(steps * sizeof(long long));
+    if(trace == NULL || events == NULL || periods == NULL || stepper_set_trace(motors[0], trace) < 0)
+        goto exit;
+
+    stepper_set_speed_multiple(motors, pps, count);
+
+    long long cpu = cpu_time_ns();
+    clock_gettime(CLOCK_MONOTONIC, &t_cmd);
+    if(stepper_step_multiple(motors, steps, count) < 0)
+        goto exit;
+    stepper_wait(motors[0]);
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+    cpu = cpu_time_ns() - cpu;
+
+    // Rising edges of the first motor
+    size_t n = trace_snapshot(trace, events, capacity);
+    unsigned long long first = 0, last = 0, nominal = (unsigned long long)(NANO_IN_SECOND / pps);
+    unsigned int rising = 0;
+    for(size_t i = 0; i < n; i++){
+        if(events[i].pin != step_pins[0] || events[i].signal != TRACE_STEP || events[i].value == 0)
+            continue;
+        if(rising == 0)
+            first = events[i].t_ns;
+        else
+            periods[rising - 1] = llabs((long long)(events[i].t_ns - last) - (long long)nominal);
+        last = events[i].t_ns;
+        rising++;
+    }
+    if(rising < 2)
+        goto exit;
+
+    qsort(periods, rising - 1, sizeof(long long), compare_ll);
+
+    unsigned long long t_cmd_ns = (unsigned long long)t_cmd.tv_sec * NANO_IN_SECOND + t_cmd.tv_nsec;
+    result->steps = rising;
+    result->achieved_pps = (rising - 1) * 1e9 / (last - first);
+    result->jitter_ns[0] = percentile(periods, rising - 1, 0.5);
+    result->jitter_ns[1] = percentile(periods, rising - 1, 0.99);
+    result->jitter_ns[2] = percentile(periods, rising - 1, 0.999);
+    result->jitter_ns[3] = periods[rising - 2];
+    result->latency_ns = (long long)(first - t_cmd_ns);
+    result->cpu_percent = 100.0 * cpu / diff_time_ns(&t_end, &t_cmd);
+
+    retval = 0;
+
+exit:
+    stepper_set_trace(motors[0], NULL);
+    trace_destroy(trace);
+    free(events);
+    free(periods);
+    return retval;
+}
+
+int main(int argc, char const *argv[])
+{
+    stepper_timing_t timing = TIMING_SLEEP;
+    FILE* out = stdout;
+    int retval = 0;
+
+    if(argc > 1 && strcmp(argv[1], "hybrid") == 0)
+        timing = TIMING_HYBRID;
+    else if(argc > 1 && strcmp(argv[1], "sleep") != 0){
+        printf("Usage: %s [sleep|hybrid] [output file]\n", argv[0]);
+        return -1;
+    }
+
+    if(argc > 2){
+        out = fopen(argv[2], "w");
+        if(out == NULL){
+            puts("Could not open the output file.");
+            return -1;
+        }
+    }
+
+    for(int i = 0; i < BENCH_MOTORS; i++){
+        char name[MOTOR_NAME_LEN];
+        snprintf(name, MOTOR_NAME_LEN, "bench-%d", i);
+        motors[i] = stepper_init(name, step_pins[i], dir_pins[i], HALF, 200, DIRECTION_CLOCKWISE);
+        if(motors[i] == NULL || stepper_set_timing(motors[i], timing) < 0){
+            puts("Init FAILED!");
+            return -1;
+        }
+    }
+
+    double max_pps = (timing == TIMING_HYBRID) ? STEPPER_MAX_PPS : STEPPER_MAX_PPS_SLEEP;
+
+    fprintf(out, "timing,motors,pps,steps,achieved_pps,jitter_p50_ns,jitter_p99_ns,jitter_p999_ns,jitter_max_ns,latency_ns,cpu_percent\n");
+    for(unsigned int count = 1; count <= BENCH_MOTORS; count++){
+        for(unsigned int s = 0; s < sizeof(speed_fractions) / sizeof(speed_fractions[0]); s++){
+            double pps = max_pps * speed_fractions[s];
+            struct bench_result result;
+
+            if(run(count, pps, &result) < 0){
+                fprintf(stderr, "Run of %u motors at %.0f pps FAILED!\n", count, pps);
+                retval = -1;
+                continue;
+            }
+
+            fprintf(out, "%s,%u,%.0f,%u,%.1f,%lld,%lld,%lld,%lld,%lld,%.1f\n", (timing == TIMING_HYBRID) ? "hybrid" : "sleep",
+                    count, pps, result.steps, result.achieved_pps, result.jitter_ns[0], result.jitter_ns[1],
+                    result.jitter_ns[2], result.jitter_ns[3], result.latency_ns, result.cpu_percent);
+            fflush(out);
+        }
+    }
+
+    for(int i = 0; i < BENCH_MOTORS; i++)
+        stepper_destroy(motors[i]);
+    if(out != stdout)
+        fclose(out);
+
+    return retval;
+}
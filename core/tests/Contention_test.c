@@ -0,0 +1,150 @@
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include "Stepper.h"
+#include "Time.h"
+#include "debug.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Cross-core contention between the pulser and the thread commanding the motors. A pulser thread
+ * publishes the position of several motors as fast as it can, while a control thread locks and
+ * unlocks their struct_mutex and writes their flags, on another core. Both run first on motors
+ * with the fields packed together (as they were before the hot/cold split of the Stepper object),
+ * and then on Stepper objects. Fewer shared cache lines mean more operations per second for both.
+ * For a direct measure of the line transfers, run under `perf c2c record` and check the HITM counts.
+ */
+
+#define TEST_MOTORS 4
+#define TEST_PUBLISHES 20000000UL
+
+// Fields of the motor touched by the pulser and the control thread, packed together
+typedef struct packed_motor{
+    pthread_mutex_t struct_mutex;
+    volatile unsigned int stop;
+    volatile unsigned int req_available;
+    atomic_uint position_seq;
+    atomic_llong steps;
+    atomic_ullong step_ns;
+} Packed_motor;
+
+struct run{
+    void* motors[TEST_MOTORS];
+    pthread_mutex_t* mutex[TEST_MOTORS];
+    volatile unsigned int* flags[TEST_MOTORS];
+    atomic_uint* seq[TEST_MOTORS];
+    atomic_llong* steps[TEST_MOTORS];
+    atomic_ullong* step_ns[TEST_MOTORS];
+    volatile int running;
+    unsigned long control_ops;
+};
+
+static void pin_thread(int cpu)
+{
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+static void* control(void* arg)
+{
+    struct run* run = arg;
+    unsigned long ops = 0;
+
+    pin_thread(0);
+    while(run->running){
+        for(int i = 0; i < TEST_MOTORS; i++){
+            pthread_mutex_lock(run->mutex[i]);
+            *run->flags[i] = 0;
+            pthread_mutex_unlock(run->mutex[i]);
+            ops++;
+        }
+    }
+    run->control_ops = ops;
+
+    return NULL;
+}
+
+// Same writes as the pulser does on every step
+static void pulser(struct run* run)
+{
+    for(unsigned long n = 0; n < TEST_PUBLISHES; n++){
+        int i = n % TEST_MOTORS;
+        unsigned int seq = atomic_load_explicit(run->seq[i], memory_order_relaxed);
+        atomic_store_explicit(run->seq[i], seq + 1, memory_order_relaxed);
+        atomic_thread_fence(memory_order_release);
+        atomic_store_explicit(run->steps[i], atomic_load_explicit(run->steps[i], memory_order_relaxed) + 1, memory_order_relaxed);
+        atomic_store_explicit(run->step_ns[i], n, memory_order_relaxed);
+        atomic_store_explicit(run->seq[i], seq + 2, memory_order_release);
+    }
+}
+
+static void measure(const char* layout, struct run* run)
+{
+    pthread_t thread;
+    struct timespec t0, t1;
+
+    run->running = 1;
+    pthread_create(&thread, NULL, control, run);
+
+    pin_thread(1);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pulser(run);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    run->running = 0;
+    pthread_join(thread, NULL);
+
+    double s = diff_time_ns(&t1, &t0) / 1e9;
+    printf("%-8s: pulser %7.2f M steps/s, control %6.2f M locks/s\n", layout, TEST_PUBLISHES / s / 1e6, run->control_ops / s / 1e6);
+}
+
+int main(void)
+{
+    struct run packed = {0}, split = {0};
+    Packed_motor* packed_motors = calloc(TEST_MOTORS, sizeof(Packed_motor));
+    if(packed_motors == NULL){
+        puts("Allocation FAILED!");
+        return -1;
+    }
+
+    // Stepper objects are only used for their layout, so they are not initialized with stepper_init()
+    for(int i = 0; i < TEST_MOTORS; i++){
+        Packed_motor* p = &packed_motors[i];
+        pthread_mutex_init(&p->struct_mutex, NULL);
+        packed.motors[i] = p;
+        packed.mutex[i] = &p->struct_mutex;
+        packed.flags[i] = &p->req_available;
+        packed.seq[i] = &p->position_seq;
+        packed.steps[i] = &p->steps;
+        packed.step_ns[i] = &p->step_ns;
+
+        Stepper* s = NULL;
+        if(posix_memalign((void**)&s, STEPPER_CACHE_LINE, sizeof(Stepper)) != 0){
+            puts("Allocation FAILED!");
+            return -1;
+        }
+        memset(s, 0, sizeof(Stepper));
+        pthread_mutex_init(&s->struct_mutex, NULL);
+        split.motors[i] = s;
+        split.mutex[i] = &s->struct_mutex;
+        split.flags[i] = &s->req_available;
+        split.seq[i] = &s->position_seq;
+        split.steps[i] = &s->steps;
+        split.step_ns[i] = &s->step_ns;
+    }
+
+    printf("###### TEST -- PULSER VS CONTROL THREAD (%d motors, %lu steps) ######\n", TEST_MOTORS, TEST_PUBLISHES);
+    measure("packed", &packed);
+    measure("split", &split);
+
+    for(int i = 0; i < TEST_MOTORS; i++)
+        free(split.motors[i]);
+    free(packed_motors);
+
+    return 0;
+}
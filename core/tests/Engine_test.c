@@ -0,0 +1,141 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+/*
+ * Runs the same independent moves on three motors, first with a thread per motor and then with the
+ * pulse engine, and compares the time taken, the steps taken and the context switches of the process.
+ * Also checks that the motors of the engine can't be commanded from another thread.
+ */
+
+#define TEST_WINDOW_NS 2000
+
+static Stepper* motors[3];
+static const unsigned int rates[] = {4000, 3000, 2000};
+
+static long context_switches(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static int run_independent(const char* mode)
+{
+    struct timespec t0, t1;
+    int start[3];
+    int retval = 0;
+
+    for(int i = 0; i < 3; i++){
+        stepper_set_speed(motors[i], rates[i]);
+        start[i] = stepper_get_steps(motors[i]);
+    }
+
+    long switches = context_switches();
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // Every motor moves for one second
+    for(int i = 0; i < 3; i++)
+        stepper_step(motors[i], rates[i]);
+    for(int i = 0; i < 3; i++)
+        stepper_wait(motors[i]);
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    switches = context_switches() - switches;
+
+    printf("%-8s: %.4f s, %ld context switches, steps", mode, diff_time_ns(&t1, &t0) / 1e9, switches);
+    for(int i = 0; i < 3; i++){
+        int steps = abs(stepper_get_steps(motors[i]) - start[i]); // Queued moves may reverse a motor
+        printf(" %d", steps);
+        if(steps != (int)rates[i])
+            retval = -1;
+    }
+    puts(retval ? " FAILED!" : "");
+
+    return retval;
+}
+
+static int run_queued(void)
+{
+    int steps_a[] = {2000, 1000};
+    int steps_b[] = {2000, -1000};
+    int start = stepper_get_steps(motors[0]);
+
+    // Blended moves of a group of the engine, while the third motor moves on its own
+    stepper_set_speed(motors[2], 2000);
+    stepper_step(motors[2], 2000);
+    stepper_queue_move(motors, steps_a, 4000, 2);
+    stepper_queue_move(motors, steps_b, 4000, 2);
+    stepper_wait(motors[0]);
+    stepper_wait(motors[2]);
+
+    int steps = stepper_get_steps(motors[0]) - start;
+    printf("Queued on the engine: motor A took %d steps %s\n", steps, (steps == 4000) ? "" : "FAILED!");
+
+    return (steps == 4000) ? 0 : -1;
+}
+
+static void* command_other_thread(void* arg)
+{
+    *(int*)arg = stepper_step(motors[1], 100);
+    return NULL;
+}
+
+static int run_other_thread(void)
+{
+    pthread_t thread;
+    int rv = 0;
+
+    // The ring of the engine has a single producer: the thread that started it
+    pthread_create(&thread, NULL, command_other_thread, &rv);
+    pthread_join(thread, NULL);
+
+    int ok = (rv < 0 && stepper_ready(motors[1]));
+    printf("Commanded from another thread: %s %s\n", (rv < 0) ? "refused" : "accepted", ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    motors[0] = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    motors[1] = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    motors[2] = stepper_init("motor-C", J21_HEADER_PIN_21, J21_HEADER_PIN_29, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motors[0] == NULL || motors[1] == NULL || motors[2] == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    for(int i = 0; i < 3; i++)
+        stepper_set_acceleration(motors[i], 20000);
+
+    puts("###### TEST -- THREAD PER MOTOR VS PULSE ENGINE ######");
+    retval |= run_independent("threads");
+
+    if(stepper_engine_init(motors, 3, TEST_WINDOW_NS, TIMING_SLEEP) < 0){
+        puts("Engine init FAILED!");
+        return -1;
+    }
+    retval |= run_independent("engine");
+
+    puts("###### TEST -- QUEUED MOVES ON THE PULSE ENGINE ######");
+    retval |= run_queued();
+
+    puts("###### TEST -- SINGLE PRODUCER OF THE PULSE ENGINE ######");
+    retval |= run_other_thread();
+
+    stepper_engine_destroy();
+    puts("###### TEST -- BACK TO THREAD PER MOTOR ######");
+    retval |= run_independent("threads");
+
+    for(int i = 0; i < 3; i++)
+        stepper_destroy(motors[i]);
+
+    return retval;
+}
@@ -0,0 +1,78 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <sys/select.h>
+
+/*
+ * Waits for the moves of a motor with select() on its event file descriptor, while doing other work
+ * on every timeout (reading the position, as the control program does while it serves its sockets).
+ * A move that finishes and a move that is stopped must both make the descriptor readable.
+ */
+
+#define TEST_STEPS 2000
+#define TEST_PPS 4000
+#define TEST_POLL_MS 50
+
+static int wait_event(Stepper* motor, int stop_after)
+{
+    int fd = stepper_get_event_fd(motor);
+    int timeouts = 0;
+
+    while(1){
+        fd_set read_set;
+        struct timeval timeout = {.tv_sec = 0, .tv_usec = TEST_POLL_MS * 1000};
+        FD_ZERO(&read_set);
+        FD_SET(fd, &read_set);
+
+        int n = select(fd + 1, &read_set, NULL, NULL, &timeout);
+        if(n < 0)
+            return -1;
+        if(n > 0)
+            break;
+
+        // Still moving: the caller is free to do other work
+        Stepper_position position;
+        stepper_get_position(motor, &position);
+        printf("  moving, at %lld steps\n", position.steps);
+        if(++timeouts == stop_after)
+            stepper_stop_nowait(motor);
+    }
+
+    stepper_clear_event(motor);
+    return timeouts;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    Stepper* motor = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+    stepper_set_speed(motor, TEST_PPS);
+
+    puts("###### TEST -- MOVE FINISHED ######");
+    int start = stepper_get_steps(motor);
+    stepper_clear_event(motor);
+    stepper_step(motor, TEST_STEPS);
+    int timeouts = wait_event(motor, 0);
+    int steps = stepper_get_steps(motor) - start;
+    printf("Timeouts: %d, steps: %d, ready: %d %s\n", timeouts, steps, stepper_ready(motor), (timeouts > 0 && steps == TEST_STEPS && stepper_ready(motor)) ? "" : "FAILED!");
+    retval |= (timeouts > 0 && steps == TEST_STEPS && stepper_ready(motor)) ? 0 : -1;
+
+    puts("###### TEST -- MOVE STOPPED ######");
+    start = stepper_get_steps(motor);
+    stepper_step(motor, TEST_STEPS);
+    timeouts = wait_event(motor, 2);
+    steps = stepper_get_steps(motor) - start;
+    printf("Timeouts: %d, steps: %d, ready: %d %s\n", timeouts, steps, stepper_ready(motor), (steps < TEST_STEPS && stepper_ready(motor)) ? "" : "FAILED!");
+    retval |= (steps < TEST_STEPS && stepper_ready(motor)) ? 0 : -1;
+
+    stepper_destroy(motor);
+
+    return retval;
+}
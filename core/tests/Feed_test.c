@@ -0,0 +1,80 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Overrides the feed rate of a motor cruising at TEST_PPS, down to half and back to full speed.
+ * The speed must follow the override within the time the acceleration allows, and the move must
+ * still take all its steps.
+ */
+
+#define TEST_PPS 4000
+#define TEST_ACCEL 8000
+#define TEST_STEPS 12000
+#define TEST_WINDOW_MS 200
+
+static Stepper* motor;
+
+static int check_speed(const char* name, double expected_pps)
+{
+    struct timespec t0, t1;
+
+    int start = stepper_get_steps(motor);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    Delay_ms(TEST_WINDOW_MS);
+    int steps = stepper_get_steps(motor) - start;
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    double pps = steps / (diff_time_ns(&t1, &t0) / 1e9);
+    int ok = pps > expected_pps * 0.9 && pps < expected_pps * 1.1;
+    printf("%-10s: %7.1f pps (expected %.1f) %s\n", name, pps, expected_pps, ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    motor = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+    stepper_set_speed(motor, TEST_PPS);
+    stepper_set_acceleration(motor, TEST_ACCEL);
+
+    printf("###### TEST -- FEED RATE OVERRIDE AT %d pps, %d pps/s ######\n", TEST_PPS, TEST_ACCEL);
+
+    if(stepper_set_feed(motor, 0.0) == 0 || stepper_set_feed(motor, 150.0) == 0){
+        puts("Out of range feed rate accepted FAILED!");
+        retval = -1;
+    }
+
+    int start = stepper_get_steps(motor);
+    stepper_step(motor, TEST_STEPS);
+    Delay_ms(1000); // Acceleration takes TEST_PPS / TEST_ACCEL seconds
+    retval |= check_speed("full", TEST_PPS);
+
+    // Changing speed by TEST_PPS / 2 takes TEST_PPS / (2 * TEST_ACCEL) seconds
+    stepper_set_feed(motor, 50.0);
+    Delay_ms(500);
+    retval |= check_speed("half", TEST_PPS / 2.0);
+
+    stepper_set_feed(motor, 100.0);
+    Delay_ms(500);
+    retval |= check_speed("restored", TEST_PPS);
+
+    stepper_wait(motor);
+    int steps = stepper_get_steps(motor) - start;
+    printf("Steps: %d (expected %d) %s\n", steps, TEST_STEPS, (steps == TEST_STEPS) ? "" : "FAILED!");
+    if(steps != TEST_STEPS)
+        retval = -1;
+
+    stepper_destroy(motor);
+
+    return retval;
+}
@@ -37,36 +37,27 @@ static void max_freq_test(void)
 
 static void multiple_test(void)
 {
-    GPIO_Controller* main_chip = gpiod_chip_open(GPIO_MAIN_CONTROLLER_PATH);
-    DEBUG_PRINT("Main chip: %p", main_chip);
-
-    GPIO_Pin* stepA = gpiod_chip_get_line(main_chip, GPIO_GET_LINE(J21_HEADER_PIN_23));
-    DEBUG_PRINT("Step A successful (%p)", stepA);
-    GPIO_Pin* stepB = gpiod_chip_get_line(main_chip, GPIO_GET_LINE(J21_HEADER_PIN_19));
-    DEBUG_PRINT("Step B successful (%p)", stepB);
-
-    int retval = 0;
+    unsigned int pins[2] = {J21_HEADER_PIN_23, J21_HEADER_PIN_19};
     int high[2] = {1,1};
     int low[2] = {0,0};
 
-    struct gpiod_line_bulk bulk = GPIOD_LINE_BULK_INITIALIZER;
-    DEBUG_PRINT("Bulk init successfull");
-    gpiod_line_bulk_add(&bulk, stepA);
-    DEBUG_PRINT("Step A added to bulk successfull");
-    gpiod_line_bulk_add(&bulk, stepB);
-    DEBUG_PRINT("Step B added to bulk successfull");
-    DEBUG_PRINT("bulk.n_lines = %d", bulk.num_lines);
-    for(unsigned int i = 0; i < bulk.num_lines; i++)
-        DEBUG_PRINT("bulk.line[%d]=(%p)", i, bulk.lines[i]);
-    retval = gpiod_line_request_bulk_output(&bulk, "test", high);
-    DEBUG_PRINT("Bulk request successfull (%d)", retval);
+    GPIO_Bulk* bulk = GPIO_init_bulk(pins, GPIO_DIRECTION_OUTPUT, high, 2);
+    DEBUG_PRINT("Bulk request successfull (%p)", bulk);
+    if(bulk == NULL)
+        return;
 
-    while(1){
-        gpiod_line_set_value_bulk(&bulk, high);
+    DEBUG_PRINT("bulk.count = %d", bulk->count);
+    for(unsigned int i = 0; i < bulk->count; i++)
+        DEBUG_PRINT("bulk.pins[%d]=(%p)", i, bulk->pins[i]);
+
+    for(int i = 0; i < 500; i++){
+        GPIO_write_bulk(bulk, high);
         Delay_ms(10);
-        gpiod_line_set_value_bulk(&bulk, low);
+        GPIO_write_bulk(bulk, low);
         Delay_ms(10);
     }
+
+    GPIO_destroy_bulk(bulk);
 }
 
 int main(int argc, char const *argv[])
@@ -0,0 +1,74 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+
+/*
+ * Measures the latency from the step command to the first step, when the same group of motors
+ * is moved repeatedly (STEP lines stay reserved), and when two groups sharing a motor alternate
+ * (STEP lines are requested again on every move).
+ */
+
+#define TEST_MOVES 1000
+#define TEST_PPS 4000
+
+static Stepper* motor_A;
+static Stepper* motor_B;
+
+static double command_latency_us(Stepper* motors[], unsigned int count)
+{
+    unsigned int steps[] = {1, 1};
+    struct timespec t_cmd, t_step;
+    int start = stepper_get_steps(motor_A);
+
+    clock_gettime(CLOCK_MONOTONIC, &t_cmd);
+    if(stepper_step_coordinated(motors, steps, count) < 0)
+        return -1.0;
+
+    // The first step is counted once its pulse is finished
+    while(stepper_get_steps(motor_A) == start)
+        ;
+    clock_gettime(CLOCK_MONOTONIC, &t_step);
+
+    stepper_wait(motor_A);
+    stepper_wait(motor_B);
+
+    return diff_time_ns(&t_step, &t_cmd) / 1e3;
+}
+
+int main(void)
+{
+    double same = 0.0, alternating = 0.0;
+
+    motor_A = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    motor_B = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor_A == NULL || motor_B == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    Stepper* group[] = {motor_A, motor_B};
+    stepper_set_speed_multiple(group, TEST_PPS, 2);
+
+    printf("###### TEST -- COMMAND TO FIRST STEP (%d moves, %d pps) ######\n", TEST_MOVES, TEST_PPS);
+
+    // Same group: lines are requested on the first move only
+    for(int i = 0; i < TEST_MOVES; i++)
+        same += command_latency_us(group, 2);
+
+    // Groups {A, B} and {A} alternate: lines are released and requested on every move
+    for(int i = 0; i < TEST_MOVES; i++)
+        alternating += command_latency_us(group, (i % 2) ? 1 : 2);
+
+    same /= TEST_MOVES;
+    alternating /= TEST_MOVES;
+    printf("Same group:        %8.2f us\n", same);
+    printf("Alternating group: %8.2f us\n", alternating);
+    printf("Reduction:         %8.2f us\n", alternating - same);
+
+    stepper_destroy(motor_A);
+    stepper_destroy(motor_B);
+
+    return 0;
+}
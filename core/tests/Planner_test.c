@@ -0,0 +1,99 @@
+#include "Planner.h"
+#include "debug.h"
+#include <stdio.h>
+
+#define TEST_RATE 4000.0
+#define TEST_ACCEL 20000.0
+#define TEST_DEVIATION 10.0
+#define TEST_EPSILON 1e-6
+
+static int check(const char* name, double value, double expected)
+{
+    int ok = fabs(value - expected) < TEST_EPSILON * (1.0 + fabs(expected));
+    printf("%-36s %10.3f (expected %10.3f) %s\n", name, value, expected, ok ? "PASSED!" : "FAILED!");
+    return ok ? 0 : -1;
+}
+
+static int test_junctions(void)
+{
+    int retval = 0;
+    Planner_block a, b;
+
+    const int straight[] = {1000, 1000};
+    const int reverse[] = {-1000, -1000};
+    const int corner[] = {1000, -1000};
+    const int slow[] = {500, 500};
+
+    puts("###### TEST -- JUNCTION SPEEDS ######");
+
+    planner_block_init(&a, straight, 2, TEST_RATE, TEST_ACCEL);
+
+    planner_block_init(&b, straight, 2, TEST_RATE, TEST_ACCEL);
+    planner_junction(&a, &b, TEST_DEVIATION);
+    retval |= check("Same direction", b.v_junction, a.v_max);
+
+    planner_block_init(&b, slow, 2, TEST_RATE / 2.0, TEST_ACCEL);
+    planner_junction(&a, &b, TEST_DEVIATION);
+    retval |= check("Same direction, slower move", b.v_junction, b.v_max);
+
+    planner_block_init(&b, reverse, 2, TEST_RATE, TEST_ACCEL);
+    planner_junction(&a, &b, TEST_DEVIATION);
+    retval |= check("Reversal", b.v_junction, 0.0);
+
+    // 90 degree corner: v² = a * deviation * sin(45°) / (1 - sin(45°))
+    planner_block_init(&b, corner, 2, TEST_RATE, TEST_ACCEL);
+    planner_junction(&a, &b, TEST_DEVIATION);
+    retval |= check("Right angle", b.v_junction, sqrt(a.accel * TEST_DEVIATION * M_SQRT1_2 / (1.0 - M_SQRT1_2)));
+
+    planner_junction(NULL, &b, TEST_DEVIATION);
+    retval |= check("From standstill", b.v_junction, 0.0);
+
+    return retval;
+}
+
+static int test_recalculate(void)
+{
+    int retval = 0;
+    Planner_block blocks[3];
+    Planner_block* list[3] = {&blocks[0], &blocks[1], &blocks[2]};
+
+    const int steps[] = {2000};
+    const int shorter[] = {100};
+
+    puts("###### TEST -- RECALCULATE ######");
+
+    // Long moves in the same direction are joined at cruising speed
+    for(int i = 0; i < 3; i++){
+        planner_block_init(&blocks[i], steps, 1, TEST_RATE, TEST_ACCEL);
+        planner_junction((i > 0) ? &blocks[i - 1] : NULL, &blocks[i], TEST_DEVIATION);
+    }
+    planner_recalculate(list, 3, 0.0);
+    retval |= check("Long moves, first entry", blocks[0].v_entry, 0.0);
+    retval |= check("Long moves, first exit", blocks[0].v_exit, TEST_RATE);
+    retval |= check("Long moves, last exit", blocks[2].v_exit, 0.0);
+
+    // A short last move limits the exit of the one before it: v² = 2 * a * d
+    planner_block_init(&blocks[2], shorter, 1, TEST_RATE, TEST_ACCEL);
+    planner_junction(&blocks[1], &blocks[2], TEST_DEVIATION);
+    planner_recalculate(list, 3, 0.0);
+    retval |= check("Short last move, junction", blocks[1].v_exit, sqrt(2.0 * TEST_ACCEL * 100.0));
+    retval |= check("Short last move, entry", blocks[2].v_entry, blocks[1].v_exit);
+
+    // Move in progress keeps its entry speed
+    planner_recalculate(list, 3, 1000.0);
+    retval |= check("Entry of the move in progress", blocks[0].v_entry, 1000.0);
+
+    return retval;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    retval |= test_junctions();
+    retval |= test_recalculate();
+
+    puts(retval == 0 ? "ALL PASSED" : "SOME FAILED");
+
+    return retval;
+}
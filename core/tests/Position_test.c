@@ -0,0 +1,86 @@
+#include "Axis.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * A reader thread takes position snapshots of a motor while it moves back and forth. Every snapshot
+ * must be consistent: a new step count always comes with a later step time. The axis must then report
+ * a negative position once the motor is moved behind its starting point.
+ */
+
+#define TEST_STEPS 20000
+#define TEST_PPS 20000
+
+static Stepper* motor;
+static volatile int reading = 1;
+static unsigned long snapshots = 0;
+static unsigned long errors = 0;
+
+static void* reader(void* arg)
+{
+    Stepper_position last, now;
+    (void)arg;
+
+    stepper_get_position(motor, &last);
+    while(reading){
+        stepper_get_position(motor, &now);
+        long long dt = diff_time_ns(&now.t_step, &last.t_step);
+
+        // Steps change by at least one per step time, and the time never goes back
+        if(dt < 0 || (now.steps != last.steps && dt == 0) || llabs(now.steps - last.steps) > dt / (NANO_IN_SECOND / STEPPER_MAX_PPS) + 1)
+            errors++;
+
+        last = now;
+        snapshots++;
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t thread;
+    int retval = 0;
+
+    motor = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+    Axis* axis = axis_init(&motor, 40, 1);
+
+    stepper_set_timing(motor, TIMING_HYBRID);
+    stepper_set_speed(motor, TEST_PPS);
+
+    printf("###### TEST -- POSITION SNAPSHOTS WHILE MOVING (%d pps) ######\n", TEST_PPS);
+    pthread_create(&thread, NULL, reader, NULL);
+
+    stepper_step(motor, TEST_STEPS);
+    stepper_wait(motor);
+    stepper_set_direction_rel(motor, DIRECTION_NEGATIVE);
+    stepper_step(motor, 2 * TEST_STEPS);
+    stepper_wait(motor);
+
+    reading = 0;
+    pthread_join(thread, NULL);
+
+    printf("Snapshots: %lu, inconsistent: %lu %s\n", snapshots, errors, errors ? "FAILED!" : "");
+    retval |= errors ? -1 : 0;
+
+    puts("###### TEST -- NEGATIVE POSITION ######");
+    Stepper_position position;
+    stepper_get_position(motor, &position);
+    double mm = axis_get_position(axis);
+    printf("Steps: %lld, position: %.2f mm, last step at ", position.steps, mm);
+    print_time(&position.t_step);
+    printf(" %s\n", (position.steps == -TEST_STEPS && mm < 0.0) ? "" : "FAILED!");
+    retval |= (position.steps == -TEST_STEPS && mm < 0.0) ? 0 : -1;
+
+    stepper_destroy(motor);
+
+    return retval;
+}
@@ -0,0 +1,139 @@
+#include "Profile.h"
+#include "debug.h"
+#include <stdio.h>
+
+#define TEST_STEPS 40000
+#define TEST_ACCEL 20000
+#define TEST_JERK 400000
+#define TEST_REPEAT 20
+
+static const unsigned int rates[] = {4000, 20000};
+static const double exact_rates[] = {3000.0, 2999.5, 12345.678};
+static const profile_type_t types[] = {PROFILE_TRAPEZOIDAL, PROFILE_SCURVE};
+static const char* type_names[] = {"CONSTANT", "TRAPEZOIDAL", "SCURVE"};
+
+// Sink for the periods, so the loops are not optimized away
+static volatile unsigned long long sink;
+
+static double cpu_time_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (double)t.tv_sec * NANO_IN_SECOND + (double)t.tv_nsec;
+}
+
+static int test_accuracy(profile_type_t type, unsigned int pps)
+{
+    Profile profile, gen;
+    Profile_table table;
+    long long max_error = 0;
+    unsigned long long total_gen = 0, total_table = 0;
+
+    profile_init(&profile, type, TEST_STEPS, NANO_IN_SECOND / pps, TEST_ACCEL, TEST_JERK);
+    if(profile_compile(&profile, &table) < 0){
+        puts("Compile FAILED!");
+        return -1;
+    }
+
+    gen = profile;
+    for(unsigned int i = 0; i < TEST_STEPS; i++){
+        unsigned long long p_gen = profile_next_period(&gen);
+        unsigned long long p_table = profile_table_next(&table);
+        long long error = (long long)p_table - (long long)p_gen;
+        if(error < 0)
+            error = -error;
+        if(error > max_error)
+            max_error = error;
+        total_gen += p_gen;
+        total_table += p_table;
+    }
+
+    printf("%-12s %6u pps: %2u segments, max error %lld ns, move time %.6f s (generated %.6f s)\n",
+           type_names[type], pps, table.count, max_error, total_table / 1e9, total_gen / 1e9);
+
+    return 0;
+}
+
+static int test_rate(double pps)
+{
+    Profile profile;
+    Profile_table table;
+    unsigned long long total = 0;
+
+    // Periods that aren't whole ns must still add up to the requested rate over the move
+    profile_init(&profile, PROFILE_CONSTANT, TEST_STEPS, NANO_IN_SECOND / pps, 0, 0);
+    if(profile_compile(&profile, &table) < 0){
+        puts("Compile FAILED!");
+        return -1;
+    }
+    for(unsigned int i = 0; i < TEST_STEPS; i++)
+        total += profile_table_next(&table);
+
+    double expected = TEST_STEPS * (NANO_IN_SECOND / pps);
+    double error = (double)total - expected;
+    int ok = error > -2.0 && error < 2.0;
+    printf("%10.3f pps: move time %llu ns (expected %.1f ns), error %.1f ns %s\n", pps, total, expected, error, ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+static void test_cost(profile_type_t type, unsigned int pps)
+{
+    Profile profile, gen;
+    Profile_table table;
+    double t0, t_inline, t_table, t_compile;
+
+    profile_init(&profile, type, TEST_STEPS, NANO_IN_SECOND / pps, TEST_ACCEL, TEST_JERK);
+
+    // Periods generated on every step, as the pulser used to do
+    t0 = cpu_time_ns();
+    for(int r = 0; r < TEST_REPEAT; r++){
+        gen = profile;
+        for(unsigned int i = 0; i < TEST_STEPS; i++)
+            sink = profile_next_period(&gen);
+    }
+    t_inline = (cpu_time_ns() - t0) / ((double)TEST_REPEAT * TEST_STEPS);
+
+    // Table compiled once per move
+    t0 = cpu_time_ns();
+    for(int r = 0; r < TEST_REPEAT; r++)
+        profile_compile(&profile, &table);
+    t_compile = (cpu_time_ns() - t0) / TEST_REPEAT;
+
+    // Periods read from the table, as the pulser does now
+    t0 = cpu_time_ns();
+    for(int r = 0; r < TEST_REPEAT; r++){
+        profile_table_rewind(&table);
+        for(unsigned int i = 0; i < TEST_STEPS; i++)
+            sink = profile_table_next(&table);
+    }
+    t_table = (cpu_time_ns() - t0) / ((double)TEST_REPEAT * TEST_STEPS);
+
+    printf("%-12s %6u pps: inline %6.2f ns/step, table %6.2f ns/step, compile %8.1f us/move\n",
+           type_names[type], pps, t_inline, t_table, t_compile / 1e3);
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    printf("Move: %d steps, %d steps/s^2, %d steps/s^3\n", TEST_STEPS, TEST_ACCEL, TEST_JERK);
+
+    puts("###### TEST -- TABLE ACCURACY ######");
+    for(unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+        for(unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+            if(test_accuracy(types[t], rates[r]) < 0)
+                retval = -1;
+
+    puts("###### TEST -- FRACTIONAL RATES ######");
+    for(unsigned int r = 0; r < sizeof(exact_rates) / sizeof(exact_rates[0]); r++)
+        if(test_rate(exact_rates[r]) < 0)
+            retval = -1;
+
+    puts("###### TEST -- CPU COST PER STEP ######");
+    for(unsigned int t = 0; t < sizeof(types) / sizeof(types[0]); t++)
+        for(unsigned int r = 0; r < sizeof(rates) / sizeof(rates[0]); r++)
+            test_cost(types[t], rates[r]);
+
+    return retval;
+}
@@ -0,0 +1,73 @@
+#include "Ring.h"
+#include "debug.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * A producer thread pushes a sequence of numbers through a ring while the main thread pops them,
+ * both without locking. Every number must arrive once and in order.
+ */
+
+#define TEST_ITEMS 1000000UL
+
+static Ring ring;
+
+static void* producer(void* arg)
+{
+    (void)arg;
+
+    for(uintptr_t i = 1; i <= TEST_ITEMS; i++){
+        while(ring_push(&ring, (void*)i) < 0)
+            sched_yield();
+    }
+
+    return NULL;
+}
+
+int main(void)
+{
+    pthread_t thread;
+    uintptr_t expected = 1;
+    unsigned long empty = 0;
+
+    ring_init(&ring);
+
+    puts("###### TEST -- EMPTY AND FULL RING ######");
+    int ok = ring_empty(&ring) && ring_pop(&ring) == NULL;
+    for(uintptr_t i = 1; i <= RING_CAPACITY; i++)
+        ok &= (ring_push(&ring, (void*)i) == 0);
+    ok &= (ring_push(&ring, (void*)1) < 0);
+    for(uintptr_t i = 1; i <= RING_CAPACITY; i++)
+        ok &= (ring_pop(&ring) == (void*)i);
+    ok &= ring_empty(&ring);
+    puts(ok ? "PASSED" : "FAILED!");
+
+    printf("###### TEST -- %lu ITEMS BETWEEN TWO THREADS ######\n", TEST_ITEMS);
+    if(pthread_create(&thread, NULL, producer, NULL) != 0){
+        puts("Thread creation FAILED!");
+        return -1;
+    }
+
+    while(expected <= TEST_ITEMS){
+        void* item = ring_pop(&ring);
+        if(item == NULL){
+            empty++;
+            sched_yield();
+            continue;
+        }
+        if((uintptr_t)item != expected){
+            printf("Expected %lu, got %lu FAILED!\n", (unsigned long)expected, (unsigned long)(uintptr_t)item);
+            ok = 0;
+            break;
+        }
+        expected++;
+    }
+    pthread_join(thread, NULL);
+
+    printf("Popped in order: %lu, times found empty: %lu\n", (unsigned long)(expected - 1), empty);
+    puts(ok ? "PASSED" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
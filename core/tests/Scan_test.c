@@ -0,0 +1,74 @@
+#include "Axis.h"
+#include "GPIO.h"
+#include "debug.h"
+#include <stdio.h>
+
+/*
+ * Runs a scan made of many moves shorter than a microstep, forth and back, with single moves and
+ * with queued ones. Fractions of a microstep must be carried from move to move, so the axis ends
+ * within half a microstep of its commanded position instead of drifting.
+ */
+
+#define TEST_MOVES 1000
+#define TEST_DISTANCE 0.013 // mm, about a tenth of a microstep
+#define TEST_SPEED 20.0     // mm/sec
+
+static Axis* axis;
+
+static int check(const char* name, double expected)
+{
+    double commanded = axis_get_commanded_position(axis);
+    double actual = axis_get_position(axis);
+    double microstep = axis->mm_per_rotation / axis->motors[0]->microsteps_per_rotation;
+    int ok = fabs(commanded - expected) < 1e-6 && fabs(actual - commanded) <= microstep / 2;
+
+    printf("%-8s: commanded %8.4f mm (expected %8.4f), actual %8.4f mm %s\n", name, commanded, expected, actual, ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    Stepper* motor_A = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    Stepper* motor_B = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor_A == NULL || motor_B == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    Stepper* motors[] = {motor_A, motor_B};
+    axis = axis_init(motors, 40, 2);
+    axis_set_speed(axis, TEST_SPEED);
+
+    printf("###### TEST -- SCAN OF %d MOVES OF %.3f mm ######\n", TEST_MOVES, TEST_DISTANCE);
+
+    for(int i = 0; i < TEST_MOVES; i++){
+        axis_move(axis, TEST_DISTANCE);
+        axis_wait(axis);
+    }
+    retval |= check("forth", TEST_MOVES * TEST_DISTANCE);
+
+    for(int i = 0; i < TEST_MOVES; i++){
+        axis_move(axis, -TEST_DISTANCE);
+        axis_wait(axis);
+    }
+    retval |= check("back", 0.0);
+
+    // Queued moves are rounded the same way, before they run
+    for(int i = 0; i < TEST_MOVES; i++){
+        if(axis_queue_move(axis, TEST_DISTANCE, TEST_SPEED) < 0){
+            axis_wait(axis); // Queue is full
+            axis_queue_move(axis, TEST_DISTANCE, TEST_SPEED);
+        }
+    }
+    axis_wait(axis);
+    retval |= check("queued", TEST_MOVES * TEST_DISTANCE);
+
+    stepper_destroy(motor_A);
+    stepper_destroy(motor_B);
+    free(axis);
+
+    return retval;
+}
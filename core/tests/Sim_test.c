@@ -0,0 +1,167 @@
+#include "Stepper.h"
+#include "GPIO_sim.h"
+#include "debug.h"
+#include <stdio.h>
+#include <math.h>
+
+/*
+ * Runs a motor on the simulated GPIO chip, and measures its pulse train from the recorded edges:
+ * amount of pulses, mean period, jitter of the period, and narrowest pulse. Needs no GPIO hardware,
+ * so the timing of the motion stack can be compared between machines and kernels.
+ * Then reverses the motor between moves, with its own thread and with the pulse engine, and checks
+ * that every DIR change is set up before the next rising edge of the STEP line.
+ * Last, checks that groups with lines on both GPIO controllers are refused, since a bulk is requested from a single chip.
+ */
+
+#define TEST_STEPS 2000
+#define TEST_STEP_PIN J21_HEADER_PIN_23
+#define TEST_DIR_PIN J21_HEADER_PIN_24
+#define TEST_REVERSE_STEPS 200
+#define TEST_REVERSE_PPS 2000
+#define TEST_AON_STEP_PIN J21_HEADER_PIN_31
+#define TEST_AON_DIR_PIN J21_HEADER_PIN_32
+
+static const unsigned int rates[] = {1000, 2000, 4000};
+
+static int measure(Stepper* motor, unsigned int pps)
+{
+    const GPIO_Edge* edges;
+    unsigned long long last_rise = 0, last_edge = 0, min_width = ~0ULL;
+    double sum = 0.0, sum_sq = 0.0, max_dev = 0.0;
+    unsigned int pulses = 0;
+
+    GPIO_sim_record(4 * TEST_STEPS);
+    stepper_set_speed(motor, pps);
+    stepper_step(motor, TEST_STEPS);
+    stepper_wait(motor);
+
+    size_t count = GPIO_sim_get_edges(&edges);
+    double period_ns = 1e9 / pps;
+    for(size_t i = 0; i < count; i++){
+        if(edges[i].pin != TEST_STEP_PIN)
+            continue;
+
+        if(edges[i].value){
+            if(pulses > 0){
+                double period = (double)(edges[i].t_ns - last_rise);
+                sum += period;
+                sum_sq += period * period;
+                max_dev = fmax(max_dev, fabs(period - period_ns));
+            }
+            last_rise = edges[i].t_ns;
+            pulses++;
+        } else if(pulses > 0 && edges[i].t_ns - last_edge < min_width)
+            min_width = edges[i].t_ns - last_edge;
+        last_edge = edges[i].t_ns;
+    }
+
+    double mean = sum / (pulses - 1);
+    double jitter = sqrt(sum_sq / (pulses - 1) - mean * mean);
+    // Timing depends on the machine running the test, so only the pulses are checked
+    int ok = pulses == TEST_STEPS && GPIO_sim_get_dropped() == 0;
+    printf("%6u pps: %u pulses, period %.0f ns (expected %.0f), jitter %.0f ns rms / %.0f ns max, min width %llu ns %s\n",
+           pps, pulses, mean, period_ns, jitter, max_dev, min_width, ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+static int reverse(Stepper* motor, const char* mode)
+{
+    const GPIO_Edge* edges;
+    const int moves[] = {TEST_REVERSE_STEPS, -TEST_REVERSE_STEPS, TEST_REVERSE_STEPS};
+    unsigned long long dir_ns = 0, min_setup = ~0ULL;
+    unsigned int pulses = 0, changes = 0;
+
+    // From the positive direction: an idle reversal, then three queued ones, back to the positive direction
+    GPIO_sim_record(8 * TEST_REVERSE_STEPS + 4);
+    stepper_set_speed(motor, TEST_REVERSE_PPS);
+    stepper_set_direction_rel(motor, DIRECTION_NEGATIVE);
+    stepper_step(motor, TEST_REVERSE_STEPS);
+    for(int i = 0; i < 3; i++)
+        stepper_queue_move(&motor, &moves[i], TEST_REVERSE_PPS, 1);
+    stepper_wait(motor);
+
+    size_t count = GPIO_sim_get_edges(&edges);
+    for(size_t i = 0; i < count; i++){
+        if(edges[i].pin == TEST_DIR_PIN){
+            dir_ns = edges[i].t_ns;
+            changes++;
+        } else if(edges[i].pin == TEST_STEP_PIN && edges[i].value){
+            if(dir_ns != 0 && edges[i].t_ns - dir_ns < min_setup)
+                min_setup = edges[i].t_ns - dir_ns;
+            dir_ns = 0;
+            pulses++;
+        }
+    }
+
+    int ok = pulses == 4 * TEST_REVERSE_STEPS && changes == 4 && min_setup >= STEPPER_DIR_SETUP_NS;
+    printf("%-8s: %u pulses, %u DIR changes, min setup %llu ns (%d ns required) %s\n", mode, pulses, changes,
+           min_setup, STEPPER_DIR_SETUP_NS, ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+static int mixed_controllers(Stepper* motor)
+{
+    int ok = 1;
+
+    Stepper* mixed = stepper_init("motor-mixed", TEST_STEP_PIN, TEST_AON_DIR_PIN, HALF, 200, DIRECTION_CLOCKWISE);
+    if(mixed != NULL){
+        stepper_destroy(mixed);
+        ok = 0;
+    }
+
+    Stepper* aon = stepper_init("motor-aon", TEST_AON_STEP_PIN, TEST_AON_DIR_PIN, HALF, 200, DIRECTION_CLOCKWISE);
+    if(aon == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+    Stepper* motors[2] = {motor, aon};
+    if(stepper_step_multiple(motors, TEST_REVERSE_STEPS, 2) == 0){
+        stepper_wait(motor);
+        ok = 0;
+    }
+    if(stepper_engine_init(motors, 2, 0, TIMING_SLEEP) == 0){
+        stepper_engine_destroy();
+        ok = 0;
+    }
+    stepper_destroy(aon);
+
+    printf("Motor, group and engine mixing the main and AON controllers refused %s\n", ok ? "" : "FAILED!");
+
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    GPIO_set_backend(&GPIO_backend_sim);
+
+    Stepper* motor = stepper_init("motor-A", TEST_STEP_PIN, TEST_DIR_PIN, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    printf("###### TEST -- PULSE TRAIN ON THE SIMULATED CHIP (%d steps) ######\n", TEST_STEPS);
+    for(unsigned int i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+        retval |= measure(motor, rates[i]);
+
+    puts("###### TEST -- DIR SETUP TIME ON REVERSALS ######");
+    retval |= reverse(motor, "thread");
+    if(stepper_engine_init(&motor, 1, 0, TIMING_SLEEP) < 0){
+        puts("Engine init FAILED!");
+        return -1;
+    }
+    retval |= reverse(motor, "engine");
+    stepper_engine_destroy();
+
+    puts("###### TEST -- LINES ON BOTH GPIO CONTROLLERS ######");
+    retval |= mixed_controllers(motor);
+
+    stepper_destroy(motor);
+    GPIO_sim_record(0);
+
+    return retval;
+}
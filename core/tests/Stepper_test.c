@@ -52,6 +52,15 @@ int main(int argc, char const *argv[])
     DEBUG_PRINT("Stop");
     stepper_stop(motor_B);
 
+    // Motor A takes 3 steps for every step of motor B, both finishing together
+    unsigned int steps[] = {6000, 2000};
+    int start_A = stepper_get_steps(motor_A), start_B = stepper_get_steps(motor_B);
+
+    DEBUG_PRINT("Stepping coordinated");
+    stepper_step_coordinated(axis, steps, 2);
+    stepper_wait(motor_A);
+    DEBUG_PRINT("Steps taken: A = %d, B = %d", stepper_get_steps(motor_A) - start_A, stepper_get_steps(motor_B) - start_B);
+
     while(1)
         Delay_ms(5000);
 
@@ -0,0 +1,88 @@
+#include "Stepper.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Stops a motor cruising at TEST_PPS, first immediately and then decelerating. The decelerating stop
+ * must ramp down over the braking distance v² / 2a, in about v / a, and report where it stopped.
+ * A stop in the middle of a queue of blended moves must also ramp down, and drop the moves left.
+ */
+
+#define TEST_PPS 4000
+#define TEST_ACCEL 4000
+#define TEST_STEPS 100000
+
+static Stepper* motor;
+
+static void cruise(void)
+{
+    stepper_set_direction_rel(motor, DIRECTION_POSITIVE);
+    stepper_step(motor, TEST_STEPS);
+    Delay_ms(2000); // Acceleration takes TEST_PPS / TEST_ACCEL seconds
+}
+
+static int check(const char* name, int steps, double seconds, int expected_steps, double expected_s)
+{
+    int ok = abs(steps - expected_steps) <= expected_steps / 10 + 2 && seconds < expected_s * 1.2 + 0.01;
+    printf("%-12s: %5d steps in %.3f s after the stop (expected %d in %.3f s) %s\n", name, steps, seconds, expected_steps, expected_s, ok ? "" : "FAILED!");
+    return ok ? 0 : -1;
+}
+
+int main(void)
+{
+    struct timespec t0, t1;
+    Stepper_position position;
+    int retval = 0;
+
+    motor = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    if(motor == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+    stepper_set_speed(motor, TEST_PPS);
+    stepper_set_acceleration(motor, TEST_ACCEL);
+
+    double brake_s = (double)TEST_PPS / TEST_ACCEL;
+    int brake_steps = TEST_PPS * TEST_PPS / (2 * TEST_ACCEL);
+
+    printf("###### TEST -- STOPS AT %d pps, %d pps/s ######\n", TEST_PPS, TEST_ACCEL);
+
+    // Immediate stop
+    cruise();
+    int start = stepper_get_steps(motor);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    stepper_stop(motor);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    retval |= check("immediate", stepper_get_steps(motor) - start, diff_time_ns(&t1, &t0) / 1e9, 0, 0.0);
+
+    // Decelerating stop
+    cruise();
+    start = stepper_get_steps(motor);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    stepper_stop_decel(motor, &position);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    retval |= check("decelerating", (int)position.steps - start, diff_time_ns(&t1, &t0) / 1e9, brake_steps, brake_s);
+
+    // Decelerating stop in a queue of blended moves, which don't stop between them
+    int moves[] = {2000};
+    start = stepper_get_steps(motor);
+    for(int i = 0; i < 6; i++)
+        stepper_queue_move(&motor, moves, TEST_PPS, 1);
+    Delay_ms(2500);
+    int before = stepper_get_steps(motor);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    stepper_stop_decel(motor, &position);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    retval |= check("queued", (int)position.steps - before, diff_time_ns(&t1, &t0) / 1e9, brake_steps, brake_s);
+    if(position.steps - start >= 6 * moves[0]){
+        puts("Queued moves were not dropped FAILED!");
+        retval = -1;
+    }
+
+    stepper_destroy(motor);
+
+    return retval;
+}
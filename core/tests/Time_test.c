@@ -1,4 +1,5 @@
 #include "Time.h"
+#include "debug.h"
 
 static int test_opstime(void)
 {
@@ -162,6 +163,39 @@ static int test_delays(void)
     sub_time(&stop, &start, &diff);
     DEBUG_PRINT("Diff: "), print_time(&diff);
 
+    puts("###### TEST -- US DELAY 100 REP WITH DELAY_UNTIL######");
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 1; i <= 100; i++){
+        add_time_ns(&start, (unsigned long long)i * del * NANO_IN_MICRO, &deadline);
+        Delay_until(&deadline);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &stop);
+    sub_time(&stop, &start, &diff);
+    DEBUG_PRINT("Diff: "), print_time(&diff);
+    DEBUG_PRINT("Drift: %lld ns", diff_time_ns(&stop, &deadline));
+
+    puts("###### TEST -- WAKEUP LATENCY, SLEEP VS SLEEP THEN SPIN ######");
+    long long spin = Delay_calibrate_spin(200);
+    long long late_sleep = 0, late_spin = 0;
+    int period = 25; // 40 kHz
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 1; i <= 1000; i++){
+        add_time_ns(&start, (unsigned long long)i * period * NANO_IN_MICRO, &deadline);
+        Delay_until(&deadline);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        late_sleep = (diff_time_ns(&stop, &deadline) > late_sleep) ? diff_time_ns(&stop, &deadline) : late_sleep;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 1; i <= 1000; i++){
+        add_time_ns(&start, (unsigned long long)i * period * NANO_IN_MICRO, &deadline);
+        Delay_until_spin(&deadline, spin);
+        clock_gettime(CLOCK_MONOTONIC, &stop);
+        late_spin = (diff_time_ns(&stop, &deadline) > late_spin) ? diff_time_ns(&stop, &deadline) : late_spin;
+    }
+    DEBUG_PRINT("Spin threshold: %lld ns", spin);
+    DEBUG_PRINT("Max latency, %d us period: sleep %lld ns, sleep then spin %lld ns", period, late_sleep, late_spin);
+
     return 0;
 }
 
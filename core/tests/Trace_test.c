@@ -0,0 +1,119 @@
+#include "Stepper.h"
+#include "Trace.h"
+#include "GPIO.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Traces a move of two motors with a thread, then with the pulse engine, and checks that every edge
+ * was recorded. The trace of the engine is saved, loaded back and written as trace_test.vcd.
+ */
+
+#define TEST_STEPS 1000
+#define TEST_PPS 2000
+#define TEST_CAPACITY 8192
+#define TEST_WINDOW_NS 2000
+#define TEST_BINS 64
+#define TEST_BIN_NS 50000
+
+static Stepper* motors[2];
+static Trace_event events[TEST_CAPACITY];
+static unsigned int bins[TEST_BINS];
+
+static int check_trace(const char* mode, Trace* trace)
+{
+    unsigned int steps[] = {TEST_STEPS, TEST_STEPS / 2};
+    int retval = 0;
+
+    stepper_step_coordinated(motors, steps, 2);
+    stepper_wait(motors[0]);
+
+    size_t count = trace_snapshot(trace, events, TEST_CAPACITY);
+
+    // Both edges of every step, all from the same request
+    unsigned int edges[2] = {0, 0};
+    for(size_t i = 0; i < count; i++){
+        for(int m = 0; m < 2; m++){
+            if(events[i].signal == TRACE_STEP && events[i].pin == motors[m]->step_pin->pin)
+                edges[m]++;
+        }
+        if(events[i].request != events[0].request)
+            retval = -1;
+    }
+
+    long periods = trace_histogram(events, count, motors[0]->step_pin->pin, TEST_BIN_NS, bins, TEST_BINS);
+
+    printf("%-8s: %zu events, STEP edges %u %u, %ld periods of motor A", mode, count, edges[0], edges[1], periods);
+    if(edges[0] != 2 * steps[0] || edges[1] != 2 * steps[1] || periods != TEST_STEPS - 1)
+        retval = -1;
+    puts(retval ? " FAILED!" : "");
+
+    return retval;
+}
+
+static int check_file(Trace* trace)
+{
+    Trace_event* loaded = NULL;
+    int retval = -1;
+
+    size_t count = trace_snapshot(trace, events, TEST_CAPACITY);
+    if(trace_save(trace, "trace_test.trace") < 0 || trace_load("trace_test.trace", &loaded) != (long)count){
+        puts("Save and load FAILED!");
+        goto exit;
+    }
+
+    FILE* vcd = fopen("trace_test.vcd", "w");
+    if(vcd == NULL || trace_write_vcd(loaded, count, vcd) < 0){
+        puts("VCD FAILED!");
+        goto exit;
+    }
+    fclose(vcd);
+
+    puts("Trace saved, loaded and written to trace_test.vcd");
+    retval = 0;
+
+exit:
+    free(loaded);
+    return retval;
+}
+
+int main(void)
+{
+    int retval = 0;
+
+    motors[0] = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    motors[1] = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    Trace* threads = trace_create(TEST_CAPACITY);
+    Trace* engine = trace_create(TEST_CAPACITY);
+    if(motors[0] == NULL || motors[1] == NULL || threads == NULL || engine == NULL){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    stepper_set_speed_multiple(motors, TEST_PPS, 2);
+
+    puts("###### TEST -- TRACE OF THE STEP EDGES ######");
+    stepper_set_trace(motors[0], threads);
+    retval |= check_trace("threads", threads);
+
+    if(stepper_engine_init(motors, 2, TEST_WINDOW_NS, TIMING_SLEEP) < 0){
+        puts("Engine init FAILED!");
+        return -1;
+    }
+    stepper_set_trace(motors[0], engine);
+    retval |= check_trace("engine", engine);
+    stepper_engine_destroy();
+
+    puts("###### TEST -- VCD EXPORT ######");
+    retval |= check_file(engine);
+
+    for(int i = 0; i < 2; i++){
+        stepper_set_trace(motors[i], NULL);
+        stepper_destroy(motors[i]);
+    }
+    trace_destroy(threads);
+    trace_destroy(engine);
+
+    return retval;
+}
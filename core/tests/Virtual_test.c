@@ -0,0 +1,133 @@
+#include "Axis.h"
+#include "Trace.h"
+#include "GPIO.h"
+#include "Time.h"
+#include "debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Runs a scan of several minutes on the virtual clock, twice with a thread per motor and twice with the
+ * pulse engine, and checks that both runs of each take the same virtual time and drive the same edges at
+ * the same times, relative to their start. The wall time every scan took is printed next to its virtual time.
+ */
+
+#define TEST_ROWS 31             // Odd, so every scan ends turned the way it started, and drives the same DIR changes
+#define TEST_ROW_LENGTH 100.0   // mm
+#define TEST_SPEED 20.0         // mm/sec
+#define TEST_DWELL_MS 500
+#define TEST_CAPACITY (1 << 18)
+
+static Axis* axis;
+static Trace* trace;
+
+static long long wall_ns(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+static long long virtual_now_ns(void)
+{
+    struct timespec t;
+    Time_now(&t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+// Scan forth and back, stopping between rows. Returns the edges, relative to the start of the scan.
+static size_t scan(Trace_event* events, long long* virtual_ns)
+{
+    long long t_wall = wall_ns();
+    long long t_start = virtual_now_ns();
+
+    for(int row = 0; row < TEST_ROWS; row++){
+        axis_move(axis, (row % 2) ? -TEST_ROW_LENGTH : TEST_ROW_LENGTH);
+        axis_wait(axis);
+        Delay_ms(TEST_DWELL_MS);
+    }
+
+    *virtual_ns = virtual_now_ns() - t_start;
+    size_t count = trace_snapshot(trace, events, TEST_CAPACITY);
+    for(size_t i = 0; i < count; i++)
+        events[i].t_ns -= t_start;
+
+    printf("Scan of %d rows: %.3f s of virtual time in %.3f s, %zu edges\n", TEST_ROWS, *virtual_ns / 1e9,
+           (wall_ns() - t_wall) / 1e9, count);
+
+    // Restarted for the next scan
+    trace_destroy(trace);
+    trace = trace_create(TEST_CAPACITY);
+    stepper_set_trace(axis->motors[0], trace);
+
+    return count;
+}
+
+int main(void)
+{
+    int retval = 0;
+    long long virtual_ns[4];
+    size_t count[4];
+
+    // Before the motors, so every delay of the stack runs on the virtual clock
+    if(Time_virtual_start() < 0){
+        puts("Virtual clock FAILED!");
+        return -1;
+    }
+
+    Stepper* motor_A = stepper_init("motor-A", J21_HEADER_PIN_23, J21_HEADER_PIN_24, HALF, 200, DIRECTION_CLOCKWISE);
+    Stepper* motor_B = stepper_init("motor-B", J21_HEADER_PIN_19, J21_HEADER_PIN_18, HALF, 200, DIRECTION_CLOCKWISE);
+    trace = trace_create(TEST_CAPACITY);
+    Trace_event* events[4];
+    int allocated = 1;
+    for(int run = 0; run < 4; run++){
+        events[run] = malloc(TEST_CAPACITY * sizeof(Trace_event));
+        allocated &= (events[run] != NULL);
+    }
+    if(motor_A == NULL || motor_B == NULL || trace == NULL || !allocated){
+        puts("Init FAILED!");
+        return -1;
+    }
+
+    Stepper* motors[] = {motor_A, motor_B};
+    axis = axis_init(motors, 40, 2);
+    axis_set_speed(axis, TEST_SPEED);
+    stepper_set_acceleration(motor_A, 2000);
+    stepper_set_trace(motor_A, trace);
+
+    puts("###### TEST -- SCAN ON THE VIRTUAL CLOCK ######");
+    for(int run = 0; run < 2; run++)
+        count[run] = scan(events[run], &virtual_ns[run]);
+
+    if(stepper_engine_init(motors, 2, 0, TIMING_SLEEP) < 0){
+        puts("Engine init FAILED!");
+        return -1;
+    }
+    for(int run = 2; run < 4; run++)
+        count[run] = scan(events[run], &virtual_ns[run]);
+    stepper_engine_destroy();
+
+    // Every row runs TEST_ROW_LENGTH mm of both motors, at 10 microsteps per mm, with both edges of every step.
+    // Both motors reverse between rows.
+    size_t expected = (size_t)(TEST_ROWS * TEST_ROW_LENGTH * 10) * 2 * 2 + (TEST_ROWS - 1) * 2;
+
+    for(int run = 0; run < 4; run += 2){
+        int same = (count[run] == count[run + 1] && virtual_ns[run] == virtual_ns[run + 1]);
+        for(size_t i = 0; i < count[run] && same; i++){
+            same = (events[run][i].t_ns == events[run + 1][i].t_ns && events[run][i].pin == events[run + 1][i].pin &&
+                    events[run][i].value == events[run + 1][i].value);
+        }
+
+        printf("%-8s: runs are %s, %zu edges of %zu expected %s\n", run ? "engine" : "threads", same ? "identical" : "different",
+               count[run], expected, (same && count[run] == expected) ? "" : "FAILED!");
+        if(!same || count[run] != expected)
+            retval = -1;
+    }
+
+    stepper_set_trace(motor_A, NULL);
+    trace_destroy(trace);
+    for(int run = 0; run < 4; run++)
+        free(events[run]);
+
+    return retval;
+}
@@ -0,0 +1,82 @@
+#include "Trace.h"
+#include "GPIO.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Converts a trace saved with trace_save() to a VCD file for GTKWave, and prints the histogram
+ * of the step periods of every STEP line in it.
+ *
+ * Usage: trace_dump <trace file> <vcd file> [bin width in us]
+ */
+
+#define DUMP_BINS 4096
+#define DUMP_LINES_MAX 64
+
+static unsigned int bins[DUMP_BINS];
+
+static void print_histogram(const Trace_event* events, long count, unsigned int pin, unsigned long long bin_ns)
+{
+    long periods = trace_histogram(events, count, pin, bin_ns, bins, DUMP_BINS);
+
+    printf("STEP line of pin %d: %ld periods\n", gpio_pin_to_int(pin), periods);
+    for(unsigned int i = 0; i < DUMP_BINS; i++){
+        if(bins[i] == 0)
+            continue;
+        if(i == DUMP_BINS - 1)
+            printf("  >= %10.3f us: %u\n", i * bin_ns / 1e3, bins[i]);
+        else
+            printf("  %10.3f us: %u\n", i * bin_ns / 1e3, bins[i]);
+    }
+}
+
+int main(int argc, char const *argv[])
+{
+    Trace_event* events = NULL;
+    unsigned int pins[DUMP_LINES_MAX];
+    unsigned int npins = 0;
+
+    if(argc != 3 && argc != 4){
+        printf("Usage: %s <trace file> <vcd file> [bin width in us]\n", argv[0]);
+        return -1;
+    }
+
+    unsigned long long bin_ns = (argc == 4) ? (unsigned long long)(atof(argv[3]) * 1e3) : 1000;
+    if(bin_ns == 0){
+        puts("Invalid bin width.");
+        return -1;
+    }
+
+    long count = trace_load(argv[1], &events);
+    if(count < 0){
+        puts("Could not load the trace.");
+        return -1;
+    }
+
+    FILE* vcd = fopen(argv[2], "w");
+    if(vcd == NULL || trace_write_vcd(events, count, vcd) < 0){
+        puts("Could not write the VCD file.");
+        free(events);
+        return -1;
+    }
+    fclose(vcd);
+
+    printf("%ld events written to %s\n", count, argv[2]);
+
+    // Histogram of every STEP line, in the order they first appear
+    for(long i = 0; i < count; i++){
+        unsigned int p = 0;
+        if(events[i].signal != TRACE_STEP)
+            continue;
+        while(p < npins && pins[p] != events[i].pin)
+            p++;
+        if(p == npins && npins < DUMP_LINES_MAX){
+            pins[npins++] = events[i].pin;
+            print_histogram(events, count, events[i].pin, bin_ns);
+        }
+    }
+
+    free(events);
+
+    return 0;
+}